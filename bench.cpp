@@ -0,0 +1,242 @@
+#include "bench.h"
+#include "camera.h"
+#include "clip_compression.h"
+#include "profiler.h"
+#include "render_device.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <fstream>
+#include <algorithm>
+#include <glload/gl_3_3.h>
+
+BenchScript::BenchScript() :
+	dt(BENCH_DT),
+	warmup_frames(BENCH_WARMUP),
+	frames(BENCH_FRAMES),
+	seed(BENCH_SEED),
+	stress(false) {
+}
+
+bool BenchScript::load(const std::string &path) {
+	std::ifstream file(path.c_str());
+	if(file.fail()) {
+		fprintf(stderr, "Bench: Failed to open %s\n", path.c_str());
+		return false;
+	}
+
+	char buffer[1024];
+	int linenr = 0;
+	while(file.getline(buffer, sizeof(buffer))) {
+		++linenr;
+		char * comment = strchr(buffer, '#');
+		if(comment != NULL)
+			*comment = '\0';
+
+		char command[32];
+		int end = 0;
+		if(sscanf(buffer, " %31s %n", command, &end) != 1)
+			continue; //Empty line
+		const char * args = buffer + end;
+
+		bool ok = false;
+		if(strcmp(command, "dt") == 0) {
+			ok = (sscanf(args, "%lf", &dt) == 1 && dt > 0);
+		} else if(strcmp(command, "warmup") == 0) {
+			ok = (sscanf(args, "%u", &warmup_frames) == 1);
+		} else if(strcmp(command, "frames") == 0) {
+			ok = (sscanf(args, "%u", &frames) == 1 && frames > 0);
+		} else if(strcmp(command, "seed") == 0) {
+			ok = (sscanf(args, "%u", &seed) == 1);
+		} else if(strcmp(command, "stress") == 0) {
+			stress = true;
+			ok = true;
+		} else if(strcmp(command, "camera") == 0) {
+			camera_key_t key;
+			glm::fquat &q = key.orientation;
+			ok = (sscanf(args, "%u %f %f %f %f %f %f %f", &key.frame, &key.position.x, &key.position.y, &key.position.z, &q.w, &q.x, &q.y, &q.z) == 8);
+			if(ok)
+				camera_path_.push_back(key);
+		} else if(strcmp(command, "key") == 0) {
+			input_event_t event;
+			int down;
+			ok = (sscanf(args, "%u %d %d", &event.frame, &event.key, &down) == 3 && event.key >= 0);
+			event.down = (down != 0);
+			if(ok)
+				input_.push_back(event);
+		}
+
+		if(!ok) {
+			fprintf(stderr, "Bench: %s:%d: Can't parse \"%s\"\n", path.c_str(), linenr, buffer);
+			return false;
+		}
+	}
+
+	//Later lines for the same frame win
+	std::stable_sort(camera_path_.begin(), camera_path_.end(), camera_key_order);
+	std::stable_sort(input_.begin(), input_.end(), input_event_order);
+	return true;
+}
+
+bool BenchScript::save(const std::string &path) const {
+	FILE * file = fopen(path.c_str(), "w");
+	if(file == NULL) {
+		fprintf(stderr, "Bench: Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	fprintf(file, "dt %.9g\nwarmup %u\nframes %u\nseed %u\n", dt, warmup_frames, frames, seed);
+	if(stress)
+		fprintf(file, "stress\n");
+	//Merged on frame, so a recording reads in order
+	std::vector<camera_key_t>::const_iterator c = camera_path_.begin();
+	std::vector<input_event_t>::const_iterator i = input_.begin();
+	while(c != camera_path_.end() || i != input_.end()) {
+		if(i != input_.end() && (c == camera_path_.end() || i->frame <= c->frame)) {
+			fprintf(file, "key %u %d %d\n", i->frame, i->key, i->down ? 1 : 0);
+			++i;
+		} else {
+			const glm::fquat &q = c->orientation;
+			fprintf(file, "camera %u %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", c->frame,
+				c->position.x, c->position.y, c->position.z, q.w, q.x, q.y, q.z);
+			++c;
+		}
+	}
+
+	bool ok = (ferror(file) == 0);
+	fclose(file);
+	if(ok)
+		printf("Wrote bench script to %s\n", path.c_str());
+	else
+		fprintf(stderr, "Bench: Failed to write %s\n", path.c_str());
+	return ok;
+}
+
+void BenchScript::apply_input(unsigned int frame, bool * keys) const {
+	std::vector<input_event_t>::const_iterator it = std::lower_bound(input_.begin(), input_.end(), frame, input_event_before);
+	for(; it != input_.end() && it->frame == frame; ++it) {
+		keys[it->key] = it->down;
+	}
+}
+
+void BenchScript::apply_camera(unsigned int frame, Camera &camera) const {
+	if(camera_path_.empty())
+		return;
+
+	//First key at or after frame, interpolate from the one before it
+	std::vector<camera_key_t>::const_iterator next = std::lower_bound(camera_path_.begin(), camera_path_.end(), frame, camera_key_before);
+	if(next == camera_path_.end()) {
+		--next;
+	} else if(next != camera_path_.begin() && next->frame != frame) {
+		std::vector<camera_key_t>::const_iterator prev = next - 1;
+		float factor = (frame - prev->frame)/(float)(next->frame - prev->frame);
+		camera.set_position(glm::mix(prev->position, next->position, factor));
+		camera.set_orientation(ClipCompression::slerp(prev->orientation, next->orientation, factor));
+		return;
+	}
+	camera.set_position(next->position);
+	camera.set_orientation(next->orientation);
+}
+
+void BenchScript::record(unsigned int frame, const Camera &camera, const bool * keys, unsigned int num_keys) {
+	camera_key_t key;
+	key.frame = frame;
+	key.position = camera.position();
+	key.orientation = camera.orientation();
+	camera_path_.push_back(key);
+
+	recorded_keys_.resize(num_keys, false);
+	for(unsigned int k=0; k < num_keys; ++k) {
+		if(keys[k] == recorded_keys_[k])
+			continue;
+		input_event_t event;
+		event.frame = frame;
+		event.key = k;
+		event.down = keys[k];
+		input_.push_back(event);
+		recorded_keys_[k] = keys[k];
+	}
+}
+
+//Nearest rank percentile of sorted times
+static double percentile(const std::vector<double> &sorted, double p) {
+	size_t rank = (size_t)ceil(p/100.0*sorted.size());
+	return sorted[(rank > 0) ? rank - 1 : 0];
+}
+
+static void write_distribution(FILE * file, const std::vector<double> &times) {
+	std::vector<double> sorted(times);
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0;
+	for(std::vector<double>::iterator it=sorted.begin(); it!=sorted.end(); ++it) {
+		sum += *it;
+	}
+	fprintf(file, "{\"frames\": %lu, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+		sorted.size(), 1000.0*sum/sorted.size(), 1000.0*percentile(sorted, 50), 1000.0*percentile(sorted, 95),
+		1000.0*percentile(sorted, 99), 1000.0*sorted.back());
+}
+
+//Escapes the characters JSON doesn't allow in strings, for paths and driver names
+static std::string json_string(const std::string &str) {
+	std::string escaped = "\"";
+	for(std::string::const_iterator it=str.begin(); it!=str.end(); ++it) {
+		if(*it == '"' || *it == '\\')
+			escaped += '\\';
+		if((unsigned char)*it >= 0x20)
+			escaped += *it;
+	}
+	return escaped + "\"";
+}
+
+bool write_bench_report(const std::string &path, const std::string &script_path, const BenchScript &script,
+	const std::vector<double> &cpu_frame_times, int width, int height) {
+
+	FILE * file = fopen(path.c_str(), "w");
+	if(file == NULL) {
+		fprintf(stderr, "Bench: Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	const char * renderer = (const char*) render_device()->get_string(GL_RENDERER);
+	fprintf(file, "{\n\"script\": %s,\n", json_string(script_path).c_str());
+	fprintf(file, "\"device\": %s,\n", json_string(render_device()->name()).c_str());
+	fprintf(file, "\"gl_renderer\": %s,\n", json_string(renderer != NULL ? renderer : "").c_str());
+	fprintf(file, "\"width\": %d, \"height\": %d, \"dt\": %.9g, \"warmup_frames\": %u, \"frames\": %u, \"seed\": %u,\n",
+		width, height, script.dt, script.warmup_frames, script.frames, script.seed);
+	fprintf(file, "\"unit\": \"ms\",\n\"cpu_frame\": ");
+	if(cpu_frame_times.empty())
+		fprintf(file, "null");
+	else
+		write_distribution(file, cpu_frame_times);
+
+	//The gpu time of a frame is its outermost scope, timer queries may be missing for some frames
+	std::map<std::string, std::vector<double> > gpu_times = Profiler::frame_times(true);
+	std::map<std::string, std::vector<double> >::iterator gpu_frame = gpu_times.find("Renderer::render");
+	fprintf(file, ",\n\"gpu_frame\": ");
+	if(gpu_frame == gpu_times.end())
+		fprintf(file, "null");
+	else
+		write_distribution(file, gpu_frame->second);
+
+	const char * kind[] = { "cpu", "gpu" };
+	for(int s=0; s < 2; ++s) {
+		std::map<std::string, std::vector<double> > times = (s == 0) ? Profiler::frame_times(false) : gpu_times;
+		fprintf(file, ",\n\"%s_scopes\": {", kind[s]);
+		for(std::map<std::string, std::vector<double> >::iterator it=times.begin(); it!=times.end(); ++it) {
+			fprintf(file, "%s\n\t%s: ", (it == times.begin()) ? "" : ",", json_string(it->first).c_str());
+			write_distribution(file, it->second);
+		}
+		fprintf(file, "\n}");
+	}
+	fprintf(file, "\n}\n");
+
+	bool ok = (ferror(file) == 0);
+	fclose(file);
+	if(ok)
+		printf("Wrote bench report to %s\n", path.c_str());
+	else
+		fprintf(stderr, "Bench: Failed to write %s\n", path.c_str());
+	return ok;
+}
@@ -0,0 +1,80 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class Camera;
+
+//Defaults of scripts that don't set them
+#define BENCH_DT (1.0/30)
+#define BENCH_WARMUP 60
+#define BENCH_FRAMES 600
+#define BENCH_SEED 1
+
+/*
+ * Script of a --bench run, a text file with one command per line (# starts a comment):
+ *
+ *   dt 0.0333333                   Fixed time step of every frame
+ *   warmup 60                      Frames rendered before measuring
+ *   frames 600                     Frames measured
+ *   seed 1                         rand() seed (see fix_random_seed())
+ *   stress                         Add the stress scene to the world
+ *   camera F x y z qw qx qy qz     Camera position and orientation at frame F, interpolated in between
+ *   key F K 0|1                    Sets keys[K] (an SDLKey) at frame F, before logic() reads it
+ *
+ * Frames count from the first warmup frame. Without camera commands the camera is moved by the
+ * keys only. --record writes the camera and keys of every frame of an interactive run as a script.
+ */
+class BenchScript {
+public:
+	BenchScript();
+
+	//Prints the error and returns false if the file can't be read or a line isn't understood
+	bool load(const std::string &path);
+	//Returns false if the file can't be written
+	bool save(const std::string &path) const;
+
+	//Sets the keys changed at frame, call before logic()
+	void apply_input(unsigned int frame, bool * keys) const;
+	//Moves the camera to its place on the path at frame, call after logic(). Does nothing without a path
+	void apply_camera(unsigned int frame, Camera &camera) const;
+
+	//Adds the camera and the keys changed since the last recorded frame, frames must be recorded in order
+	void record(unsigned int frame, const Camera &camera, const bool * keys, unsigned int num_keys);
+
+	double dt;
+	unsigned int warmup_frames, frames;
+	unsigned int seed;
+	bool stress;
+
+private:
+	struct camera_key_t {
+		unsigned int frame;
+		glm::vec3 position;
+		glm::fquat orientation;
+	};
+
+	struct input_event_t {
+		unsigned int frame;
+		int key;
+		bool down;
+	};
+
+	static bool camera_key_order(const camera_key_t &a, const camera_key_t &b) { return a.frame < b.frame; };
+	static bool input_event_order(const input_event_t &a, const input_event_t &b) { return a.frame < b.frame; };
+	static bool camera_key_before(const camera_key_t &key, unsigned int frame) { return key.frame < frame; };
+	static bool input_event_before(const input_event_t &event, unsigned int frame) { return event.frame < frame; };
+
+	std::vector<camera_key_t> camera_path_; //Sorted on frame
+	std::vector<input_event_t> input_; //Sorted on frame
+	std::vector<bool> recorded_keys_; //State after the last record()
+};
+
+//Writes mean, p50, p95, p99 and max of the frame times (seconds) and of every profiler scope as JSON
+bool write_bench_report(const std::string &path, const std::string &script_path, const BenchScript &script,
+	const std::vector<double> &cpu_frame_times, int width, int height);
+
+#endif
@@ -0,0 +1,310 @@
+#include "buffer_arena.h"
+#include "packed_vertex.h"
+#include "renderer.h"
+#include "gl_state.h"
+#include "render_device.h"
+
+#include <map>
+#include <vector>
+#include <cstdio>
+#include <cassert>
+#include <algorithm>
+#include <stdint.h>
+
+//Index ranges are kept 4 byte aligned so 16 and 32 bit meshes can share a buffer
+#define INDEX_ALIGNMENT 4
+
+std::map<unsigned int, BufferArena*> BufferArena::arenas_;
+
+BufferArena * BufferArena::for_format(unsigned int format) {
+	unsigned int layout = format & PackedVertex::LAYOUT_FLAGS;
+	std::map<unsigned int, BufferArena*>::iterator it = arenas_.find(layout);
+	if(it != arenas_.end())
+		return it->second;
+
+	BufferArena * arena = new BufferArena(layout);
+	arenas_[layout] = arena;
+	return arena;
+}
+
+BufferArena::BufferArena(unsigned int format) :
+	format_(format),
+	vertex_size_(PackedVertex::vertex_size(format)) { }
+
+BufferArena::allocation_t * BufferArena::allocate(unsigned int format, const void * vertices, unsigned int num_vertices, const void * indices, unsigned int num_indices) {
+	assert((format & PackedVertex::LAYOUT_FLAGS) == format_);
+	size_t index_bytes = PackedVertex::index_size(format)*num_indices;
+
+	page_t * page = NULL;
+	size_t vertex_offset = 0, index_offset = 0;
+	for(std::vector<page_t*>::iterator it=pages_.begin(); it!=pages_.end(); ++it) {
+		vertex_offset = (*it)->vertex_space.allocate(num_vertices, 1);
+		if(vertex_offset == (*it)->vertex_space.size())
+			continue;
+		index_offset = (*it)->index_space.allocate(index_bytes, INDEX_ALIGNMENT);
+		if(index_offset == (*it)->index_space.size()) {
+			(*it)->vertex_space.free(vertex_offset, num_vertices);
+			continue;
+		}
+		page = *it;
+		break;
+	}
+
+	if(page == NULL) {
+		page = create_page(std::max((size_t)ARENA_PAGE_VERTICES, (size_t)num_vertices),
+			std::max((size_t)ARENA_PAGE_INDEX_BYTES, index_bytes));
+		vertex_offset = page->vertex_space.allocate(num_vertices, 1);
+		index_offset = page->index_space.allocate(index_bytes, INDEX_ALIGNMENT);
+	}
+
+	allocation_t * allocation = new allocation_t();
+	allocation->base_vertex = vertex_offset;
+	allocation->num_vertices = num_vertices;
+	allocation->index_offset = index_offset;
+	allocation->num_indices = num_indices;
+	allocation->index_type = PackedVertex::index_type(format);
+	allocation->page = page;
+	page->allocations.push_back(allocation);
+
+	//Upload through the copy target, binding the element array buffer would change the bound vao
+	GLState::bind_buffer(GL_COPY_WRITE_BUFFER, page->vb);
+	render_device()->buffer_sub_data(GL_COPY_WRITE_BUFFER, vertex_offset*vertex_size_, num_vertices*vertex_size_, vertices);
+	GLState::bind_buffer(GL_COPY_WRITE_BUFFER, page->ib);
+	render_device()->buffer_sub_data(GL_COPY_WRITE_BUFFER, index_offset, index_bytes, indices);
+	Renderer::checkForGLErrors("BufferArena::allocate()");
+
+	return allocation;
+}
+
+void BufferArena::free(allocation_t * allocation) {
+	page_t * page = allocation->page;
+	BufferArena * arena = page->arena;
+
+	page->vertex_space.free(allocation->base_vertex, allocation->num_vertices);
+	page->index_space.free(allocation->index_offset, index_bytes(allocation));
+	page->allocations.erase(std::find(page->allocations.begin(), page->allocations.end(), allocation));
+	delete allocation;
+
+	//Keep one page around for the next mesh
+	if(page->allocations.empty() && arena->pages_.size() > 1)
+		arena->delete_page(page);
+}
+
+void BufferArena::bind(const allocation_t * allocation) {
+	GLState::bind_vertex_array(allocation->page->vao);
+}
+
+GLuint BufferArena::vao(const allocation_t * allocation) {
+	return allocation->page->vao;
+}
+
+void BufferArena::draw(const allocation_t * allocation) {
+	bind(allocation);
+	render_device()->draw_elements_base_vertex(GL_TRIANGLES, allocation->num_indices, allocation->index_type,
+		(const GLvoid*) allocation->index_offset, allocation->base_vertex);
+}
+
+void BufferArena::draw_instanced(const allocation_t * allocation, unsigned int instances) {
+	bind(allocation);
+	render_device()->draw_elements_instanced_base_vertex(GL_TRIANGLES, allocation->num_indices, allocation->index_type,
+		(const GLvoid*) allocation->index_offset, instances, allocation->base_vertex);
+}
+
+BufferArena::page_t * BufferArena::create_page(size_t num_vertices, size_t index_bytes) {
+	page_t * page = new page_t(num_vertices, index_bytes);
+	page->arena = this;
+
+	render_device()->gen_buffers(1, &page->vb);
+	GLState::bind_buffer(GL_COPY_WRITE_BUFFER, page->vb);
+	render_device()->buffer_data(GL_COPY_WRITE_BUFFER, num_vertices*vertex_size_, NULL, GL_STATIC_DRAW);
+
+	render_device()->gen_buffers(1, &page->ib);
+	GLState::bind_buffer(GL_COPY_WRITE_BUFFER, page->ib);
+	render_device()->buffer_data(GL_COPY_WRITE_BUFFER, index_bytes, NULL, GL_STATIC_DRAW);
+
+	render_device()->gen_vertex_arrays(1, &page->vao);
+	setup_vao(page);
+	Renderer::checkForGLErrors("BufferArena::create_page()");
+
+	pages_.push_back(page);
+	return page;
+}
+
+void BufferArena::delete_page(page_t * page) {
+	GLState::delete_vertex_array(page->vao);
+	GLState::delete_buffer(page->vb);
+	GLState::delete_buffer(page->ib);
+	pages_.erase(std::find(pages_.begin(), pages_.end(), page));
+	delete page;
+}
+
+void BufferArena::setup_vao(page_t * page) {
+	GLState::bind_vertex_array(page->vao);
+	GLState::bind_buffer(GL_ARRAY_BUFFER, page->vb);
+	PackedVertex::set_attrib_pointers(format_);
+	GLState::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, page->ib);
+
+	GLValidation::label(GL_VERTEX_ARRAY, page->vao, "BufferArena page");
+	GLValidation::label(GL_BUFFER, page->vb, "BufferArena vertices");
+	GLValidation::label(GL_BUFFER, page->ib, "BufferArena indices");
+}
+
+void BufferArena::defragment(float threshold) {
+	for(std::vector<page_t*>::iterator it=pages_.begin(); it!=pages_.end(); ++it) {
+		page_t * page = *it;
+		float fragmentation = std::max(page->vertex_space.fragmentation(), page->index_space.fragmentation());
+		if(fragmentation > threshold)
+			compact(page);
+	}
+}
+
+void BufferArena::defragment_all(float threshold) {
+	for(std::map<unsigned int, BufferArena*>::iterator it=arenas_.begin(); it!=arenas_.end(); ++it) {
+		it->second->defragment(threshold);
+	}
+}
+
+/*
+ * Copies all allocations to the start of new buffers.
+ * Copying within the same buffer is not allowed when the ranges overlap, so new buffers are used.
+ */
+void BufferArena::compact(page_t * page) {
+	GLuint vb, ib;
+	render_device()->gen_buffers(1, &vb);
+	GLState::bind_buffer(GL_COPY_WRITE_BUFFER, vb);
+	render_device()->buffer_data(GL_COPY_WRITE_BUFFER, page->vertex_space.size()*vertex_size_, NULL, GL_STATIC_DRAW);
+	render_device()->gen_buffers(1, &ib);
+	GLState::bind_buffer(GL_COPY_WRITE_BUFFER, ib);
+	render_device()->buffer_data(GL_COPY_WRITE_BUFFER, page->index_space.size(), NULL, GL_STATIC_DRAW);
+
+	size_t vertex_end = 0, index_end = 0;
+	for(std::vector<allocation_t*>::iterator it=page->allocations.begin(); it!=page->allocations.end(); ++it) {
+		allocation_t * a = *it;
+		size_t a_index_bytes = index_bytes(a);
+
+		GLState::bind_buffer(GL_COPY_READ_BUFFER, page->vb);
+		GLState::bind_buffer(GL_COPY_WRITE_BUFFER, vb);
+		render_device()->copy_buffer_sub_data(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, a->base_vertex*vertex_size_, vertex_end*vertex_size_, a->num_vertices*vertex_size_);
+		a->base_vertex = vertex_end;
+		vertex_end += a->num_vertices;
+
+		index_end = (index_end + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT * INDEX_ALIGNMENT;
+		GLState::bind_buffer(GL_COPY_READ_BUFFER, page->ib);
+		GLState::bind_buffer(GL_COPY_WRITE_BUFFER, ib);
+		render_device()->copy_buffer_sub_data(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, a->index_offset, index_end, a_index_bytes);
+		a->index_offset = index_end;
+		index_end += a_index_bytes;
+	}
+
+	GLState::delete_buffer(page->vb);
+	GLState::delete_buffer(page->ib);
+	page->vb = vb;
+	page->ib = ib;
+	setup_vao(page);
+
+	page->vertex_space.reset(vertex_end);
+	page->index_space.reset(index_end);
+
+	Renderer::checkForGLErrors("BufferArena::compact()");
+}
+
+size_t BufferArena::index_bytes(const allocation_t * allocation) {
+	size_t index_size = (allocation->index_type == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+	return index_size*allocation->num_indices;
+}
+
+void BufferArena::print_stats() const {
+	printf("Buffer arena (format %x): %lu pages\n", format_, pages_.size());
+	for(unsigned int i=0; i < pages_.size(); ++i) {
+		const page_t * page = pages_[i];
+		const FreeList &v = page->vertex_space;
+		const FreeList &ix = page->index_space;
+		printf("  page %u: %lu meshes, vertices %lu/%lu used in %u free blocks (%.0f%% fragmented), index bytes %lu/%lu used in %u free blocks (%.0f%% fragmented)\n",
+			i, page->allocations.size(),
+			v.size() - v.free_space(), v.size(), v.num_blocks(), 100.f*v.fragmentation(),
+			ix.size() - ix.free_space(), ix.size(), ix.num_blocks(), 100.f*ix.fragmentation());
+	}
+}
+
+void BufferArena::print_stats_all() {
+	for(std::map<unsigned int, BufferArena*>::const_iterator it=arenas_.begin(); it!=arenas_.end(); ++it) {
+		it->second->print_stats();
+	}
+}
+
+BufferArena::FreeList::FreeList(size_t size) : size_(size) {
+	reset(0);
+}
+
+size_t BufferArena::FreeList::allocate(size_t size, size_t alignment) {
+	if(size == 0)
+		return 0;
+
+	for(std::map<size_t, size_t>::iterator it=free_.begin(); it!=free_.end(); ++it) {
+		size_t block_start = it->first;
+		size_t block_end = it->first + it->second;
+		size_t start = (block_start + alignment - 1) / alignment * alignment;
+		if(start + size > block_end)
+			continue;
+
+		free_.erase(it);
+		if(start > block_start)
+			free_[block_start] = start - block_start;
+		if(start + size < block_end)
+			free_[start + size] = block_end - (start + size);
+		return start;
+	}
+	return size_;
+}
+
+void BufferArena::FreeList::free(size_t offset, size_t size) {
+	if(size == 0)
+		return;
+
+	//Merge with the blocks before and after
+	std::map<size_t, size_t>::iterator next = free_.lower_bound(offset);
+	if(next != free_.begin()) {
+		std::map<size_t, size_t>::iterator prev = next;
+		--prev;
+		assert(prev->first + prev->second <= offset);
+		if(prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			free_.erase(prev);
+		}
+	}
+	if(next != free_.end() && offset + size == next->first) {
+		size += next->second;
+		free_.erase(next);
+	}
+	free_[offset] = size;
+}
+
+void BufferArena::FreeList::reset(size_t used) {
+	free_.clear();
+	if(used < size_)
+		free_[used] = size_ - used;
+}
+
+size_t BufferArena::FreeList::free_space() const {
+	size_t total = 0;
+	for(std::map<size_t, size_t>::const_iterator it=free_.begin(); it!=free_.end(); ++it) {
+		total += it->second;
+	}
+	return total;
+}
+
+size_t BufferArena::FreeList::largest_block() const {
+	size_t largest = 0;
+	for(std::map<size_t, size_t>::const_iterator it=free_.begin(); it!=free_.end(); ++it) {
+		largest = std::max(largest, it->second);
+	}
+	return largest;
+}
+
+float BufferArena::FreeList::fragmentation() const {
+	size_t total = free_space();
+	if(total == 0)
+		return 0.f;
+	return 1.f - largest_block()/(float)total;
+}
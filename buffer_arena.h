@@ -0,0 +1,114 @@
+#ifndef BUFFER_ARENA_H
+#define BUFFER_ARENA_H
+
+#include <map>
+#include <vector>
+#include <cstddef>
+#include <glload/gl_3_3.h>
+
+//Default size of each vertex/index buffer pair, larger meshes get a page of their own
+#define ARENA_PAGE_VERTICES (256*1024)
+#define ARENA_PAGE_INDEX_BYTES (4*1024*1024)
+
+//Pages with more of their free space split up than this are compacted by defragment()
+#define ARENA_DEFRAGMENT_THRESHOLD 0.5f
+
+/*
+ * Shared vertex and index buffers for meshes with the same PackedVertex layout.
+ *
+ * Instead of a buffer pair per mesh the arena keeps a few large buffers (pages) and hands out
+ * ranges of them. Each page has one vao, so all meshes in a page draw with the same vao
+ * and glDrawElementsBaseVertex.
+ *
+ * All functions must be called from the GL thread.
+ */
+class BufferArena {
+	struct page_t;
+public:
+	//A mesh in the arena, the offsets may be changed by defragment()
+	struct allocation_t {
+		unsigned int base_vertex;
+		unsigned int num_vertices;
+		size_t index_offset; //In bytes
+		unsigned int num_indices;
+		GLenum index_type;
+	private:
+		page_t * page;
+		friend class BufferArena;
+	};
+
+	//The arena for meshes packed with format (only PackedVertex::LAYOUT_FLAGS matter)
+	static BufferArena * for_format(unsigned int format);
+
+	//Allocates and uploads one mesh, vertices and indices are in the packed format
+	allocation_t * allocate(unsigned int format, const void * vertices, unsigned int num_vertices, const void * indices, unsigned int num_indices);
+	static void free(allocation_t * allocation);
+
+	//Binds the vao of the page the allocation is in
+	static void bind(const allocation_t * allocation);
+	//The vao of the page, allocations with the same vao can be drawn without binding another
+	static GLuint vao(const allocation_t * allocation);
+	//Binds and draws the whole mesh with GL_TRIANGLES
+	static void draw(const allocation_t * allocation);
+	//Same as draw() with glDrawElementsInstancedBaseVertex, the instance attributes must be set up by the caller
+	static void draw_instanced(const allocation_t * allocation, unsigned int instances);
+
+	/*
+	 * Compacts pages where the free space is more fragmented than threshold
+	 * (0: free space in one block, 1: split in many small blocks)
+	 */
+	void defragment(float threshold=ARENA_DEFRAGMENT_THRESHOLD);
+	static void defragment_all(float threshold=ARENA_DEFRAGMENT_THRESHOLD);
+
+	void print_stats() const;
+	static void print_stats_all();
+
+private:
+	BufferArena(unsigned int format);
+	//Copy not allowed (no body implemented, intentional!)
+	BufferArena(const BufferArena &other);
+
+	/*
+	 * First fit allocator of ranges in [0, size), adjacent free blocks are merged
+	 */
+	class FreeList {
+		std::map<size_t, size_t> free_; //offset -> size
+		size_t size_;
+	public:
+		FreeList(size_t size);
+		//Returns size() if there is no room
+		size_t allocate(size_t size, size_t alignment);
+		void free(size_t offset, size_t size);
+		void reset(size_t used);
+
+		size_t size() const { return size_; };
+		size_t free_space() const;
+		size_t largest_block() const;
+		unsigned int num_blocks() const { return free_.size(); };
+		float fragmentation() const;
+	};
+
+	struct page_t {
+		page_t(size_t num_vertices, size_t index_bytes) : vertex_space(num_vertices), index_space(index_bytes) {};
+		GLuint vb, ib, vao;
+		FreeList vertex_space; //In vertices
+		FreeList index_space; //In bytes
+		std::vector<allocation_t*> allocations;
+		BufferArena * arena;
+	};
+
+	page_t * create_page(size_t num_vertices, size_t index_bytes);
+	void delete_page(page_t * page);
+	void setup_vao(page_t * page);
+	void compact(page_t * page);
+
+	static size_t index_bytes(const allocation_t * allocation);
+
+	static std::map<unsigned int, BufferArena*> arenas_;
+
+	unsigned int format_;
+	size_t vertex_size_;
+	std::vector<page_t*> pages_;
+};
+
+#endif
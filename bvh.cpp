@@ -0,0 +1,176 @@
+#include "bvh.h"
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+
+BVH::BVH() : needs_rebuild_(true), built_area_(0), rebuilds_(0), nodes_tested_(0) { }
+
+void BVH::resize(unsigned int count) {
+	if(count == size())
+		return;
+
+	min_x_.resize(count);
+	min_y_.resize(count);
+	min_z_.resize(count);
+	max_x_.resize(count);
+	max_y_.resize(count);
+	max_z_.resize(count);
+	needs_rebuild_ = true;
+}
+
+void BVH::set_bounds(unsigned int item, const glm::vec3 &min, const glm::vec3 &max) {
+	min_x_[item] = min.x;
+	min_y_[item] = min.y;
+	min_z_[item] = min.z;
+	max_x_[item] = max.x;
+	max_y_[item] = max.y;
+	max_z_[item] = max.z;
+}
+
+void BVH::update() {
+	if(needs_rebuild_) {
+		rebuild();
+		return;
+	}
+
+	float area = refit();
+	if(built_area_ > 0.f && area > built_area_ * BVH_REBUILD_GROWTH)
+		rebuild();
+}
+
+void BVH::rebuild() {
+	nodes_.clear();
+	needs_rebuild_ = false;
+	++rebuilds_;
+	if(size() == 0) {
+		built_area_ = 0;
+		return;
+	}
+
+	build_items_.resize(size());
+	for(unsigned int i=0; i < size(); ++i) {
+		build_items_[i] = i;
+	}
+	build(0, size());
+	built_area_ = refit();
+}
+
+unsigned int BVH::build(unsigned int begin, unsigned int end) {
+	unsigned int index = nodes_.size();
+	nodes_.push_back(node_t());
+
+	int children[BVH_WIDTH];
+	std::fill(children, children + BVH_WIDTH, 0);
+
+	if(end - begin <= BVH_WIDTH) {
+		for(unsigned int i=begin; i < end; ++i) {
+			children[i - begin] = ~(int)build_items_[i];
+		}
+	} else {
+		//Two levels of binary splits give the four children
+		unsigned int mid = split(begin, end);
+		unsigned int groups[BVH_WIDTH + 1] = { begin, split(begin, mid), mid, split(mid, end), end };
+		for(int g=0; g < BVH_WIDTH; ++g) {
+			if(groups[g + 1] - groups[g] == 1)
+				children[g] = ~(int)build_items_[groups[g]];
+			else
+				children[g] = build(groups[g], groups[g + 1]);
+		}
+	}
+
+	//nodes_ may have been reallocated by the recursion
+	std::copy(children, children + BVH_WIDTH, nodes_[index].children);
+	return index;
+}
+
+unsigned int BVH::split(unsigned int begin, unsigned int end) {
+	//Box centers times two, the scale doesn't matter for sorting
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for(unsigned int i=begin; i < end; ++i) {
+		unsigned int item = build_items_[i];
+		glm::vec3 c(min_x_[item] + max_x_[item], min_y_[item] + max_y_[item], min_z_[item] + max_z_[item]);
+		lo = glm::min(lo, c);
+		hi = glm::max(hi, c);
+	}
+
+	glm::vec3 size = hi - lo;
+	const std::vector<float> *min = &min_x_, *max = &max_x_;
+	if(size.y > size.x && size.y >= size.z) {
+		min = &min_y_;
+		max = &max_y_;
+	} else if(size.z > size.x && size.z > size.y) {
+		min = &min_z_;
+		max = &max_z_;
+	}
+
+	unsigned int mid = begin + (end - begin) / 2;
+	std::nth_element(build_items_.begin() + begin, build_items_.begin() + mid, build_items_.begin() + end,
+		[min, max](unsigned int a, unsigned int b) {
+			return (*min)[a] + (*max)[a] < (*min)[b] + (*max)[b];
+		});
+	return mid;
+}
+
+float BVH::refit() {
+	float area = 0.f;
+
+	//Children come after their parents, so going backwards they are done first
+	for(int n=(int)nodes_.size() - 1; n >= 0; --n) {
+		node_t &node = nodes_[n];
+		for(int c=0; c < BVH_WIDTH; ++c) {
+			int child = node.children[c];
+			if(child < 0) {
+				unsigned int item = ~child;
+				node.min_x[c] = min_x_[item];
+				node.min_y[c] = min_y_[item];
+				node.min_z[c] = min_z_[item];
+				node.max_x[c] = max_x_[item];
+				node.max_y[c] = max_y_[item];
+				node.max_z[c] = max_z_[item];
+			} else if(child == 0) {
+				//Inverted box, outside any frustum and ignored by the min and max below
+				node.min_x[c] = node.min_y[c] = node.min_z[c] = FLT_MAX;
+				node.max_x[c] = node.max_y[c] = node.max_z[c] = -FLT_MAX;
+			} else {
+				const node_t &cn = nodes_[child];
+				node.min_x[c] = *std::min_element(cn.min_x, cn.min_x + BVH_WIDTH);
+				node.min_y[c] = *std::min_element(cn.min_y, cn.min_y + BVH_WIDTH);
+				node.min_z[c] = *std::min_element(cn.min_z, cn.min_z + BVH_WIDTH);
+				node.max_x[c] = *std::max_element(cn.max_x, cn.max_x + BVH_WIDTH);
+				node.max_y[c] = *std::max_element(cn.max_y, cn.max_y + BVH_WIDTH);
+				node.max_z[c] = *std::max_element(cn.max_z, cn.max_z + BVH_WIDTH);
+
+				glm::vec3 size(node.max_x[c] - node.min_x[c], node.max_y[c] - node.min_y[c], node.max_z[c] - node.min_z[c]);
+				area += 2.f * (size.x*size.y + size.y*size.z + size.z*size.x);
+			}
+		}
+	}
+	return area;
+}
+
+void BVH::cull(const Frustum &frustum, std::vector<unsigned int> &visible) {
+	nodes_tested_ = 0;
+	if(nodes_.empty())
+		return;
+
+	char inside[BVH_WIDTH];
+	stack_.clear();
+	stack_.push_back(0);
+	while(!stack_.empty()) {
+		const node_t &node = nodes_[stack_.back()];
+		stack_.pop_back();
+		++nodes_tested_;
+
+		frustum.intersects_boxes(node.min_x, node.min_y, node.min_z, node.max_x, node.max_y, node.max_z, BVH_WIDTH, inside);
+		for(int c=0; c < BVH_WIDTH; ++c) {
+			int child = node.children[c];
+			if(!inside[c] || child == 0)
+				continue;
+			if(child < 0)
+				visible.push_back(~child);
+			else
+				stack_.push_back(child);
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+
+//Children per node, the bounds of all children are tested against a plane at once
+#define BVH_WIDTH 4
+
+//The tree is rebuilt when refitting has grown the summed area of its nodes by this factor since the last build
+#define BVH_REBUILD_GROWTH 1.5f
+
+/*
+ * Bounding volume hierarchy over a set of axis aligned boxes, for culling many objects
+ * at a cost that depends on how many are visible instead of how many there are.
+ *
+ * Each node holds the boxes of its (up to BVH_WIDTH) children as separate coordinate arrays,
+ * so Frustum::intersects_boxes tests them together.
+ * Moving items only refits the boxes (linear, no allocation), the tree is rebuilt when the
+ * number of items changes or the refitted boxes have grown too loose.
+ */
+class BVH {
+public:
+	BVH();
+
+	//Changes the number of items, set the bounds of all items before the next update()
+	void resize(unsigned int count);
+	unsigned int size() const { return min_x_.size(); };
+
+	void set_bounds(unsigned int item, const glm::vec3 &min, const glm::vec3 &max);
+
+	//Refits or rebuilds the tree to the current bounds, call after changing bounds and before cull()
+	void update();
+
+	//Appends the items whose bounds intersect the frustum to visible
+	void cull(const Frustum &frustum, std::vector<unsigned int> &visible);
+
+	unsigned int num_nodes() const { return nodes_.size(); };
+	//Since construction
+	unsigned int rebuilds() const { return rebuilds_; };
+	//Nodes tested by the last cull()
+	unsigned int nodes_tested() const { return nodes_tested_; };
+
+private:
+	//Copy not allowed (no body implemented, intentional!)
+	BVH(const BVH &other);
+
+	struct node_t {
+		float min_x[BVH_WIDTH], min_y[BVH_WIDTH], min_z[BVH_WIDTH];
+		float max_x[BVH_WIDTH], max_y[BVH_WIDTH], max_z[BVH_WIDTH];
+		/*
+		 * Index of an inner node, ~item for an item, or 0 for an unused slot
+		 * (the root is never a child). Children come after their parent in nodes_.
+		 */
+		int children[BVH_WIDTH];
+	};
+
+	void rebuild();
+	//Builds a node over items [begin, end), returns its index
+	unsigned int build(unsigned int begin, unsigned int end);
+	//Splits [begin, end) at the median of the box centers along their widest axis
+	unsigned int split(unsigned int begin, unsigned int end);
+	//Updates all boxes bottom up, returns the summed surface area of the inner nodes
+	float refit();
+
+	std::vector<node_t> nodes_;
+
+	//Bounds of each item
+	std::vector<float> min_x_, min_y_, min_z_;
+	std::vector<float> max_x_, max_y_, max_z_;
+
+	std::vector<unsigned int> build_items_; //Scratch for build()
+	std::vector<int> stack_; //Scratch for cull()
+
+	bool needs_rebuild_;
+	float built_area_;
+	unsigned int rebuilds_;
+	unsigned int nodes_tested_;
+};
+
+#endif
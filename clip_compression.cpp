@@ -0,0 +1,108 @@
+#include "clip_compression.h"
+
+#include <cmath>
+#include <algorithm>
+
+static float error(const glm::vec3 &a, const glm::vec3 &b) {
+	return glm::length(a - b);
+}
+
+//Angle between the rotations, from the chord length since acos is too imprecise close to 1
+static float error(const glm::fquat &a, const glm::fquat &b) {
+	float s = (a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w < 0.f) ? -1.f : 1.f;
+	float dx = a.x - s*b.x, dy = a.y - s*b.y, dz = a.z - s*b.z, dw = a.w - s*b.w;
+	float chord = sqrt(dx*dx + dy*dy + dz*dz + dw*dw);
+	return 4.f * asin(std::min(chord/2.f, 1.f));
+}
+
+static glm::vec3 blend(const glm::vec3 &a, const glm::vec3 &b, float factor) {
+	return glm::mix(a, b, factor);
+}
+
+static glm::fquat blend(const glm::fquat &a, const glm::fquat &b, float factor) {
+	return ClipCompression::slerp(a, b, factor);
+}
+
+/*
+ * Greedy reduction: starting from the last kept key, skip keys as long as interpolating
+ * from the kept key to the key after the skipped ones is within tolerance for all of them.
+ */
+template<typename T>
+static void reduce_track(std::vector<float> &times, std::vector<T> &values, float tolerance) {
+	if(times.size() < 2)
+		return;
+
+	std::vector<unsigned int> keep;
+	keep.push_back(0);
+	unsigned int anchor = 0;
+	for(unsigned int i=1; i+1 < times.size(); ++i) {
+		float interval = times[i+1] - times[anchor];
+		bool removable = interval > 0.f;
+		for(unsigned int k=anchor+1; removable && k <= i; ++k) {
+			T v = blend(values[anchor], values[i+1], (times[k] - times[anchor]) / interval);
+			removable = error(v, values[k]) <= tolerance;
+		}
+		if(!removable) {
+			keep.push_back(i);
+			anchor = i;
+		}
+	}
+	unsigned int last = times.size() - 1;
+	if(keep.size() > 1 || error(values[0], values[last]) > tolerance)
+		keep.push_back(last);
+
+	for(unsigned int i=0; i < keep.size(); ++i) {
+		times[i] = times[keep[i]];
+		values[i] = values[keep[i]];
+	}
+	times.resize(keep.size());
+	values.resize(keep.size());
+}
+
+void ClipCompression::reduce(std::vector<float> &times, std::vector<glm::vec3> &values, float tolerance) {
+	reduce_track(times, values, tolerance);
+}
+
+void ClipCompression::reduce(std::vector<float> &times, std::vector<glm::fquat> &values, float tolerance) {
+	reduce_track(times, values, tolerance);
+}
+
+void ClipCompression::pack_quat(const glm::fquat &q, int16_t * dst) {
+	glm::fquat n = glm::normalize(q);
+	dst[0] = (int16_t)floor(glm::clamp(n.x, -1.f, 1.f) * 32767.f + 0.5f);
+	dst[1] = (int16_t)floor(glm::clamp(n.y, -1.f, 1.f) * 32767.f + 0.5f);
+	dst[2] = (int16_t)floor(glm::clamp(n.z, -1.f, 1.f) * 32767.f + 0.5f);
+	dst[3] = (int16_t)floor(glm::clamp(n.w, -1.f, 1.f) * 32767.f + 0.5f);
+}
+
+glm::fquat ClipCompression::unpack_quat(const int16_t * src) {
+	//Rounding leaves it slightly off unit length
+	return glm::normalize(glm::fquat(src[3] / 32767.f, src[0] / 32767.f, src[1] / 32767.f, src[2] / 32767.f));
+}
+
+glm::fquat ClipCompression::slerp(const glm::fquat &start, const glm::fquat &end, float factor) {
+	float cosom = start.x*end.x + start.y*end.y + start.z*end.z + start.w*end.w;
+	glm::fquat e = end;
+	if(cosom < 0.0f) {
+		cosom = -cosom;
+		e = glm::fquat(-e.w, -e.x, -e.y, -e.z);
+	}
+
+	float sclp, sclq;
+	if((1.0f - cosom) > 0.0001f) {
+		float omega = acos(cosom);
+		float sinom = sin(omega);
+		sclp = sin((1.0f - factor) * omega) / sinom;
+		sclq = sin(factor * omega) / sinom;
+	} else {
+		//Very close, do linear interpolation
+		sclp = 1.0f - factor;
+		sclq = factor;
+	}
+
+	return glm::fquat(
+		sclp * start.w + sclq * e.w,
+		sclp * start.x + sclq * e.x,
+		sclp * start.y + sclq * e.y,
+		sclp * start.z + sclq * e.z);
+}
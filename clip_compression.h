@@ -0,0 +1,34 @@
+#ifndef CLIP_COMPRESSION_H
+#define CLIP_COMPRESSION_H
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+//Largest error allowed when keys are removed, in model units and radians
+#define CLIP_POSITION_TOLERANCE 0.0001f
+#define CLIP_SCALING_TOLERANCE 0.0001f
+#define CLIP_ROTATION_TOLERANCE 0.0005f
+
+/*
+ * Reduces and packs animation tracks when a model is imported.
+ *
+ * Keys that linear interpolation (slerp for rotations) of the remaining keys reproduces
+ * within the tolerance are removed, constant tracks end up with a single key.
+ * Rotations are stored as four 16 bit signed normalized components, 8 bytes instead of 16.
+ */
+class ClipCompression {
+public:
+	static void reduce(std::vector<float> &times, std::vector<glm::vec3> &values, float tolerance);
+	static void reduce(std::vector<float> &times, std::vector<glm::fquat> &values, float tolerance);
+
+	//Writes 4 values to dst
+	static void pack_quat(const glm::fquat &q, int16_t * dst);
+	static glm::fquat unpack_quat(const int16_t * src);
+
+	//Spherical interpolation along the shortest path (same as aiQuaternion::Interpolate)
+	static glm::fquat slerp(const glm::fquat &start, const glm::fquat &end, float factor);
+};
+
+#endif
@@ -0,0 +1,447 @@
+#include "cooked_model.h"
+#include "render_object.h"
+#include "packed_vertex.h"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define COOKED_MAGIC "GTKM"
+//Alignment of the vertex and index blobs in the file
+#define BLOB_ALIGNMENT 16
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/*
+ * Sequential writer/reader for the variable sized part of the file
+ * (materials, nodes and animations)
+ */
+namespace {
+	class Writer {
+		FILE * file_;
+		bool ok_;
+	public:
+		Writer(FILE * file) : file_(file), ok_(true) {};
+
+		bool ok() const { return ok_; };
+
+		void bytes(const void * data, size_t size) {
+			if(size > 0 && fwrite(data, size, 1, file_) != 1)
+				ok_ = false;
+		}
+
+		template<typename T> void value(const T &v) { bytes(&v, sizeof(T)); }
+
+		template<typename T> void array(const std::vector<T> &v) {
+			value<uint32_t>(v.size());
+			if(!v.empty())
+				bytes(&v.front(), sizeof(T)*v.size());
+		}
+
+		void string(const std::string &str) {
+			value<uint32_t>(str.size());
+			bytes(str.data(), str.size());
+		}
+
+		void pad_to(size_t alignment) {
+			long pos = ftell(file_);
+			static const char zero[BLOB_ALIGNMENT] = {0};
+			if(pos % alignment != 0)
+				bytes(zero, alignment - pos % alignment);
+		}
+
+		uint64_t position() const { return ftell(file_); };
+	};
+
+	class Reader {
+		const char * data_;
+		size_t size_, pos_;
+		bool ok_;
+	public:
+		Reader(const void * data, size_t size, size_t offset) : data_((const char*)data), size_(size), pos_(offset), ok_(offset <= size) {};
+
+		bool ok() const { return ok_; };
+
+		void bytes(void * dst, size_t size) {
+			if(!ok_ || size > size_ - pos_) {
+				ok_ = false;
+				return;
+			}
+			memcpy(dst, data_+pos_, size);
+			pos_ += size;
+		}
+
+		template<typename T> void value(T &v) { bytes(&v, sizeof(T)); }
+
+		template<typename T> void array(std::vector<T> &v) {
+			uint32_t count = 0;
+			value(count);
+			if(!ok_ || count > (size_ - pos_)/sizeof(T)) {
+				ok_ = false;
+				return;
+			}
+			v.resize(count);
+			if(count > 0)
+				bytes(&v.front(), sizeof(T)*count);
+		}
+
+		void string(std::string &str) {
+			uint32_t length = 0;
+			value(length);
+			if(!ok_ || length > size_ - pos_) {
+				ok_ = false;
+				return;
+			}
+			str.assign(data_+pos_, length);
+			pos_ += length;
+		}
+	};
+}
+
+CookedModel::CookedModel() :
+	source_animation_bytes(0),
+	mapping_(NULL),
+	mapping_size_(0),
+	mapped_vertices_(NULL),
+	mapped_indices_(NULL) { }
+
+CookedModel::~CookedModel() {
+	unmap();
+}
+
+const void * CookedModel::vertices(const mesh_t &mesh) const {
+	if(mapping_ != NULL)
+		return mapped_vertices_ + mesh.vertex_offset;
+	else
+		return vertex_data.empty() ? NULL : &vertex_data[mesh.vertex_offset];
+}
+
+const void * CookedModel::indices(const mesh_t &mesh) const {
+	if(mapping_ != NULL)
+		return mapped_indices_ + mesh.index_offset;
+	else
+		return index_data.empty() ? NULL : &index_data[mesh.index_offset];
+}
+
+uint64_t CookedModel::hash(const void * data, size_t size, uint64_t seed) {
+	//FNV-1a
+	const unsigned char * bytes = (const unsigned char*)data;
+	for(size_t i=0; i < size; ++i) {
+		seed ^= bytes[i];
+		seed *= FNV_PRIME;
+	}
+	return seed;
+}
+
+bool CookedModel::hash_file(const std::string &path, uint64_t &key) {
+	FILE * file = fopen(path.c_str(), "rb");
+	if(file == NULL)
+		return false;
+
+	char buffer[65536];
+	size_t read;
+	while((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		key = hash(buffer, read, key);
+	}
+	fclose(file);
+	return true;
+}
+
+void CookedModel::hash_obj_materials(const std::string &source, uint64_t &key) {
+	FILE * file = fopen(source.c_str(), "r");
+	if(file == NULL)
+		return;
+
+	//Library paths are relative to the .obj, like assimp resolves them
+	std::string dir;
+	size_t last_slash = source.rfind("/");
+	if(last_slash != std::string::npos)
+		dir = source.substr(0, last_slash+1);
+
+	char line[1024];
+	while(fgets(line, sizeof(line), file) != NULL) {
+		if(strncmp(line, "mtllib", 6) != 0 || (line[6] != ' ' && line[6] != '\t'))
+			continue;
+		//One or more file names separated by whitespace
+		for(char * name = strtok(line+6, " \t\r\n"); name != NULL; name = strtok(NULL, " \t\r\n")) {
+			std::string path = dir + name;
+			key = hash(name, strlen(name), key);
+			hash_file(path, key);
+		}
+	}
+	fclose(file);
+}
+
+uint64_t CookedModel::cache_key(const std::string &source, unsigned int import_flags) {
+	uint64_t key = FNV_OFFSET_BASIS;
+	uint32_t version = COOKED_MODEL_VERSION;
+	key = hash(&version, sizeof(version), key);
+	key = hash(&import_flags, sizeof(import_flags), key);
+
+	if(!hash_file(source, key))
+		return 0;
+
+	//The material table is cooked from the .mtl files, editing one must recook
+	if(source.size() >= 4 && strcasecmp(source.c_str() + source.size() - 4, ".obj") == 0)
+		hash_obj_materials(source, key);
+
+	//0 is reserved for "no key"
+	return key == 0 ? 1 : key;
+}
+
+std::string CookedModel::cache_path(const std::string &source, uint64_t key) {
+	std::string base = source;
+	size_t last_slash = base.rfind("/");
+	if(last_slash != std::string::npos)
+		base = base.substr(last_slash+1);
+
+	char hex[17];
+	sprintf(hex, "%016llx", (unsigned long long)key);
+	return std::string(MODEL_CACHE_PATH)+base+"-"+hex+COOKED_MODEL_EXTENTION;
+}
+
+bool CookedModel::read(const std::string &path, uint64_t key) {
+	unmap();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+		return false;
+
+	struct stat st;
+	if(fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(header_t)) {
+		close(fd);
+		return false;
+	}
+
+	mapping_size_ = st.st_size;
+	mapping_ = mmap(NULL, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping_ == MAP_FAILED) {
+		mapping_ = NULL;
+		return false;
+	}
+
+	header_t header;
+	memcpy(&header, mapping_, sizeof(header_t));
+
+	if(memcmp(header.magic, COOKED_MAGIC, 4) != 0 || header.version != COOKED_MODEL_VERSION || header.key != key
+		|| header.vertex_offset + header.vertex_bytes > mapping_size_
+		|| header.index_offset + header.index_bytes > mapping_size_
+		|| header.num_materials > mapping_size_ || header.num_nodes > mapping_size_ || header.num_animations > mapping_size_) {
+		fprintf(stderr, "Ignoring invalid or outdated cooked model %s\n", path.c_str());
+		unmap();
+		return false;
+	}
+
+	mapped_vertices_ = (const char*)mapping_ + header.vertex_offset;
+	mapped_indices_ = (const char*)mapping_ + header.index_offset;
+
+	scene_min = glm::vec3(header.scene_min[0], header.scene_min[1], header.scene_min[2]);
+	scene_max = glm::vec3(header.scene_max[0], header.scene_max[1], header.scene_max[2]);
+	source_animation_bytes = header.source_animation_bytes;
+
+	Reader r(mapping_, mapping_size_, sizeof(header_t));
+	r.array(meshes);
+
+	materials.resize(header.num_materials);
+	for(std::vector<material_t>::iterator it=materials.begin(); it!=materials.end(); ++it) {
+		uint32_t two_sided = 0;
+		r.value(it->attr);
+		r.value(two_sided);
+		it->two_sided = (two_sided != 0);
+		r.string(it->texture);
+		r.string(it->normal_map);
+	}
+
+	r = Reader(mapping_, mapping_size_, header.data_offset);
+	r.array(nodes);
+	r.array(node_meshes);
+	r.array(bones);
+	node_names.resize(nodes.size());
+	for(std::vector<std::string>::iterator it=node_names.begin(); it!=node_names.end(); ++it) {
+		r.string(*it);
+	}
+
+	animations.resize(header.num_animations);
+	for(std::vector<RenderObject::animation_t>::iterator it=animations.begin(); it!=animations.end(); ++it) {
+		uint32_t num_channels = 0;
+		r.value(it->duration);
+		r.value(it->ticks_per_second);
+		r.value(num_channels);
+		if(!r.ok())
+			break;
+		it->channels.resize(num_channels);
+		for(std::vector<RenderObject::node_anim_t>::iterator c=it->channels.begin(); c!=it->channels.end(); ++c) {
+			r.array(c->position.times);
+			r.array(c->position.values);
+			r.array(c->rotation.times);
+			r.array(c->rotation.values);
+			r.array(c->scaling.times);
+			r.array(c->scaling.values);
+		}
+		r.array(it->node_channels);
+	}
+
+	//Validate references, a corrupt file must not make us read outside the blobs
+	bool valid = r.ok() && meshes.size() == header.num_meshes && !nodes.empty() && nodes.size() == header.num_nodes;
+	for(std::vector<mesh_t>::const_iterator it=meshes.begin(); valid && it!=meshes.end(); ++it) {
+		valid = (it->format & ~PackedVertex::ALL_FLAGS) == 0
+			&& (uint64_t)it->vertex_offset + (uint64_t)it->num_vertices*PackedVertex::vertex_size(it->format) <= header.vertex_bytes
+			&& (uint64_t)it->index_offset + (uint64_t)it->num_indices*PackedVertex::index_size(it->format) <= header.index_bytes
+			&& it->mtl_index < materials.size()
+			&& it->num_bones <= SKIN_MAX_BONES && (uint64_t)it->first_bone + it->num_bones <= bones.size()
+			&& ((it->format & PackedVertex::SKINNED) != 0) == (it->num_bones > 0);
+	}
+	for(std::vector<RenderObject::bone_t>::const_iterator it=bones.begin(); valid && it!=bones.end(); ++it)
+		valid = it->node >= 0 && (unsigned int)it->node < nodes.size();
+	for(unsigned int i=0; valid && i < nodes.size(); ++i) {
+		//Parents must come before their children for the single pass matrix update
+		const RenderObject::node_t &node = nodes[i];
+		valid = (i == 0) ? node.parent == -1 : (node.parent >= 0 && (unsigned int)node.parent < i);
+		valid = valid && (uint64_t)node.first_mesh + node.num_meshes <= node_meshes.size();
+	}
+	for(unsigned int i=0; valid && i < node_meshes.size(); ++i)
+		valid = node_meshes[i] < meshes.size();
+	for(std::vector<RenderObject::animation_t>::const_iterator it=animations.begin(); valid && it!=animations.end(); ++it) {
+		valid = it->node_channels.size() == nodes.size();
+		for(std::vector<RenderObject::node_anim_t>::const_iterator c=it->channels.begin(); valid && c!=it->channels.end(); ++c) {
+			//Sampling needs at least one key in each track
+			valid = !c->position.times.empty() && c->position.times.size() == c->position.values.size()
+				&& !c->rotation.times.empty() && 4*c->rotation.times.size() == c->rotation.values.size()
+				&& !c->scaling.times.empty() && c->scaling.times.size() == c->scaling.values.size();
+		}
+		for(unsigned int i=0; valid && i < it->node_channels.size(); ++i)
+			valid = it->node_channels[i] < 0 || (unsigned int)it->node_channels[i] < it->channels.size();
+	}
+
+	if(!valid) {
+		fprintf(stderr, "Ignoring corrupt cooked model %s\n", path.c_str());
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool CookedModel::write(const std::string &path, uint64_t key) const {
+	mkdir(MODEL_CACHE_PATH, 0755);
+
+	//Write to a temporary file and move it in place so a concurrent reader never sees a partial file
+	std::string tmp_path = path + ".tmp";
+	FILE * file = fopen(tmp_path.c_str(), "wb");
+	if(file == NULL) {
+		fprintf(stderr, "Failed to write cooked model %s: %s\n", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	header_t header;
+	memset(&header, 0, sizeof(header_t));
+	memcpy(header.magic, COOKED_MAGIC, 4);
+	header.version = COOKED_MODEL_VERSION;
+	header.key = key;
+	header.num_meshes = meshes.size();
+	header.vertex_bytes = vertex_data.size();
+	header.index_bytes = index_data.size();
+	header.num_materials = materials.size();
+	header.num_nodes = nodes.size();
+	header.num_animations = animations.size();
+	for(int i=0; i < 3; ++i) {
+		header.scene_min[i] = scene_min[i];
+		header.scene_max[i] = scene_max[i];
+	}
+	header.source_animation_bytes = source_animation_bytes;
+
+	Writer w(file);
+	//Header is rewritten when the offsets are known
+	w.value(header);
+	w.array(meshes);
+	for(std::vector<material_t>::const_iterator it=materials.begin(); it!=materials.end(); ++it) {
+		w.value(it->attr);
+		w.value<uint32_t>(it->two_sided ? 1 : 0);
+		w.string(it->texture);
+		w.string(it->normal_map);
+	}
+
+	w.pad_to(BLOB_ALIGNMENT);
+	header.vertex_offset = w.position();
+	if(!vertex_data.empty())
+		w.bytes(&vertex_data.front(), vertex_data.size());
+
+	w.pad_to(BLOB_ALIGNMENT);
+	header.index_offset = w.position();
+	if(!index_data.empty())
+		w.bytes(&index_data.front(), index_data.size());
+
+	header.data_offset = w.position();
+	w.array(nodes);
+	w.array(node_meshes);
+	w.array(bones);
+	for(std::vector<std::string>::const_iterator it=node_names.begin(); it!=node_names.end(); ++it) {
+		w.string(*it);
+	}
+
+	for(std::vector<RenderObject::animation_t>::const_iterator it=animations.begin(); it!=animations.end(); ++it) {
+		w.value(it->duration);
+		w.value(it->ticks_per_second);
+		w.value<uint32_t>(it->channels.size());
+		for(std::vector<RenderObject::node_anim_t>::const_iterator c=it->channels.begin(); c!=it->channels.end(); ++c) {
+			w.array(c->position.times);
+			w.array(c->position.values);
+			w.array(c->rotation.times);
+			w.array(c->rotation.values);
+			w.array(c->scaling.times);
+			w.array(c->scaling.values);
+		}
+		w.array(it->node_channels);
+	}
+
+	fseek(file, 0, SEEK_SET);
+	w.value(header);
+
+	bool ok = w.ok();
+	if(fclose(file) != 0)
+		ok = false;
+
+	if(!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+		fprintf(stderr, "Failed to write cooked model %s\n", path.c_str());
+		unlink(tmp_path.c_str());
+		return false;
+	}
+
+	printf("Wrote cooked model %s\n", path.c_str());
+	return true;
+}
+
+void CookedModel::clear() {
+	unmap();
+	scene_min = scene_max = glm::vec3(0.f);
+	source_animation_bytes = 0;
+	meshes.clear();
+	materials.clear();
+	nodes.clear();
+	node_names.clear();
+	node_meshes.clear();
+	bones.clear();
+	animations.clear();
+	vertex_data.clear();
+	index_data.clear();
+}
+
+void CookedModel::unmap() {
+	if(mapping_ != NULL) {
+		munmap(mapping_, mapping_size_);
+		mapping_ = NULL;
+		mapping_size_ = 0;
+		mapped_vertices_ = NULL;
+		mapped_indices_ = NULL;
+	}
+}
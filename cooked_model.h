@@ -0,0 +1,117 @@
+#ifndef COOKED_MODEL_H
+#define COOKED_MODEL_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "render_object.h"
+#include "shader.h"
+
+#define MODEL_CACHE_PATH "cache/"
+#define COOKED_MODEL_EXTENTION ".cooked"
+
+//Bump this whenever the layout of the file (or of any struct written raw to it) changes
+#define COOKED_MODEL_VERSION 7
+
+/*
+ * CPU side representation of a model, either filled by Model from an
+ * assimp import or read from a cooked file in MODEL_CACHE_PATH.
+ *
+ * When read from file the vertex and index data is not copied, vertices() and indices()
+ * point straight into the memory mapped file until the CookedModel is destroyed.
+ */
+class CookedModel {
+public:
+	struct mesh_t {
+		uint32_t mtl_index;
+		uint32_t format; //PackedVertex format flags
+		uint32_t num_vertices;
+		uint32_t num_indices;
+		uint32_t vertex_offset; //Bytes into the vertex data
+		uint32_t index_offset; //Bytes into the index data
+		uint32_t first_bone, num_bones; //Range in bones, the format is SKINNED if there are any
+		float bounds_min[3], bounds_max[3]; //Mesh space bounding box of the vertices
+	};
+
+	struct material_t {
+		Shader::material_t attr;
+		bool two_sided;
+		//Texture paths as given by the model file, empty if not used
+		std::string texture, normal_map;
+	};
+
+	CookedModel();
+	~CookedModel();
+
+	glm::vec3 scene_min, scene_max;
+
+	std::vector<mesh_t> meshes;
+	std::vector<material_t> materials;
+	std::vector<RenderObject::node_t> nodes; //Depth first, nodes[0] is the root
+	std::vector<std::string> node_names;
+	std::vector<unsigned int> node_meshes;
+	std::vector<RenderObject::bone_t> bones;
+	std::vector<RenderObject::animation_t> animations;
+	uint64_t source_animation_bytes; //Size of the animation keys as imported, before compression
+
+	//Backing storage when the model was imported, unused when the data is mapped. Packed as given by mesh_t::format
+	std::vector<char> vertex_data;
+	std::vector<char> index_data;
+
+	const void * vertices(const mesh_t &mesh) const;
+	const void * indices(const mesh_t &mesh) const;
+
+	/*
+	 * Key identifying a cooked version of source: a hash of the file contents,
+	 * the import flags and COOKED_MODEL_VERSION. For .obj files the material
+	 * libraries (mtllib) are hashed too, textures are not cooked.
+	 * Returns 0 if the source file can't be read.
+	 */
+	static uint64_t cache_key(const std::string &source, unsigned int import_flags);
+	static std::string cache_path(const std::string &source, uint64_t key);
+
+	//Maps the cooked file, returns false (and leaves the model empty) if it is missing, corrupt or cooked with another key
+	bool read(const std::string &path, uint64_t key);
+	bool write(const std::string &path, uint64_t key) const;
+
+private:
+	//Copy not allowed (no body implemented, intentional!)
+	CookedModel(const CookedModel &other);
+
+	struct header_t {
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t num_meshes;
+		uint32_t vertex_bytes;
+		uint32_t index_bytes;
+		uint32_t num_materials;
+		uint32_t num_nodes;
+		uint32_t num_animations;
+		float scene_min[3];
+		float scene_max[3];
+		uint64_t source_animation_bytes;
+		uint64_t vertex_offset;
+		uint64_t index_offset;
+		uint64_t data_offset; //Materials, nodes and animations
+	};
+
+	void unmap();
+	//Unmaps and empties everything read() fills, so a failed read leaves nothing for import to append to
+	void clear();
+
+	static uint64_t hash(const void * data, size_t size, uint64_t seed);
+	//Hashes the contents of path into key, false if it can't be read
+	static bool hash_file(const std::string &path, uint64_t &key);
+	//Hashes the material libraries referenced by the .obj file source, missing ones are skipped
+	static void hash_obj_materials(const std::string &source, uint64_t &key);
+
+	void * mapping_;
+	size_t mapping_size_;
+	const char * mapped_vertices_;
+	const char * mapped_indices_;
+};
+
+#endif
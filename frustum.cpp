@@ -0,0 +1,84 @@
+#include "frustum.h"
+
+#include <glm/glm.hpp>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+Frustum::Frustum(const glm::mat4 &projection_view) {
+	const glm::mat4 &m = projection_view;
+	glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+	for(int i=0; i < 3; ++i) {
+		glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+		planes[2*i] = w + row;
+		planes[2*i + 1] = w - row;
+	}
+	for(int i=0; i < 6; ++i) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool Frustum::intersects_sphere(const glm::vec3 &center, float radius) const {
+	glm::vec4 c(center, 1.f);
+	for(int i=0; i < 6; ++i) {
+		if(glm::dot(planes[i], c) < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::intersects_box(const glm::vec3 &min, const glm::vec3 &max) const {
+	for(int i=0; i < 6; ++i) {
+		const glm::vec4 &p = planes[i];
+		//The corner furthest along the plane normal
+		glm::vec4 corner((p.x > 0.f) ? max.x : min.x, (p.y > 0.f) ? max.y : min.y, (p.z > 0.f) ? max.z : min.z, 1.f);
+		if(glm::dot(p, corner) < 0.f)
+			return false;
+	}
+	return true;
+}
+
+void Frustum::intersects_boxes(const float * min_x, const float * min_y, const float * min_z,
+		const float * max_x, const float * max_y, const float * max_z, unsigned int count, char * visible) const {
+	unsigned int i = 0;
+
+#ifdef __SSE__
+	for(; i + 4 <= count; i += 4) {
+		__m128 outside = _mm_setzero_ps();
+		for(int n=0; n < 6; ++n) {
+			const glm::vec4 &p = planes[n];
+			//The sign of the normal is the same for all four boxes, so is the choice of corner
+			__m128 x = _mm_loadu_ps(((p.x > 0.f) ? max_x : min_x) + i);
+			__m128 y = _mm_loadu_ps(((p.y > 0.f) ? max_y : min_y) + i);
+			__m128 z = _mm_loadu_ps(((p.z > 0.f) ? max_z : min_z) + i);
+
+			__m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p.x)), _mm_set1_ps(p.w));
+			d = _mm_add_ps(d, _mm_mul_ps(y, _mm_set1_ps(p.y)));
+			d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(p.z)));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+		}
+		int mask = _mm_movemask_ps(outside);
+		for(int b=0; b < 4; ++b) {
+			visible[i + b] = ((mask >> b) & 1) ? 0 : 1;
+		}
+	}
+#endif
+
+	for(; i < count; ++i) {
+		visible[i] = intersects_box(glm::vec3(min_x[i], min_y[i], min_z[i]), glm::vec3(max_x[i], max_y[i], max_z[i])) ? 1 : 0;
+	}
+}
+
+void Frustum::transform_box(const glm::mat4 &m, const glm::vec3 &min, const glm::vec3 &max, glm::vec3 &out_min, glm::vec3 &out_max) {
+	glm::vec3 center = glm::vec3(m * glm::vec4((min + max) * 0.5f, 1.f));
+	glm::vec3 half = (max - min) * 0.5f;
+
+	//Each axis of the box adds its absolute length along each world axis
+	glm::vec3 extent(0.f);
+	for(int i=0; i < 3; ++i) {
+		extent += glm::abs(glm::vec3(m[i])) * half[i];
+	}
+	out_min = center - extent;
+	out_max = center + extent;
+}
@@ -0,0 +1,34 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+/*
+ * The six planes of a view frustum, for culling bounding volumes.
+ * Planes point inwards and are normalized, a point p is inside a plane if dot(plane, vec4(p, 1)) >= 0.
+ */
+class Frustum {
+public:
+	Frustum() {};
+	//Extracts the planes from a projection * view matrix, the volumes tested are in the space the view matrix transforms from
+	Frustum(const glm::mat4 &projection_view);
+
+	glm::vec4 planes[6];
+
+	bool intersects_sphere(const glm::vec3 &center, float radius) const;
+	//Conservative, a box close to a corner of the frustum may be reported as intersecting
+	bool intersects_box(const glm::vec3 &min, const glm::vec3 &max) const;
+
+	/*
+	 * Tests count boxes stored as separate arrays of each coordinate, writes 1 to visible
+	 * for boxes intersecting the frustum and 0 for the others.
+	 * Four boxes are tested at a time with SSE when available.
+	 */
+	void intersects_boxes(const float * min_x, const float * min_y, const float * min_z,
+		const float * max_x, const float * max_y, const float * max_z, unsigned int count, char * visible) const;
+
+	//Axis aligned box around the box [min, max] transformed by m
+	static void transform_box(const glm::mat4 &m, const glm::vec3 &min, const glm::vec3 &max, glm::vec3 &out_min, glm::vec3 &out_max);
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "gl_device.h"
+#include "renderer.h"
+
+#include <cassert>
+#include <glutil/Shader.h>
+
+GLDevice::GLDevice() :
+	buffer_storage_(NULL),
+	multi_draw_elements_indirect_(NULL),
+	debug_message_callback_(NULL),
+	object_label_(NULL) {
+
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for(GLint i=0; i < count; ++i) {
+		const char * ext = (const char*) glGetStringi(GL_EXTENSIONS, i);
+		if(ext != NULL)
+			extensions_.insert(ext);
+	}
+
+	//Newer than the 3.3 headers, looked up at runtime
+	if(has_extension("GL_ARB_buffer_storage"))
+		buffer_storage_ = (buffer_storage_func_t) Renderer::get_proc_address("glBufferStorage");
+	if(has_extension("GL_ARB_multi_draw_indirect"))
+		multi_draw_elements_indirect_ = (multi_draw_elements_indirect_func_t) Renderer::get_proc_address("glMultiDrawElementsIndirect");
+	if(has_extension("GL_KHR_debug")) {
+		debug_message_callback_ = (debug_message_callback_func_t) Renderer::get_proc_address("glDebugMessageCallback");
+		object_label_ = (object_label_func_t) Renderer::get_proc_address("glObjectLabel");
+	} else if(has_extension("GL_ARB_debug_output")) {
+		debug_message_callback_ = (debug_message_callback_func_t) Renderer::get_proc_address("glDebugMessageCallbackARB");
+	}
+}
+
+bool GLDevice::buffer_storage(GLenum target, GLsizeiptr size, const GLvoid * data, GLbitfield flags) {
+	if(buffer_storage_ == NULL)
+		return false;
+	buffer_storage_(target, size, data, flags);
+	return true;
+}
+
+GLuint GLDevice::compile_shader(GLenum type, const std::string &source) {
+	return glutil::CompileShader(type, source);
+}
+
+GLuint GLDevice::link_program(const std::vector<GLuint> &shaders) {
+	return glutil::LinkProgram(shaders);
+}
+
+void GLDevice::multi_draw_elements_indirect(GLenum mode, GLenum type, const GLvoid * indirect, GLsizei draw_count, GLsizei stride) {
+	assert(multi_draw_elements_indirect_ != NULL);
+	multi_draw_elements_indirect_(mode, type, indirect, draw_count, stride);
+}
+
+bool GLDevice::debug_message_callback(debug_proc_t callback, const GLvoid * user_param) {
+	if(debug_message_callback_ == NULL)
+		return false;
+	debug_message_callback_(callback, user_param);
+	return true;
+}
+
+void GLDevice::object_label(GLenum identifier, GLuint name, GLsizei length, const GLchar * label) {
+	if(object_label_ != NULL)
+		object_label_(identifier, name, length, label);
+}
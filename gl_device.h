@@ -0,0 +1,132 @@
+#ifndef GL_DEVICE_H
+#define GL_DEVICE_H
+
+#include "render_device.h"
+
+#include <set>
+
+/*
+ * RenderDevice that forwards every call to the GL context. Created by the Renderer once
+ * the context is current and the functions are loaded, extension functions newer than the
+ * 3.3 headers are looked up then.
+ */
+class GLDevice : public RenderDevice {
+public:
+	GLDevice();
+
+	const char * name() const { return "gl"; };
+	bool has_gpu() const { return true; };
+	bool has_extension(const char * name) const { return extensions_.find(name) != extensions_.end(); };
+
+	void gen_buffers(GLsizei n, GLuint * buffers) { glGenBuffers(n, buffers); };
+	void delete_buffers(GLsizei n, const GLuint * buffers) { glDeleteBuffers(n, buffers); };
+	void bind_buffer(GLenum target, GLuint buffer) { glBindBuffer(target, buffer); };
+	void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) { glBindBufferRange(target, index, buffer, offset, size); };
+	void buffer_data(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage) { glBufferData(target, size, data, usage); };
+	void buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid * data) { glBufferSubData(target, offset, size, data); };
+	void copy_buffer_sub_data(GLenum read_target, GLenum write_target, GLintptr read_offset, GLintptr write_offset, GLsizeiptr size) { glCopyBufferSubData(read_target, write_target, read_offset, write_offset, size); };
+	void * map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) { return glMapBufferRange(target, offset, length, access); };
+	GLboolean unmap_buffer(GLenum target) { return glUnmapBuffer(target); };
+	bool buffer_storage(GLenum target, GLsizeiptr size, const GLvoid * data, GLbitfield flags);
+
+	void gen_vertex_arrays(GLsizei n, GLuint * arrays) { glGenVertexArrays(n, arrays); };
+	void delete_vertex_arrays(GLsizei n, const GLuint * arrays) { glDeleteVertexArrays(n, arrays); };
+	void bind_vertex_array(GLuint array) { glBindVertexArray(array); };
+	void enable_vertex_attrib_array(GLuint index) { glEnableVertexAttribArray(index); };
+	void disable_vertex_attrib_array(GLuint index) { glDisableVertexAttribArray(index); };
+	void vertex_attrib_pointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid * pointer) { glVertexAttribPointer(index, size, type, normalized, stride, pointer); };
+	void vertex_attrib_i_pointer(GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid * pointer) { glVertexAttribIPointer(index, size, type, stride, pointer); };
+	void vertex_attrib_divisor(GLuint index, GLuint divisor) { glVertexAttribDivisor(index, divisor); };
+	void vertex_attrib_3fv(GLuint index, const GLfloat * v) { glVertexAttrib3fv(index, v); };
+	void vertex_attrib_4f(GLuint index, GLfloat x, GLfloat y, GLfloat z, GLfloat w) { glVertexAttrib4f(index, x, y, z, w); };
+	void vertex_attrib_4fv(GLuint index, const GLfloat * v) { glVertexAttrib4fv(index, v); };
+
+	void gen_textures(GLsizei n, GLuint * textures) { glGenTextures(n, textures); };
+	void delete_textures(GLsizei n, const GLuint * textures) { glDeleteTextures(n, textures); };
+	void active_texture(GLenum texture) { glActiveTexture(texture); };
+	void bind_texture(GLenum target, GLuint texture) { glBindTexture(target, texture); };
+	void tex_parameter_i(GLenum target, GLenum pname, GLint param) { glTexParameteri(target, pname, param); };
+	void pixel_store_i(GLenum pname, GLint param) { glPixelStorei(pname, param); };
+	void tex_image_2d(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid * pixels) {
+		glTexImage2D(target, level, internal_format, width, height, border, format, type, pixels);
+	};
+	void tex_image_3d(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid * pixels) {
+		glTexImage3D(target, level, internal_format, width, height, depth, border, format, type, pixels);
+	};
+	void tex_sub_image_3d(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid * pixels) {
+		glTexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+	};
+	void sampler_parameter_i(GLuint sampler, GLenum pname, GLint param) { glSamplerParameteri(sampler, pname, param); };
+	void sampler_parameter_f(GLuint sampler, GLenum pname, GLfloat param) { glSamplerParameterf(sampler, pname, param); };
+
+	GLuint compile_shader(GLenum type, const std::string &source);
+	GLuint link_program(const std::vector<GLuint> &shaders);
+	void delete_shader(GLuint shader) { glDeleteShader(shader); };
+	void use_program(GLuint program) { glUseProgram(program); };
+	GLint get_uniform_location(GLuint program, const GLchar * name) { return glGetUniformLocation(program, name); };
+	GLuint get_uniform_block_index(GLuint program, const GLchar * name) { return glGetUniformBlockIndex(program, name); };
+	void uniform_block_binding(GLuint program, GLuint block_index, GLuint binding) { glUniformBlockBinding(program, block_index, binding); };
+	void uniform_1i(GLint location, GLint v) { glUniform1i(location, v); };
+	void uniform_1f(GLint location, GLfloat v) { glUniform1f(location, v); };
+	void uniform_2fv(GLint location, GLsizei count, const GLfloat * v) { glUniform2fv(location, count, v); };
+
+	void enable(GLenum capability) { glEnable(capability); };
+	void disable(GLenum capability) { glDisable(capability); };
+	void depth_mask(GLboolean flag) { glDepthMask(flag); };
+	void depth_func(GLenum func) { glDepthFunc(func); };
+	void depth_range(GLclampd near_value, GLclampd far_value) { glDepthRange(near_value, far_value); };
+	void blend_func(GLenum src, GLenum dst) { glBlendFunc(src, dst); };
+	void cull_face(GLenum mode) { glCullFace(mode); };
+	void front_face(GLenum mode) { glFrontFace(mode); };
+	void line_width(GLfloat width) { glLineWidth(width); };
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height) { glViewport(x, y, width, height); };
+	void clear_color(GLclampf r, GLclampf g, GLclampf b, GLclampf a) { glClearColor(r, g, b, a); };
+	void clear(GLbitfield mask) { glClear(mask); };
+
+	void draw_arrays(GLenum mode, GLint first, GLsizei count) { glDrawArrays(mode, first, count); };
+	void draw_elements(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices) { glDrawElements(mode, count, type, indices); };
+	void draw_elements_base_vertex(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices, GLint base_vertex) {
+		glDrawElementsBaseVertex(mode, count, type, indices, base_vertex);
+	};
+	void draw_elements_instanced_base_vertex(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices, GLsizei instances, GLint base_vertex) {
+		glDrawElementsInstancedBaseVertex(mode, count, type, indices, instances, base_vertex);
+	};
+	void multi_draw_elements_indirect(GLenum mode, GLenum type, const GLvoid * indirect, GLsizei draw_count, GLsizei stride);
+
+	GLsync fence_sync(GLenum condition, GLbitfield flags) { return glFenceSync(condition, flags); };
+	GLenum client_wait_sync(GLsync sync, GLbitfield flags, GLuint64 timeout) { return glClientWaitSync(sync, flags, timeout); };
+	void delete_sync(GLsync sync) { glDeleteSync(sync); };
+	void finish() { glFinish(); };
+
+	void gen_queries(GLsizei n, GLuint * queries) { glGenQueries(n, queries); };
+	void delete_queries(GLsizei n, const GLuint * queries) { glDeleteQueries(n, queries); };
+	void query_counter(GLuint query, GLenum target) { glQueryCounter(query, target); };
+	void get_query_object_iv(GLuint query, GLenum pname, GLint * params) { glGetQueryObjectiv(query, pname, params); };
+	void get_query_object_ui64v(GLuint query, GLenum pname, GLuint64 * params) { glGetQueryObjectui64v(query, pname, params); };
+
+	void get_integer_v(GLenum pname, GLint * params) { glGetIntegerv(pname, params); };
+	void get_integer64_v(GLenum pname, GLint64 * params) { glGetInteger64v(pname, params); };
+	const GLubyte * get_string(GLenum name) { return glGetString(name); };
+	GLenum get_error() { return glGetError(); };
+	bool debug_message_callback(debug_proc_t callback, const GLvoid * user_param);
+	void object_label(GLenum identifier, GLuint name, GLsizei length, const GLchar * label);
+
+private:
+	//Copy not allowed (no body implemented, intentional!)
+	GLDevice(const GLDevice &other);
+
+	typedef void (APIENTRY * buffer_storage_func_t)(GLenum target, GLsizeiptr size, const GLvoid * data, GLbitfield flags);
+	typedef void (APIENTRY * multi_draw_elements_indirect_func_t)(GLenum mode, GLenum type, const GLvoid * indirect, GLsizei drawcount, GLsizei stride);
+	typedef void (APIENTRY * debug_message_callback_func_t)(debug_proc_t callback, const GLvoid * user_param);
+	typedef void (APIENTRY * object_label_func_t)(GLenum identifier, GLuint name, GLsizei length, const GLchar * label);
+
+	std::set<std::string> extensions_;
+
+	//NULL if the extension isn't supported
+	buffer_storage_func_t buffer_storage_;
+	multi_draw_elements_indirect_func_t multi_draw_elements_indirect_;
+	debug_message_callback_func_t debug_message_callback_;
+	object_label_func_t object_label_;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "gl_state.h"
+#include "renderer.h"
+#include "render_device.h"
+
+#include <map>
+
+//ARB_draw_indirect is newer than the 3.3 headers
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+GLuint GLState::program_ = GLState::UNKNOWN;
+unsigned int GLState::active_unit_ = GLState::UNKNOWN;
+GLuint GLState::textures_[GL_STATE_TEXTURE_UNITS][3];
+GLuint GLState::vao_ = GLState::UNKNOWN;
+GLuint GLState::array_buffer_ = GLState::UNKNOWN;
+GLuint GLState::uniform_buffer_ = GLState::UNKNOWN;
+GLuint GLState::copy_read_buffer_ = GLState::UNKNOWN;
+GLuint GLState::copy_write_buffer_ = GLState::UNKNOWN;
+GLuint GLState::draw_indirect_buffer_ = GLState::UNKNOWN;
+GLState::range_t GLState::uniform_ranges_[GL_STATE_UNIFORM_BINDINGS];
+std::map<GLenum, bool> GLState::enabled_;
+int GLState::depth_mask_ = -1;
+GLenum GLState::blend_src_ = GLState::UNKNOWN;
+GLenum GLState::blend_dst_ = GLState::UNKNOWN;
+
+bool GLState::changed(bool change) {
+	if(change)
+		++Renderer::stats.state_calls;
+	else
+		++Renderer::stats.state_calls_avoided;
+	return change;
+}
+
+bool GLState::use_program(GLuint program) {
+	if(!changed(program != program_))
+		return false;
+	render_device()->use_program(program);
+	program_ = program;
+	return true;
+}
+
+bool GLState::active_texture(unsigned int unit) {
+	if(!changed(unit != active_unit_))
+		return false;
+	render_device()->active_texture(GL_TEXTURE0 + unit);
+	active_unit_ = unit;
+	return true;
+}
+
+int GLState::target_index(GLenum target) {
+	switch(target) {
+		case GL_TEXTURE_2D: return 0;
+		case GL_TEXTURE_2D_ARRAY: return 1;
+		case GL_TEXTURE_CUBE_MAP: return 2;
+		default: return -1;
+	}
+}
+
+bool GLState::bind_texture(unsigned int unit, GLenum target, GLuint texture) {
+	int t = target_index(target);
+	bool tracked = unit < GL_STATE_TEXTURE_UNITS && t >= 0;
+	if(!changed(!tracked || textures_[unit][t] != texture))
+		return false;
+	active_texture(unit);
+	render_device()->bind_texture(target, texture);
+	if(tracked)
+		textures_[unit][t] = texture;
+	return true;
+}
+
+bool GLState::bind_vertex_array(GLuint vao) {
+	if(!changed(vao != vao_))
+		return false;
+	render_device()->bind_vertex_array(vao);
+	vao_ = vao;
+	return true;
+}
+
+GLuint * GLState::buffer_binding(GLenum target) {
+	switch(target) {
+		case GL_ARRAY_BUFFER: return &array_buffer_;
+		case GL_UNIFORM_BUFFER: return &uniform_buffer_;
+		case GL_COPY_READ_BUFFER: return &copy_read_buffer_;
+		case GL_COPY_WRITE_BUFFER: return &copy_write_buffer_;
+		case GL_DRAW_INDIRECT_BUFFER: return &draw_indirect_buffer_;
+		default: return NULL;
+	}
+}
+
+bool GLState::bind_buffer(GLenum target, GLuint buffer) {
+	GLuint * binding = buffer_binding(target);
+	if(!changed(binding == NULL || *binding != buffer))
+		return false;
+	render_device()->bind_buffer(target, buffer);
+	if(binding != NULL)
+		*binding = buffer;
+	return true;
+}
+
+bool GLState::bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+	range_t * range = (target == GL_UNIFORM_BUFFER && index < GL_STATE_UNIFORM_BINDINGS) ? &uniform_ranges_[index] : NULL;
+	if(!changed(range == NULL || range->buffer != buffer || range->offset != offset || range->size != size))
+		return false;
+	render_device()->bind_buffer_range(target, index, buffer, offset, size);
+	if(range != NULL) {
+		range->buffer = buffer;
+		range->offset = offset;
+		range->size = size;
+	}
+	//Also binds the buffer to the target
+	GLuint * binding = buffer_binding(target);
+	if(binding != NULL)
+		*binding = buffer;
+	return true;
+}
+
+bool GLState::set(GLenum capability, bool enabled) {
+	std::map<GLenum, bool>::iterator it = enabled_.find(capability);
+	if(!changed(it == enabled_.end() || it->second != enabled))
+		return false;
+	if(enabled)
+		render_device()->enable(capability);
+	else
+		render_device()->disable(capability);
+	enabled_[capability] = enabled;
+	return true;
+}
+
+bool GLState::depth_mask(bool enabled) {
+	if(!changed(depth_mask_ != (enabled ? 1 : 0)))
+		return false;
+	render_device()->depth_mask(enabled ? GL_TRUE : GL_FALSE);
+	depth_mask_ = enabled ? 1 : 0;
+	return true;
+}
+
+bool GLState::blend_func(GLenum src, GLenum dst) {
+	if(!changed(src != blend_src_ || dst != blend_dst_))
+		return false;
+	render_device()->blend_func(src, dst);
+	blend_src_ = src;
+	blend_dst_ = dst;
+	return true;
+}
+
+//Deleting a bound object binds 0 in its place
+void GLState::delete_texture(GLuint texture) {
+	for(unsigned int u=0; u < GL_STATE_TEXTURE_UNITS; ++u) {
+		for(int t=0; t < 3; ++t) {
+			if(textures_[u][t] == texture)
+				textures_[u][t] = 0;
+		}
+	}
+	render_device()->delete_textures(1, &texture);
+}
+
+void GLState::delete_buffer(GLuint buffer) {
+	GLuint * bindings[] = { &array_buffer_, &uniform_buffer_, &copy_read_buffer_, &copy_write_buffer_, &draw_indirect_buffer_ };
+	for(unsigned int i=0; i < sizeof(bindings)/sizeof(GLuint*); ++i) {
+		if(*bindings[i] == buffer)
+			*bindings[i] = 0;
+	}
+	for(unsigned int i=0; i < GL_STATE_UNIFORM_BINDINGS; ++i) {
+		if(uniform_ranges_[i].buffer == buffer)
+			uniform_ranges_[i].buffer = UNKNOWN;
+	}
+	render_device()->delete_buffers(1, &buffer);
+}
+
+void GLState::delete_vertex_array(GLuint vao) {
+	if(vao_ == vao)
+		vao_ = 0;
+	render_device()->delete_vertex_arrays(1, &vao);
+}
+
+void GLState::invalidate() {
+	program_ = UNKNOWN;
+	active_unit_ = UNKNOWN;
+	for(unsigned int u=0; u < GL_STATE_TEXTURE_UNITS; ++u) {
+		for(int t=0; t < 3; ++t) {
+			textures_[u][t] = UNKNOWN;
+		}
+	}
+	vao_ = UNKNOWN;
+	array_buffer_ = uniform_buffer_ = copy_read_buffer_ = copy_write_buffer_ = draw_indirect_buffer_ = UNKNOWN;
+	for(unsigned int i=0; i < GL_STATE_UNIFORM_BINDINGS; ++i) {
+		uniform_ranges_[i].buffer = UNKNOWN;
+	}
+	enabled_.clear();
+	depth_mask_ = -1;
+	blend_src_ = blend_dst_ = UNKNOWN;
+}
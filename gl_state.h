@@ -0,0 +1,77 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <map>
+#include <glload/gl_3_3.h>
+
+//Texture units and uniform buffer bindings that are tracked, higher ones are always set
+#define GL_STATE_TEXTURE_UNITS 8
+#define GL_STATE_UNIFORM_BINDINGS 8
+
+/*
+ * Cache of the GL state set by the toolkit, calls that wouldn't change anything are skipped.
+ *
+ * All binds, enables and program switches go through here instead of straight to GL,
+ * and nothing is reset to 0 after use: whoever needs a state sets it and the cache
+ * skips it if it is already set. Each function returns true if it called GL.
+ * Renderer::stats counts the calls made and avoided.
+ *
+ * The element array buffer binding is part of the vao and is not cached.
+ * Objects must be deleted with the delete functions, so a new object given the same name
+ * is not taken to be bound. Call invalidate() after code that changes state behind the cache's back.
+ *
+ * All functions must be called from the GL thread.
+ */
+class GLState {
+public:
+	static bool use_program(GLuint program);
+
+	//unit is 0 for GL_TEXTURE0
+	static bool active_texture(unsigned int unit);
+	static unsigned int active_unit() { return active_unit_; };
+	static bool bind_texture(unsigned int unit, GLenum target, GLuint texture);
+
+	static bool bind_vertex_array(GLuint vao);
+	static bool bind_buffer(GLenum target, GLuint buffer);
+	static bool bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	//glEnable/glDisable
+	static bool set(GLenum capability, bool enabled);
+	static bool depth_mask(bool enabled);
+	static bool blend_func(GLenum src, GLenum dst);
+
+	static void delete_texture(GLuint texture);
+	static void delete_buffer(GLuint buffer);
+	static void delete_vertex_array(GLuint vao);
+
+	//Forgets all cached state, the next call of each function goes to GL. Called by the Renderer once the context is created
+	static void invalidate();
+
+private:
+	static const GLuint UNKNOWN = ~0u;
+
+	struct range_t {
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	//Index in textures_ for the tracked texture targets, -1 for others
+	static int target_index(GLenum target);
+	//Cached buffer binding of target, NULL for targets that aren't tracked
+	static GLuint * buffer_binding(GLenum target);
+
+	static bool changed(bool change);
+
+	static GLuint program_;
+	static unsigned int active_unit_;
+	static GLuint textures_[GL_STATE_TEXTURE_UNITS][3]; //2D, 2D array, cube map
+	static GLuint vao_;
+	static GLuint array_buffer_, uniform_buffer_, copy_read_buffer_, copy_write_buffer_, draw_indirect_buffer_;
+	static range_t uniform_ranges_[GL_STATE_UNIFORM_BINDINGS];
+	static std::map<GLenum, bool> enabled_;
+	static int depth_mask_; //-1 unknown
+	static GLenum blend_src_, blend_dst_;
+};
+
+#endif
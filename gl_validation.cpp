@@ -0,0 +1,94 @@
+#include "gl_validation.h"
+#include "renderer.h"
+#include "gl_state.h"
+#include "render_device.h"
+
+#include <cstdio>
+#include <GL/glu.h>
+
+//KHR_debug and ARB_debug_output are newer than the 3.3 headers, the functions are looked up by the GLDevice
+#ifndef GL_DEBUG_OUTPUT
+#define GL_DEBUG_OUTPUT 0x92E0
+#endif
+#ifndef GL_DEBUG_OUTPUT_SYNCHRONOUS
+#define GL_DEBUG_OUTPUT_SYNCHRONOUS 0x8242
+#endif
+#ifndef GL_DEBUG_TYPE_ERROR
+#define GL_DEBUG_TYPE_ERROR 0x824C
+#define GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR 0x824D
+#define GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR 0x824E
+#define GL_DEBUG_TYPE_PORTABILITY 0x824F
+#define GL_DEBUG_TYPE_PERFORMANCE 0x8250
+#endif
+#ifndef GL_DEBUG_SEVERITY_HIGH
+#define GL_DEBUG_SEVERITY_HIGH 0x9146
+#define GL_DEBUG_SEVERITY_MEDIUM 0x9147
+#define GL_DEBUG_SEVERITY_LOW 0x9148
+#endif
+#ifndef GL_DEBUG_SEVERITY_NOTIFICATION
+#define GL_DEBUG_SEVERITY_NOTIFICATION 0x826B
+#endif
+
+GLValidation::mode_t GLValidation::mode = GLValidation::PASS_CHECKS;
+bool GLValidation::debug_output_ = false;
+bool GLValidation::labels_ = false;
+unsigned int GLValidation::errors_ = 0;
+
+void GLValidation::init() {
+#if GL_VALIDATION
+	//Nothing to validate without a gpu, and the checks would only add to the counted commands
+	if(!render_device()->has_gpu())
+		mode = NO_CHECKS;
+	if(mode == NO_CHECKS)
+		return;
+
+	if(Renderer::has_extension("GL_KHR_debug")) {
+		labels_ = true;
+		//Only on by default in debug contexts
+		GLState::set(GL_DEBUG_OUTPUT, true);
+	}
+
+	if(render_device()->debug_message_callback(debug_callback, NULL)) {
+		if(mode == STRICT)
+			GLState::set(GL_DEBUG_OUTPUT_SYNCHRONOUS, true);
+		debug_output_ = true;
+	} else {
+		printf("GL debug output not supported, checking for errors after each pass\n");
+	}
+	read_errors("GLValidation::init()");
+#endif
+}
+
+int GLValidation::read_errors(const char * where) {
+	int errors = 0;
+	GLenum error;
+	while((error = render_device()->get_error()) != GL_NO_ERROR) {
+		fprintf(stderr, "%s: OpenGL error: %s\n", where, gluErrorString(error));
+		++errors;
+	}
+	errors_ += errors;
+	return errors;
+}
+
+void APIENTRY GLValidation::debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar * message, const GLvoid * user_param) {
+	if(severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+		return;
+
+	const char * type_name = "other";
+	switch(type) {
+		case GL_DEBUG_TYPE_ERROR: type_name = "error"; break;
+		case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: type_name = "deprecated"; break;
+		case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: type_name = "undefined behavior"; break;
+		case GL_DEBUG_TYPE_PORTABILITY: type_name = "portability"; break;
+		case GL_DEBUG_TYPE_PERFORMANCE: type_name = "performance"; break;
+	}
+	const char * severity_name = "low";
+	if(severity == GL_DEBUG_SEVERITY_HIGH)
+		severity_name = "high";
+	else if(severity == GL_DEBUG_SEVERITY_MEDIUM)
+		severity_name = "medium";
+
+	fprintf(stderr, "OpenGL %s (%s severity): %s\n", type_name, severity_name, message);
+	if(type == GL_DEBUG_TYPE_ERROR)
+		++errors_;
+}
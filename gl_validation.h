@@ -0,0 +1,97 @@
+#ifndef GL_VALIDATION_H
+#define GL_VALIDATION_H
+
+#include <string>
+#include <glload/gl_3_3.h>
+
+#include "render_device.h"
+
+//0 compiles all error checking out, release builds (make RELEASE=1) define NDEBUG
+#ifndef GL_VALIDATION
+#ifdef NDEBUG
+#define GL_VALIDATION 0
+#else
+#define GL_VALIDATION 1
+#endif
+#endif
+
+//Object identifiers of KHR_debug, for label()
+#ifndef GL_BUFFER
+#define GL_BUFFER 0x82E0
+#endif
+#ifndef GL_PROGRAM
+#define GL_PROGRAM 0x82E2
+#endif
+#ifndef GL_VERTEX_ARRAY
+#define GL_VERTEX_ARRAY 0x8074
+#endif
+
+/*
+ * GL error checking, selected with mode before the Renderer is created:
+ *
+ * PASS_CHECKS (default): with KHR_debug or ARB_debug_output a callback prints errors and
+ * warnings as the driver reports them, and objects are labeled with their file or purpose so the
+ * messages name them. Without either, glGetError is read once at the end of each pass (check_pass).
+ * STRICT: glGetError after every checked call (check_call) and synchronous debug output, so the
+ * callback runs inside the offending call. Slow, for bug hunting.
+ * NO_CHECKS: nothing is checked.
+ *
+ * glGetError can make the driver wait for the gpu, so nothing calls it per draw outside STRICT.
+ * With GL_VALIDATION 0 all checks are empty inline functions.
+ */
+class GLValidation {
+public:
+	enum mode_t {
+		NO_CHECKS,
+		PASS_CHECKS,
+		STRICT
+	};
+
+	static mode_t mode;
+
+	//Installs the debug output callback, called by the Renderer once the context is created
+	static void init();
+
+	//True if errors are reported by the debug output callback
+	static bool debug_output() { return debug_output_; };
+
+	//After a single GL call, only checked in STRICT. Returns the number of errors
+	static int check_call(const char * where) {
+#if GL_VALIDATION
+		if(mode == STRICT)
+			return read_errors(where);
+#endif
+		return 0;
+	};
+
+	//After a pass of many calls, checked unless the debug output reports the errors
+	static int check_pass(const char * where) {
+#if GL_VALIDATION
+		if(mode == STRICT || (mode == PASS_CHECKS && !debug_output_))
+			return read_errors(where);
+#endif
+		return 0;
+	};
+
+	//Names an object in debug messages, identifier is GL_BUFFER, GL_TEXTURE, GL_PROGRAM or GL_VERTEX_ARRAY. Needs KHR_debug
+	static void label(GLenum identifier, GLuint name, const std::string &label) {
+#if GL_VALIDATION
+		if(labels_)
+			render_device()->object_label(identifier, name, -1, label.c_str());
+#endif
+	};
+
+	//Errors reported since init(), by either the callback or glGetError
+	static unsigned int errors() { return errors_; };
+
+private:
+	static int read_errors(const char * where);
+
+	static void APIENTRY debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar * message, const GLvoid * user_param);
+
+	static bool debug_output_;
+	static bool labels_; //KHR_debug is supported
+	static unsigned int errors_;
+};
+
+#endif
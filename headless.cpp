@@ -0,0 +1,144 @@
+#include "headless.h"
+#include "gl_validation.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+static bool has_egl_extension(EGLDisplay display, const char * name) {
+	const char * extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if(extensions == NULL)
+		return false;
+	size_t len = strlen(name);
+	for(const char * ext = strstr(extensions, name); ext != NULL; ext = strstr(ext + len, name)) {
+		if((ext == extensions || ext[-1] == ' ') && (ext[len] == ' ' || ext[len] == '\0'))
+			return true;
+	}
+	return false;
+}
+
+HeadlessContext::HeadlessContext(int w, int h) :
+	width_(w),
+	height_(h),
+	framebuffer_(0),
+	color_(0),
+	depth_(0) {
+
+	//The surfaceless platform needs no display server at all, otherwise try the default display
+	EGLDisplay display = EGL_NO_DISPLAY;
+	if(has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if(get_platform_display != NULL)
+			display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if(display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		fprintf(stderr, "Headless: Failed to initialize EGL\n");
+		exit(1);
+	}
+	display_ = display;
+	printf("Headless: EGL %d.%d (%s)\n", major, minor, eglQueryString(display, EGL_VENDOR));
+
+	if(!has_egl_extension(display, "EGL_KHR_surfaceless_context")) {
+		fprintf(stderr, "Headless: EGL_KHR_surfaceless_context not supported\n");
+		exit(1);
+	}
+
+	if(!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "Headless: Desktop OpenGL not supported by EGL\n");
+		exit(1);
+	}
+
+	//No surface is ever created, but the default surface type (window) isn't offered without a display
+	const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint num_configs = 0;
+	if(!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+		fprintf(stderr, "Headless: No EGL config with OpenGL support\n");
+		exit(1);
+	}
+
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+	if(context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "Headless: Failed to create an OpenGL 3.3 core context (EGL error 0x%x)\n", eglGetError());
+		exit(1);
+	}
+	context_ = context;
+
+	if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		fprintf(stderr, "Headless: Failed to make the context current (EGL error 0x%x)\n", eglGetError());
+		exit(1);
+	}
+}
+
+HeadlessContext::~HeadlessContext() {
+	if(framebuffer_ != 0) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer_);
+		glDeleteRenderbuffers(1, &color_);
+		glDeleteRenderbuffers(1, &depth_);
+	}
+	eglMakeCurrent((EGLDisplay) display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext((EGLDisplay) display_, (EGLContext) context_);
+	eglTerminate((EGLDisplay) display_);
+}
+
+void HeadlessContext::create_framebuffer() {
+	glGenRenderbuffers(1, &color_);
+	glBindRenderbuffer(GL_RENDERBUFFER, color_);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+
+	glGenRenderbuffers(1, &depth_);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width_, height_);
+
+	glGenFramebuffers(1, &framebuffer_);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if(status != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Headless: Framebuffer incomplete (status 0x%x)\n", status);
+		exit(1);
+	}
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	GLValidation::check_pass("HeadlessContext::create_framebuffer()");
+}
+
+void HeadlessContext::read_pixels(unsigned char * pixels) const {
+	//Rows are read bottom up, flip them
+	size_t row = width_*4;
+	std::vector<unsigned char> flipped(row*height_);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, &flipped[0]);
+	for(int y=0; y < height_; ++y) {
+		memcpy(pixels + y*row, &flipped[(height_ - 1 - y)*row], row);
+	}
+	GLValidation::check_pass("HeadlessContext::read_pixels()");
+}
+
+void * HeadlessContext::get_proc_address(const char * name) {
+	return (void*) eglGetProcAddress(name);
+}
@@ -0,0 +1,43 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glload/gl_3_3.h>
+
+/*
+ * GL context without a display: an EGL surfaceless context (Mesa's surfaceless platform where
+ * available, so no X server or gpu is needed with llvmpipe) that renders into a w x h framebuffer
+ * object instead of a window.
+ *
+ * Created by the Renderer when it is headless, the framebuffer is bound for the lifetime of the
+ * context so all drawing ends up in it. Frames are read back with read_pixels().
+ */
+class HeadlessContext {
+public:
+	//Prints the reason and exits if no context can be created
+	HeadlessContext(int w, int h);
+	~HeadlessContext();
+
+	//Creates the framebuffer, must be called after the GL functions are loaded
+	void create_framebuffer();
+
+	//RGBA, width*height*4 bytes with the top row first
+	void read_pixels(unsigned char * pixels) const;
+
+	//GL and extension functions of the current context
+	static void * get_proc_address(const char * name);
+
+	int width() const { return width_; };
+	int height() const { return height_; };
+
+private:
+	//Copy not allowed (no body implemented, intentional!)
+	HeadlessContext(const HeadlessContext &other);
+
+	int width_, height_;
+	void * display_, * context_; //EGLDisplay, EGLContext
+
+	GLuint framebuffer_;
+	GLuint color_, depth_; //Renderbuffers
+};
+
+#endif
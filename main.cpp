@@ -2,38 +2,374 @@
 #include <time.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <cstring>
+#include <cstdio>
 
 #include "renderer.h"
 #include "render_object.h"
 #include "logic.h"
 #include "input.h"
 #include "world.h"
+#include "skinning.h"
+#include "render_queue.h"
+#include "gl_validation.h"
+#include "profiler.h"
+#include "model_loader.h"
+#include "png_file.h"
+#include "bench.h"
+#include "util.h"
+#include "render_device.h"
 
 #define REF_FPS 30
 #define REF_DT (1.0/REF_FPS)
 
+//Frames measured for each submission path by --draw-bench
+#define DRAW_BENCH_FRAMES 300
+
+//Defaults of --size, --frames and --tolerance
+#define DEFAULT_WIDTH 1024
+#define DEFAULT_HEIGHT 768
+#define HEADLESS_FRAMES 60
+#define HEADLESS_TOLERANCE 2
+//rand() seed of headless runs, so particles and the stress scene are the same every run
+#define HEADLESS_SEED 1
+//Default of --report
+#define BENCH_REPORT "bench.json"
+
 bool fullscreen =false;
+bool print_stats = false;
+bool animation_lod = true;
+bool frustum_culling = true;
+bool stress = false;
+bool instancing = true;
+bool multi_draw = true;
+bool draw_bench = false;
+bool skin_test = false;
+const char * profile_trace = NULL;
+bool headless = false;
+bool null_device = false;
+int width = DEFAULT_WIDTH;
+int height = DEFAULT_HEIGHT;
+int headless_frames = HEADLESS_FRAMES;
+const char * capture_file = NULL;
+const char * golden_file = NULL;
+int tolerance = HEADLESS_TOLERANCE;
+const char * bench_file = NULL;
+const char * bench_report = BENCH_REPORT;
+BenchScript bench_script;
+const char * record_file = NULL;
 
 Renderer * renderer;
 
+//False when nothing may depend on the keyboard and joystick, so runs repeat
+static bool live_input() {
+	return !headless && !null_device && bench_file == NULL;
+}
+
 static void setup(){
-	renderer = new Renderer(1024, 768, fullscreen);
+	if(bench_file != NULL)
+		fix_random_seed(bench_script.seed);
+	else if(headless || null_device)
+		fix_random_seed(HEADLESS_SEED);
 
-	init_input();
+	Renderer::context_t context = Renderer::WINDOW_CONTEXT;
+	if(null_device)
+		context = Renderer::NO_CONTEXT;
+	else if(headless)
+		context = Renderer::HEADLESS_CONTEXT;
+	renderer = new Renderer(width, height, fullscreen, context);
+	renderer->print_stats = print_stats;
+	renderer->animation_lod = animation_lod;
+	renderer->frustum_culling = frustum_culling;
+	renderer->render_queue->instancing = instancing;
+	renderer->render_queue->multi_draw = multi_draw;
+
+	if(live_input())
+		init_input();
+
+	if(draw_bench) {
+		create_draw_bench_scene(renderer);
+		return;
+	}
+	if(skin_test) {
+		create_skinning_scene(renderer);
+		return;
+	}
 
 	create_world(renderer);
+	if(stress)
+		create_stress_scene(renderer);
+}
+
+//Uploads models from the loader until none are pending
+static void wait_for_models() {
+	while(renderer->model_loader->pending() > 0) {
+		renderer->model_loader->upload(MODEL_UPLOAD_BUDGET);
+		usleep(1000);
+	}
 }
 
+/*
+ * Renders the draw bench scene with the plain draw loop and with multi-draw,
+ * and prints the meshes submitted per ms of cpu time for both.
+ * Instancing and culling are off, so every object is a draw of its own.
+ */
+static void run_draw_bench() {
+	wait_for_models();
+	renderer->print_stats = false;
+	renderer->frustum_culling = false;
+	renderer->render_queue->instancing = false;
+
+	const char * names[] = { "plain", "multi-draw" };
+	for(int mode=0; mode < 2; ++mode) {
+		if(mode == 1 && !renderer->render_queue->multi_draw_supported()) {
+			printf("%-10s: not supported (needs GL_ARB_multi_draw_indirect and GL_ARB_base_instance)\n", names[mode]);
+			break;
+		}
+		renderer->render_queue->multi_draw = (mode == 1);
+
+		//Let buffers and the transform ring settle first
+		for(int i=0; i < 10; ++i) {
+			renderer->render(REF_DT);
+		}
+		render_device()->finish();
+		Renderer::stats = Renderer::render_stats_t();
+
+		struct timeval start, end;
+		gettimeofday(&start, NULL);
+		for(int i=0; i < DRAW_BENCH_FRAMES; ++i) {
+			renderer->render(REF_DT);
+		}
+		render_device()->finish();
+		gettimeofday(&end, NULL);
+
+		const Renderer::render_stats_t &stats = Renderer::stats;
+		double wall = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)/1000000.0;
+		printf("%-10s: %.0f meshes/frame in %.1f draw calls/frame, %.3f ms cpu/frame, %.3f ms/frame, %.0f meshes/ms cpu\n",
+			names[mode],
+			stats.queued_draws/(double)stats.frames,
+			stats.draw_calls/(double)stats.frames,
+			1000.0*stats.cpu_time/stats.frames,
+			1000.0*wall/DRAW_BENCH_FRAMES,
+			stats.queued_draws/(1000.0*stats.cpu_time));
+	}
+}
+
+/*
+ * Renders headless_frames frames with a fixed dt and no input once all models are loaded,
+ * so every run on the same driver gives the same image. The last frame is written to
+ * capture_file and compared to golden_file. On the null device only the commands and
+ * bytes of the frames are printed.
+ * Returns the exit code: 0, or 1 if the frame differs from the golden image or a file failed.
+ */
+static int run_headless() {
+	wait_for_models();
+
+	render_device()->reset_stats();
+	for(int i=0; i < headless_frames; ++i) {
+		if(skin_test)
+			update_skinning_scene(REF_DT, renderer);
+		else
+			update_world(REF_DT, renderer);
+		renderer->render(REF_DT);
+	}
+	render_device()->print_stats(headless_frames);
+
+	std::vector<unsigned char> frame;
+	renderer->read_frame(frame);
+
+	int result = 0;
+	if(capture_file != NULL) {
+		if(write_png(capture_file, &frame[0], width, height))
+			printf("Wrote frame %d to %s\n", headless_frames, capture_file);
+		else
+			result = 1;
+	}
+
+	if(golden_file != NULL) {
+		std::vector<unsigned char> golden;
+		int golden_width, golden_height;
+		if(!read_png(golden_file, golden, golden_width, golden_height)) {
+			result = 1;
+		} else if(golden_width != width || golden_height != height) {
+			fprintf(stderr, "%s is %dx%d, the frame is %dx%d\n", golden_file, golden_width, golden_height, width, height);
+			result = 1;
+		} else {
+			image_diff_t diff = compare_pixels(&frame[0], &golden[0], width, height, tolerance);
+			if(diff.differing_pixels > 0) {
+				fprintf(stderr, "Frame differs from %s: %lu pixels (%.2f%%) off by more than %d, at most %d\n",
+					golden_file, diff.differing_pixels, 100.0*diff.differing_pixels/(width*height), tolerance, diff.max_difference);
+				result = 1;
+			} else {
+				printf("Frame matches %s (largest difference %d)\n", golden_file, diff.max_difference);
+			}
+		}
+	}
+	return result;
+}
+
+/*
+ * Runs bench_script once all models are loaded: the warmup frames, then the measured frames, with
+ * the script's dt, camera path and keys instead of the clock and live input. The cpu time of each
+ * measured frame (logic, world update and render) and the profiler scopes go to bench_report.
+ * Returns the exit code.
+ */
+static int run_bench() {
+	wait_for_models();
+
+	std::vector<double> frame_times;
+	frame_times.reserve(bench_script.frames);
+	unsigned int total_frames = bench_script.warmup_frames + bench_script.frames;
+	for(unsigned int frame=0; frame < total_frames; ++frame) {
+		if(frame == bench_script.warmup_frames) {
+			Profiler::flush();
+			Profiler::keep_frame_times(true);
+			render_device()->reset_stats();
+		}
+
+		bench_script.apply_input(frame, keys);
+		double start = monotonic_seconds();
+		logic(bench_script.dt, renderer);
+		bench_script.apply_camera(frame, renderer->camera);
+		update_world(bench_script.dt, renderer);
+		renderer->render(bench_script.dt);
+		if(frame >= bench_script.warmup_frames)
+			frame_times.push_back(monotonic_seconds() - start);
+	}
+	Profiler::flush();
+	render_device()->print_stats(bench_script.frames);
+
+	return write_bench_report(bench_report, bench_file, bench_script, frame_times, width, height) ? 0 : 1;
+}
 
 static void cleanup(){
-	cleanup_input();
+	if(profile_trace != NULL)
+		Profiler::write_trace(profile_trace);
+	if(live_input())
+		cleanup_input();
 	SDL_Quit();
 	
 	delete renderer;
 }
 
 int main(int argc, char* argv[]){
+	for(int i=1; i < argc; ++i) {
+		if(strcmp(argv[i], "--stats") == 0) {
+			print_stats = true;
+		} else if(strcmp(argv[i], "--cpu-skinning") == 0) {
+			Skinning::backend = Skinning::CPU_SKINNING;
+		} else if(strcmp(argv[i], "--no-anim-lod") == 0) {
+			animation_lod = false;
+		} else if(strcmp(argv[i], "--no-culling") == 0) {
+			frustum_culling = false;
+		} else if(strcmp(argv[i], "--stress") == 0) {
+			stress = true;
+		} else if(strcmp(argv[i], "--no-instancing") == 0) {
+			instancing = false;
+		} else if(strcmp(argv[i], "--no-multi-draw") == 0) {
+			multi_draw = false;
+		} else if(strcmp(argv[i], "--draw-bench") == 0) {
+			draw_bench = true;
+		} else if(strcmp(argv[i], "--skin-test") == 0) {
+			skin_test = true;
+			headless = true;
+		} else if(strcmp(argv[i], "--gl-strict") == 0) {
+			GLValidation::mode = GLValidation::STRICT;
+		} else if(strcmp(argv[i], "--no-gl-checks") == 0) {
+			GLValidation::mode = GLValidation::NO_CHECKS;
+		} else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			Profiler::enabled = true;
+			profile_trace = argv[++i];
+		} else if(strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+		} else if(strcmp(argv[i], "--null-device") == 0) {
+			null_device = true;
+		} else if(strcmp(argv[i], "--size") == 0 && i + 1 < argc && sscanf(argv[i+1], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+			++i;
+		} else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc && (headless_frames = atoi(argv[i+1])) > 0) {
+			++i;
+		} else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			capture_file = argv[++i];
+		} else if(strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+			golden_file = argv[++i];
+		} else if(strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+			tolerance = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+			bench_file = argv[++i];
+		} else if(strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+			bench_report = argv[++i];
+		} else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			record_file = argv[++i];
+		} else {
+			printf("Usage: %s [--stats] [--cpu-skinning] [--no-anim-lod] [--no-culling] [--stress] [--no-instancing] [--no-multi-draw] [--draw-bench] [--skin-test] [--gl-strict] [--no-gl-checks] [--profile trace.json] [--headless] [--null-device] [--size WxH] [--frames N] [--capture frame.png] [--compare golden.png] [--tolerance T] [--bench script] [--report report.json] [--record script]\n", argv[0]);
+			printf("  --stats         Print draw calls and cpu time per draw call every %d seconds\n", (int)RENDER_STATS_INTERVAL);
+			printf("  --cpu-skinning  Skin animated meshes on the cpu instead of in the vertex shader\n");
+			printf("  --no-anim-lod   Sample all animations every frame, also when small or off screen\n");
+			printf("  --no-culling    Draw all objects, also those outside the view\n");
+			printf("  --stress        Add %d instanced cubes to the world\n", STRESS_INSTANCES);
+			printf("  --no-instancing Draw every mesh on its own, also when the same mesh is drawn many times\n");
+			printf("  --no-multi-draw Draw each mesh with its own call, also when multi-draw indirect is supported\n");
+			printf("  --draw-bench    Measure draw submission with and without multi-draw on %d cubes and exit\n", DRAW_BENCH_OBJECTS);
+			printf("  --skin-test     --headless with only the rigged %s, compare the frames of both skinning back ends (make skin-test)\n", SKIN_TEST_MODEL);
+			printf("  --gl-strict     Check for GL errors after every call, slow\n");
+			printf("  --no-gl-checks  Don't check for GL errors at all\n");
+			printf("  --profile FILE  Print cpu and gpu time per scope every %d seconds and write a Chrome trace to FILE on exit\n", (int)RENDER_STATS_INTERVAL);
+			printf("  --headless      Render without a window (EGL surfaceless) with a fixed dt and random seed, then exit\n");
+			printf("  --null-device   Like --headless but without GL, counts the commands and bytes of each frame instead\n");
+			printf("  --size WxH      Window or framebuffer size, default %dx%d\n", DEFAULT_WIDTH, DEFAULT_HEIGHT);
+			printf("  --frames N      Frames rendered by --headless and --null-device, default %d\n", HEADLESS_FRAMES);
+			printf("  --capture FILE  Write the last --headless frame to FILE as PNG\n");
+			printf("  --compare FILE  Compare the last --headless frame to the PNG in FILE, exit with 1 if they differ\n");
+			printf("  --tolerance T   Difference per color channel (0-255) ignored by --compare, default %d\n", HEADLESS_TOLERANCE);
+			printf("  --bench FILE    Run the benchmark script in FILE (see bench.h) and exit, with or without --headless or --null-device\n");
+			printf("  --report FILE   Where --bench writes its JSON report, default %s\n", BENCH_REPORT);
+			printf("  --record FILE   Write the camera path and keys of this run to FILE as a --bench script\n");
+			return 1;
+		}
+	}
+	if(skin_test && draw_bench) {
+		printf("--skin-test and --draw-bench can't be combined\n");
+		return 1;
+	}
+	if(headless && null_device) {
+		printf("--headless and --null-device can't be combined\n");
+		return 1;
+	}
+	if((capture_file != NULL || golden_file != NULL) && !headless) {
+		printf("--capture and --compare need --headless\n");
+		return 1;
+	}
+	if(bench_file != NULL) {
+		if(draw_bench || skin_test || record_file != NULL || (headless && (capture_file != NULL || golden_file != NULL))) {
+			printf("--bench can't be combined with --draw-bench, --skin-test, --record, --capture or --compare\n");
+			return 1;
+		}
+		if(!bench_script.load(bench_file))
+			return 1;
+		stress = stress || bench_script.stress;
+		Profiler::enabled = true;
+	}
+
 	setup();	
+	if(bench_file != NULL) {
+		int result = run_bench();
+		cleanup();
+		return result;
+	}
+	if((headless || null_device) && !draw_bench) {
+		int result = run_headless();
+		cleanup();
+		return result;
+	}
+	if(draw_bench) {
+		run_draw_bench();
+		cleanup();
+		return 0;
+	}
+
+	BenchScript recording;
+	unsigned int recorded_frames = 0;
+
 	bool run = true;
 	struct timeval ref;
 	gettimeofday(&ref, NULL);
@@ -49,6 +385,8 @@ int main(int argc, char* argv[]){
 
     poll(&run);
 	 logic(dt, renderer);
+	 if(record_file != NULL)
+		 recording.record(recorded_frames++, renderer->camera, keys, SDLK_LAST);
 	 update_world(dt, renderer);
 	 renderer->render(dt);
 		 
@@ -62,5 +400,13 @@ int main(int argc, char* argv[]){
     ref = ts;
   }
 
+  if(record_file != NULL && recorded_frames > 0) {
+	  //The first frames of the path become the warmup when it is long enough
+	  recording.warmup_frames = (recorded_frames > 2*BENCH_WARMUP) ? BENCH_WARMUP : 0;
+	  recording.frames = recorded_frames - recording.warmup_frames;
+	  recording.stress = stress;
+	  recording.save(record_file);
+  }
+
   cleanup();
 }
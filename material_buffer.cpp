@@ -0,0 +1,121 @@
+#include "material_buffer.h"
+#include "renderer.h"
+#include "gl_state.h"
+#include "render_device.h"
+
+#include <vector>
+#include <cstring>
+#include <cassert>
+
+std::vector<Shader::material_t> MaterialBuffer::materials_;
+std::map<std::string, unsigned int> MaterialBuffer::indices_;
+std::vector<unsigned int> MaterialBuffer::references_;
+std::vector<unsigned int> MaterialBuffer::free_;
+unsigned int MaterialBuffer::capacity_ = 0;
+size_t MaterialBuffer::stride_ = sizeof(Shader::material_t);
+std::thread::id MaterialBuffer::gl_thread_;
+
+void MaterialBuffer::init() {
+	gl_thread_ = std::this_thread::get_id();
+
+	GLint alignment;
+	render_device()->get_integer_v(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if(alignment <= 0)
+		alignment = 256;
+	stride_ = (sizeof(Shader::material_t) + alignment - 1) / alignment * alignment;
+
+	grow(MATERIAL_BUFFER_INITIAL_SIZE);
+
+	Shader::material_t material;
+	material.use_texture = 0;
+	material.use_normal_map = 0;
+	material.shininess = 0.f;
+	material.diffuse = glm::vec4(1.f);
+	material.specular = glm::vec4(0.f);
+	material.ambient = glm::vec4(0.f);
+	material.emission = glm::vec4(0.f);
+	add(material);
+}
+
+unsigned int MaterialBuffer::add(const Shader::material_t &material) {
+	assert(std::this_thread::get_id() == gl_thread_);
+	std::string k = key(material);
+	std::map<std::string, unsigned int>::const_iterator it = indices_.find(k);
+	if(it != indices_.end()) {
+		++references_[it->second];
+		return it->second;
+	}
+
+	unsigned int index;
+	if(!free_.empty()) {
+		index = free_.back();
+		free_.pop_back();
+		materials_[index] = material;
+	} else {
+		index = materials_.size();
+		materials_.push_back(material);
+		references_.push_back(0);
+	}
+	indices_[k] = index;
+	references_[index] = 1;
+
+	if(index >= capacity_)
+		grow(capacity_*2);
+	else
+		upload(index);
+	return index;
+}
+
+void MaterialBuffer::release(unsigned int index) {
+	assert(std::this_thread::get_id() == gl_thread_);
+	if(index == 0 || index >= references_.size() || references_[index] == 0)
+		return;
+	if(--references_[index] > 0)
+		return;
+	indices_.erase(key(materials_[index]));
+	free_.push_back(index);
+}
+
+unsigned int MaterialBuffer::update(unsigned int index, const Shader::material_t &material) {
+	assert(std::this_thread::get_id() == gl_thread_);
+	std::string k = key(material);
+	bool only_reference = (index != 0 && index < references_.size() && references_[index] == 1);
+	if(!only_reference || indices_.find(k) != indices_.end()) {
+		unsigned int next = add(material);
+		release(index);
+		return next;
+	}
+
+	indices_.erase(key(materials_[index]));
+	materials_[index] = material;
+	indices_[k] = index;
+	upload(index);
+	return index;
+}
+
+void MaterialBuffer::upload(unsigned int index) {
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.materialBuffer);
+	render_device()->buffer_sub_data(GL_UNIFORM_BUFFER, index*stride_, sizeof(Shader::material_t), &materials_[index]);
+}
+
+bool MaterialBuffer::matches(unsigned int index, const Shader::material_t &material) {
+	return index < materials_.size() && memcmp(&materials_[index], &material, sizeof(Shader::material_t)) == 0;
+}
+
+bool MaterialBuffer::bind(unsigned int index) {
+	return GLState::bind_buffer_range(GL_UNIFORM_BUFFER, Shader::MATERIAL_BLOCK_INDEX, Shader::globals.materialBuffer,
+		index*stride_, sizeof(Shader::material_t));
+}
+
+void MaterialBuffer::grow(unsigned int capacity) {
+	capacity_ = capacity;
+
+	std::vector<char> data(capacity_*stride_, 0);
+	for(unsigned int i=0; i < materials_.size(); ++i) {
+		memcpy(&data[i*stride_], &materials_[i], sizeof(Shader::material_t));
+	}
+
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.materialBuffer);
+	render_device()->buffer_data(GL_UNIFORM_BUFFER, data.size(), &data.front(), GL_STATIC_DRAW);
+	Renderer::checkForGLErrors("MaterialBuffer::grow()");
+}
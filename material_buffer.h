@@ -0,0 +1,64 @@
+#ifndef MATERIAL_BUFFER_H
+#define MATERIAL_BUFFER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <thread>
+#include <glload/gl_3_3.h>
+
+#include "shader.h"
+
+//Materials the buffer has room for before it is first grown
+#define MATERIAL_BUFFER_INITIAL_SIZE 64
+
+/*
+ * Every material in use, packed in Shader::globals.materialBuffer.
+ *
+ * Materials are added when a model is uploaded and draws select theirs by binding its range
+ * to the Material block, so nothing is uploaded while drawing. Equal materials share an index,
+ * slots are reference counted and reused once released. A material changed every frame is
+ * rewritten in its own slot (see update()), RenderObject::tint is still cheaper for fades.
+ *
+ * All functions must be called from the GL thread (the one that called init()), add(),
+ * release() and update() assert it.
+ */
+class MaterialBuffer {
+public:
+	//Allocates the buffer, index 0 is the default material
+	static void init();
+
+	//Returns the index of material and adds a reference to it, adding and uploading it if it isn't in the buffer
+	static unsigned int add(const Shader::material_t &material);
+	//Drops a reference from add(), the slot is reused when none are left. Index 0 is never freed
+	static void release(unsigned int index);
+	//Changes the material of a reference from add(), returns its new index. Rewrites the slot if it has no other references
+	static unsigned int update(unsigned int index, const Shader::material_t &material);
+	//True if index holds material
+	static bool matches(unsigned int index, const Shader::material_t &material);
+
+	//Binds material index to the Material block, false if it already was bound
+	static bool bind(unsigned int index);
+
+	static unsigned int size() { return materials_.size(); };
+	//Distance between the materials in the buffer, sizeof(Shader::material_t) rounded up to the offset alignment
+	static size_t stride() { return stride_; };
+
+private:
+	static std::string key(const Shader::material_t &material) { return std::string((const char*)&material, sizeof(Shader::material_t)); };
+	//Writes slot index of the buffer
+	static void upload(unsigned int index);
+	//Reallocates the buffer with room for capacity materials and uploads all of them
+	static void grow(unsigned int capacity);
+
+	static std::vector<Shader::material_t> materials_; //Copy of the buffer contents
+	static std::map<std::string, unsigned int> indices_; //Material bytes -> index
+	static std::vector<unsigned int> references_; //Per slot, 0 if free
+	static std::vector<unsigned int> free_;
+	static unsigned int capacity_;
+	static size_t stride_;
+	static std::thread::id gl_thread_;
+};
+
+#endif
@@ -1,20 +1,31 @@
 #include "mesh.h"
 #include "renderer.h"
+#include "packed_vertex.h"
+#include "buffer_arena.h"
+#include "gl_state.h"
+#include "render_device.h"
 
 #include <cstdio>
 #include <glm/glm.hpp>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <algorithm>
 #include <glload/gl_3_3.h>
 
 Mesh::Mesh(const std::vector<vertex_t> &vertices, const std::vector<unsigned int> &indices) :
-	vbos_generated_(false),vertices_(vertices), indices_(indices)	{
+	vbos_generated_(false), buffer_(NULL), vertices_(vertices), indices_(indices)	{
 	assert((indices.size()%3)==0);
 }
 
 Mesh::~Mesh() {
-	if(vbos_generated_)
-		glDeleteBuffers(2, buffers_);
+	if(buffer_ != NULL) {
+		BufferArena::free(buffer_);
+	} else if(vbos_generated_) {
+		GLState::delete_vertex_array(vao_);
+		GLState::delete_buffer(buffers_[0]);
+		GLState::delete_buffer(buffers_[1]);
+	}
 }
 
 void Mesh::generate_normals() {
@@ -77,60 +88,73 @@ void Mesh::verify_immutable(const char * where) {
 	}
 }
 
-void Mesh::generate_vbos() {
+void Mesh::generate_vbos(bool packed) {
 	verify_immutable("generate_vbos()");
 
-	//Upload data:
-	glGenBuffers(2, buffers_);
-	Renderer::checkForGLErrors("Mesh::generate_vbos(): gen buffers");
-
-	glBindBuffer(GL_ARRAY_BUFFER, buffers_[0]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_t)*vertices_.size(), &vertices_.front(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	Renderer::checkForGLErrors("Mesh::generate_vbos(): fill array buffer");
+	num_faces_ = indices_.size();
+	vbos_generated_ = true;
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers_[1]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indices_.size(), &indices_.front(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	Renderer::checkForGLErrors("Mesh::generate_vbos(): fill element array buffer");
+	if(packed) {
+		float max_abs_uv = 0.f;
+		for(std::vector<vertex_t>::const_iterator it=vertices_.begin(); it!=vertices_.end(); ++it) {
+			max_abs_uv = std::max(max_abs_uv, std::max(fabsf(it->texCoord.x), fabsf(it->texCoord.y)));
+		}
+		unsigned int format = PackedVertex::choose_format(vertices_.size(), max_abs_uv);
 
-	num_faces_ = indices_.size();
+		size_t vertex_size = PackedVertex::vertex_size(format);
+		std::vector<char> vertex_data(vertex_size*vertices_.size());
+		for(unsigned int i=0; i<vertices_.size(); ++i) {
+			const vertex_t &v = vertices_[i];
+			PackedVertex::pack(format, &vertex_data[vertex_size*i], v.position, v.texCoord, v.normal, v.tangent, v.bitangent);
+		}
+		std::vector<char> index_data(PackedVertex::index_size(format)*indices_.size());
+		PackedVertex::pack_indices(format, &index_data.front(), &indices_.front(), indices_.size());
 
-	vbos_generated_ = true;
-}
+		printf("Mesh::generate_vbos(): %lu vertices packed to %lu bytes (%lu unpacked)\n",
+			vertices_.size(), vertex_data.size(), sizeof(vertex_t)*vertices_.size());
 
-void Mesh::render() {
-	glBindBuffer(GL_ARRAY_BUFFER, buffers_[0]);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers_[1]);
+		buffer_ = BufferArena::for_format(format)->allocate(format, &vertex_data.front(), vertices_.size(), &index_data.front(), indices_.size());
+		return;
+	}
 
-	Renderer::checkForGLErrors("Mesh::render(): Bind buffers");
+	//Upload data:
+	render_device()->gen_buffers(2, buffers_);
+	Renderer::checkForGLErrors("Mesh::generate_vbos(): gen buffers");
 
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
-	glEnableVertexAttribArray(3);
-	glEnableVertexAttribArray(4);
+	GLState::bind_buffer(GL_ARRAY_BUFFER, buffers_[0]);
+	render_device()->buffer_data(GL_ARRAY_BUFFER, sizeof(vertex_t)*vertices_.size(), &vertices_.front(), GL_STATIC_DRAW);
+	Renderer::checkForGLErrors("Mesh::generate_vbos(): fill array buffer");
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), 0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)));
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)+sizeof(glm::vec2)));
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (2*sizeof(glm::vec3)+sizeof(glm::vec2)));
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (3*sizeof(glm::vec3)+sizeof(glm::vec2)));
+	//The index buffer binding is stored in the vao, so fill it with the vao bound
+	render_device()->gen_vertex_arrays(1, &vao_);
+	GLState::bind_vertex_array(vao_);
 
-	Renderer::checkForGLErrors("Mesh::render(): Set vertex attribs");
+	GLState::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffers_[1]);
+	render_device()->buffer_data(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indices_.size(), &indices_.front(), GL_STATIC_DRAW);
+	Renderer::checkForGLErrors("Mesh::generate_vbos(): fill element array buffer");
 
-	glDrawElements(GL_TRIANGLES, num_faces_, GL_UNSIGNED_INT, 0);	
+	render_device()->enable_vertex_attrib_array(0);
+	render_device()->enable_vertex_attrib_array(1);
+	render_device()->enable_vertex_attrib_array(2);
+	render_device()->enable_vertex_attrib_array(3);
 
-	Renderer::checkForGLErrors("Mesh::render(): glDrawElements()");
+	//The tangent gets w=1, ortonormalize_tangent_space() makes the bitangent cross(normal, tangent)
+	render_device()->vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), 0);
+	render_device()->vertex_attrib_pointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)));
+	render_device()->vertex_attrib_pointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)+sizeof(glm::vec2)));
+	render_device()->vertex_attrib_pointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (2*sizeof(glm::vec3)+sizeof(glm::vec2)));
 
-	glDisableVertexAttribArray(4);
-	glDisableVertexAttribArray(3);
-	glDisableVertexAttribArray(2);
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(0);
+	Renderer::checkForGLErrors("Mesh::generate_vbos(): create vao");
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+void Mesh::render() {
+	if(buffer_ != NULL) {
+		BufferArena::draw(buffer_);
+	} else {
+		GLState::bind_vertex_array(vao_);
+		render_device()->draw_elements(GL_TRIANGLES, num_faces_, GL_UNSIGNED_INT, 0);	
+	}
+	++Renderer::stats.draw_calls;
 
-	Renderer::checkForGLErrors("Mesh::render(): Teardown ");
+	Renderer::checkForGLErrors("Mesh::render(): render_device()->draw_elements()");
 }
@@ -5,6 +5,8 @@
 #include <vector>
 #include <glload/gl_3_3.h>
 
+#include "buffer_arena.h"
+
 
 class Mesh {
 public:
@@ -24,13 +26,19 @@ public:
 	void generate_normals();
 	void generate_tangents_and_bitangents();
 	void ortonormalize_tangent_space();
-	//The mesh becommes immutable when vbos have been generated
-	void generate_vbos();
+	/*
+	 * The mesh becommes immutable when vbos have been generated
+	 * Set packed to false to upload full floats instead of the PackedVertex layout.
+	 * Either way the shader gets no bitangent, it is rebuilt from the normal and tangent.
+	 */
+	void generate_vbos(bool packed=true);
 	void render();
 	unsigned long num_faces() { return num_faces_; };
 private:
-	GLenum buffers_[2]; //0:vertex buffer, 1: index buffer
+	GLenum buffers_[2]; //0:vertex buffer, 1: index buffer, only used when not packed
+	GLuint vao_;
 	bool vbos_generated_;
+	BufferArena::allocation_t * buffer_; //Set when packed
 	unsigned long num_faces_;
 	std::vector<vertex_t> vertices_;
 	std::vector<unsigned int> indices_;
@@ -0,0 +1,697 @@
+#include "model.h"
+#include "render_object.h"
+#include "cooked_model.h"
+#include "model_loader.h"
+#include "texture.h"
+#include "packed_vertex.h"
+#include "buffer_arena.h"
+#include "material_buffer.h"
+#include "clip_compression.h"
+#include "profiler.h"
+
+#include <string>
+#include <map>
+#include <cstdio>
+#include <cassert>
+#include <cstdlib>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include <mutex>
+#include <stdint.h>
+
+#include <assimp/assimp.h>
+#include <assimp/aiScene.h>
+#include <assimp/aiPostProcess.h>
+#include <glm/glm.hpp>
+
+#define aisgl_min(x,y) (x<y?x:y)
+#define aisgl_max(x,y) (y>x?y:x)
+
+//Assimp's C API is built without boost, so its global state has no locks of its own.
+//Held by the loader threads around importing and releasing, reading the scene needs no lock
+static std::mutex assimp_mutex;
+
+//Part of the cache key, cooked models are recooked when this changes
+#define IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_GenSmoothNormals | \
+		aiProcess_JoinIdenticalVertices |  \
+		aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph  | \
+		aiProcess_ImproveCacheLocality | aiProcess_GenUVCoords | \
+		aiProcess_ValidateDataStructure | aiProcess_FixInfacingNormals | \
+		aiProcess_CalcTangentSpace)
+
+std::map<std::string, Model*> Model::loaded_models_;
+
+Model * Model::acquire(const std::string &file, unsigned int aiOptions, ModelLoader * loader) {
+	unsigned int import_flags = IMPORT_FLAGS | aiOptions;
+
+	//Key on the canonical path so different paths to the same file share the model
+	char resolved[PATH_MAX];
+	std::string path = (realpath(file.c_str(), resolved) != NULL) ? std::string(resolved) : file;
+	char flags[16];
+	sprintf(flags, ":%x", import_flags);
+	std::string key = path + flags;
+
+	std::map<std::string, Model*>::iterator it = loaded_models_.find(key);
+	if(it != loaded_models_.end()) {
+		++it->second->ref_count_;
+		return it->second;
+	}
+
+	Model * model = new Model(file, key, import_flags, loader);
+	loaded_models_[key] = model;
+	return model;
+}
+
+void Model::release(Model * model) {
+	if(--model->ref_count_ == 0) {
+		loaded_models_.erase(model->key_);
+		delete model;
+	}
+}
+
+Model::Model(const std::string &file, const std::string &key, unsigned int import_flags, ModelLoader * loader) :
+	name_(file),
+	key_(key),
+	ref_count_(1),
+	source_animation_bytes_(0),
+	ready_(false),
+	failed_(false),
+	loader_(loader) {
+
+	if(loader_ != NULL) {
+		loader_->load(this, file, import_flags);
+		return;
+	}
+
+	CookedModel cooked;
+	if(load_cooked(file, import_flags, cooked)) {
+		pre_render(cooked);
+	} else {
+		printf("Failed to load model %s\n", file.c_str());
+		failed_ = true;
+	}
+}
+
+Model::~Model() {
+	if(loader_ != NULL)
+		loader_->cancel(this);
+
+	for(std::vector<RenderObject::mesh_data_t>::iterator it=meshes.begin(); it!=meshes.end(); ++it) {
+		BufferArena::free(it->buffer);
+		delete it->skin;
+	}
+
+	for(std::vector<RenderObject::material_t>::iterator it=materials.begin(); it!=materials.end(); ++it) {
+		MaterialBuffer::release(it->index);
+		if(it->texture != NULL)
+			Texture::release(it->texture);
+		if(it->normal_map != NULL)
+			Texture::release(it->normal_map);
+	}
+}
+
+void Model::color4_to_vec4(const struct aiColor4D *c, glm::vec4 &target) {
+	target.x = c->r;
+	target.y = c->g;
+	target.z = c->b;
+	target.w = c->a;
+}
+
+bool Model::load_cooked(const std::string &file, unsigned int import_flags, CookedModel &cooked) {
+	PROFILE_SCOPE("Model::load_cooked");
+	//Use the cooked model if there is one for this version of the file, otherwise import and cook it
+	uint64_t key = CookedModel::cache_key(file, import_flags);
+	std::string cache_file = CookedModel::cache_path(file, key);
+
+	if(key != 0 && cooked.read(cache_file, key)) {
+		printf("Loaded cooked model %s from %s\n", file.c_str(), cache_file.c_str());
+		return true;
+	} else if(import(file, import_flags, cooked)) {
+		if(key != 0)
+			cooked.write(cache_file, key);
+		return true;
+	}
+	return false;
+}
+
+void Model::init(CookedModel &cooked) {
+	nodes.swap(cooked.nodes);
+	node_names.swap(cooked.node_names);
+	node_meshes.swap(cooked.node_meshes);
+	bones.swap(cooked.bones);
+
+	rest_pose.resize(nodes.size());
+	for(unsigned int i=0; i < nodes.size(); ++i) {
+		rest_pose[i] = RenderObject::transform_t::from_matrix(nodes[i].transformation);
+	}
+	animations.swap(cooked.animations);
+
+	scene_min = cooked.scene_min;
+	scene_max = cooked.scene_max;
+	source_animation_bytes_ = cooked.source_animation_bytes;
+}
+
+size_t Model::node_bytes() const {
+	size_t bytes = nodes.size()*sizeof(RenderObject::node_t) + node_meshes.size()*sizeof(unsigned int);
+	for(std::vector<std::string>::const_iterator it=node_names.begin(); it!=node_names.end(); ++it) {
+		bytes += it->size();
+	}
+	return bytes;
+}
+
+size_t Model::animation_bytes() const {
+	size_t bytes = 0;
+	for(std::vector<RenderObject::animation_t>::const_iterator it=animations.begin(); it!=animations.end(); ++it) {
+		bytes += it->node_channels.size()*sizeof(int);
+		for(std::vector<RenderObject::node_anim_t>::const_iterator c=it->channels.begin(); c!=it->channels.end(); ++c) {
+			bytes += sizeof(RenderObject::node_anim_t);
+			bytes += c->position.times.size()*sizeof(float) + c->position.values.size()*sizeof(glm::vec3);
+			bytes += c->rotation.times.size()*sizeof(float) + c->rotation.values.size()*sizeof(int16_t);
+			bytes += c->scaling.times.size()*sizeof(float) + c->scaling.values.size()*sizeof(glm::vec3);
+		}
+	}
+	return bytes;
+}
+
+void Model::print_memory() const {
+	printf("Model %s: %lu meshes, %lu nodes (%lu bytes), %lu animations (%lu bytes, %lu uncompressed)\n",
+		name_.c_str(), meshes.size(), nodes.size(), node_bytes(),
+		animations.size(), animation_bytes(), source_animation_bytes_);
+}
+
+void Model::print_memory_all() {
+	for(std::map<std::string, Model*>::const_iterator it=loaded_models_.begin(); it!=loaded_models_.end(); ++it) {
+		if(it->second->ready())
+			it->second->print_memory();
+	}
+}
+
+bool Model::import(const std::string &file, unsigned int import_flags, CookedModel &cooked) {
+	const aiVector3D zero_3d(0.0f,0.0f,0.0f);
+
+	const aiScene * scene;
+	{
+		std::lock_guard<std::mutex> lock(assimp_mutex);
+		scene = aiImportFile(file.c_str(), import_flags);
+	}
+
+	if(scene == 0)
+		return false;
+
+	printf("Loaded model %s: \nMeshes: %d\nTextures: %d\nMaterials: %d\nAnimations: %d\n",file.c_str(), scene->mNumMeshes, scene->mNumTextures, scene->mNumMaterials, scene->mNumAnimations);
+
+	//Get bounds:
+	aiVector3D s_min, s_max;
+	get_bounding_box(scene, &s_min, &s_max);
+	cooked.scene_min = glm::make_vec3((float*)&s_min);
+	cooked.scene_max = glm::make_vec3((float*)&s_max);
+
+	//Bone nodes are found by name once the nodes are imported
+	std::vector<std::string> bone_names;
+
+	for(unsigned int i=0; i<scene->mNumMeshes; ++i) {
+		const aiMesh* mesh = scene->mMeshes[i];
+		CookedModel::mesh_t md;
+
+		float max_abs_uv = 0.f;
+		if(mesh->HasTextureCoords(0)) {
+			for(unsigned int n = 0; n<mesh->mNumVertices; ++n) {
+				max_abs_uv = std::max(max_abs_uv, std::max(fabsf(mesh->mTextureCoords[0][n].x), fabsf(mesh->mTextureCoords[0][n].y)));
+			}
+		}
+
+		md.mtl_index = mesh->mMaterialIndex;
+		md.format = PackedVertex::choose_format(mesh->mNumVertices, max_abs_uv);
+		md.num_vertices = mesh->mNumVertices;
+		md.vertex_offset = cooked.vertex_data.size();
+		md.num_indices = 0;
+		md.first_bone = cooked.bones.size();
+		md.num_bones = 0;
+
+		glm::vec3 bounds_min(0.f), bounds_max(0.f);
+		for(unsigned int n = 0; n<mesh->mNumVertices; ++n) {
+			glm::vec3 pos = glm::make_vec3((float*)&mesh->mVertices[n]);
+			bounds_min = (n == 0) ? pos : glm::min(bounds_min, pos);
+			bounds_max = (n == 0) ? pos : glm::max(bounds_max, pos);
+		}
+		for(int c=0; c < 3; ++c) {
+			md.bounds_min[c] = bounds_min[c];
+			md.bounds_max[c] = bounds_max[c];
+		}
+
+		std::vector<uint8_t> vertex_bones;
+		std::vector<float> vertex_weights;
+		if(mesh->HasBones()) {
+			if(mesh->mNumBones <= SKIN_MAX_BONES) {
+				md.format |= PackedVertex::SKINNED;
+				md.num_bones = mesh->mNumBones;
+				import_bones(mesh, vertex_bones, vertex_weights, cooked, bone_names);
+			} else {
+				printf("Mesh %d in %s has %d bones, more than %d are not supported. It will not be animated\n", i, file.c_str(), mesh->mNumBones, SKIN_MAX_BONES);
+			}
+		}
+
+		size_t vertex_size = PackedVertex::vertex_size(md.format);
+		cooked.vertex_data.resize(md.vertex_offset + vertex_size*mesh->mNumVertices);
+
+		for(unsigned int n = 0; n<mesh->mNumVertices; ++n) {
+			const aiVector3D* pos = &(mesh->mVertices[n]);
+			const aiVector3D* texCoord = mesh->HasTextureCoords(0) ? &(mesh->mTextureCoords[0][n]) : &zero_3d;
+			const aiVector3D* normal = &(mesh->mNormals[n]);
+			const aiVector3D* tangent, *bitangent;
+			if(mesh->HasTangentsAndBitangents()) {
+				tangent = &(mesh->mTangents[n]);
+				bitangent= &(mesh->mBitangents[n]);
+			} else {
+				tangent = &zero_3d;
+				bitangent = &zero_3d;
+			}
+			if(!mesh->HasNormals())
+				normal = &zero_3d;
+			PackedVertex::pack(md.format, &cooked.vertex_data[md.vertex_offset + vertex_size*n],
+				glm::make_vec3((float*)pos), glm::vec2(texCoord->x, texCoord->y), glm::make_vec3((float*)normal),
+				glm::make_vec3((float*)tangent), glm::make_vec3((float*)bitangent));
+			if(md.format & PackedVertex::SKINNED) {
+				PackedVertex::pack_bones(md.format, &cooked.vertex_data[md.vertex_offset + vertex_size*n],
+					&vertex_bones[SKIN_BONES_PER_VERTEX*n], &vertex_weights[SKIN_BONES_PER_VERTEX*n]);
+			}
+		}
+
+		std::vector<unsigned int> indices;
+		for(unsigned int n = 0 ; n<mesh->mNumFaces; ++n) {
+			const aiFace* face = &mesh->mFaces[n];
+			assert(face->mNumIndices == 3);
+			md.num_indices+=3;
+
+			for(unsigned int j = 0; j< face->mNumIndices; ++j) {
+				int index = face->mIndices[j];
+				indices.push_back(index);
+			}
+		}
+
+		//Keep every mesh 4 byte aligned, 16 bit meshes may leave it at 2
+		cooked.index_data.resize((cooked.index_data.size() + 3) & ~3);
+		md.index_offset = cooked.index_data.size();
+		cooked.index_data.resize(md.index_offset + PackedVertex::index_size(md.format)*indices.size());
+		if(!indices.empty())
+			PackedVertex::pack_indices(md.format, &cooked.index_data[md.index_offset], &indices.front(), indices.size());
+
+		cooked.meshes.push_back(md);
+	}
+
+	import_materials(scene, cooked);
+	import_animations(scene, cooked);
+	import_node(scene->mRootNode, -1, cooked);
+	for(unsigned int i=0; i < cooked.bones.size(); ++i) {
+		std::vector<std::string>::const_iterator it = std::find(cooked.node_names.begin(), cooked.node_names.end(), bone_names[i]);
+		if(it != cooked.node_names.end()) {
+			cooked.bones[i].node = it - cooked.node_names.begin();
+		} else {
+			printf("Bone %s in %s has no node, using the root\n", bone_names[i].c_str(), file.c_str());
+			cooked.bones[i].node = 0;
+		}
+	}
+	import_node_channels(scene, cooked);
+/*
+	if(scene->HasAnimations()) {
+		printf("Animation data:\n");
+		for(unsigned int i=0; i < scene->mNumAnimations; ++i) {
+			aiAnimation * anim = scene->mAnimations[i];
+			printf("Name: %s, Bone Channels: %d, Mesh channels: %d, tps: %f, duration: %f\n", anim->mName.data, anim->mNumChannels, anim->mNumMeshChannels, anim->mTicksPerSecond, anim->mDuration);
+			for(unsigned int n=0; n<anim->mNumChannels; ++n) {
+				aiNodeAnim * na = anim->mChannels[n];
+				printf("nodeAnim: Node name: %s, position keys: %d, rotation keys: %d, scaling keys: %d\n", na->mNodeName.data, na->mNumPositionKeys, na->mNumRotationKeys, na->mNumScalingKeys);
+			}
+		}
+	}
+*/
+	//Everything needed has been copied to cooked
+	{
+		std::lock_guard<std::mutex> lock(assimp_mutex);
+		aiReleaseImport(scene);
+	}
+
+	return true;
+}
+
+Texture * Model::load_texture(std::string path) {
+	size_t last_slash = path.rfind("/");
+	if(last_slash != std::string::npos) 
+		path = path.substr(last_slash+1);
+	std::string full_path = std::string("textures/")+path;
+	return Texture::acquire(full_path);
+}
+
+void Model::pre_render(CookedModel &cooked) {
+	init(cooked);
+
+	for(unsigned int i=0; i < cooked.meshes.size(); ++i) {
+		upload_mesh(cooked, i);
+	}
+
+	for(unsigned int i=0; i < cooked.materials.size(); ++i) {
+		upload_material(cooked, i);
+	}
+
+	ready_ = true;
+}
+
+size_t Model::upload_mesh(const CookedModel &cooked, unsigned int mesh) {
+	const CookedModel::mesh_t &cm = cooked.meshes[mesh];
+	RenderObject::mesh_data_t md;
+
+	md.mtl_index = cm.mtl_index;
+	md.first_bone = cm.first_bone;
+	md.num_bones = cm.num_bones;
+	md.bounds_min = glm::make_vec3(cm.bounds_min);
+	md.bounds_max = glm::make_vec3(cm.bounds_max);
+
+	//When the model was cooked the data is uploaded straight from the mapped file
+	md.buffer = BufferArena::for_format(cm.format)->allocate(cm.format, cooked.vertices(cm), cm.num_vertices, cooked.indices(cm), cm.num_indices);
+
+	if(md.num_bones > 0 && Skinning::backend == Skinning::CPU_SKINNING)
+		md.skin = create_skin(cooked, mesh);
+
+	meshes.push_back(md);
+
+	return PackedVertex::vertex_size(cm.format)*cm.num_vertices + PackedVertex::index_size(cm.format)*cm.num_indices;
+}
+
+Skinning::source_t * Model::create_skin(const CookedModel &cooked, unsigned int mesh) {
+	const CookedModel::mesh_t &cm = cooked.meshes[mesh];
+	Skinning::source_t * skin = new Skinning::source_t();
+	skin->positions.resize(cm.num_vertices);
+	skin->uvs.resize(cm.num_vertices);
+	skin->normals.resize(cm.num_vertices);
+	skin->tangents.resize(cm.num_vertices);
+	skin->bones.resize(SKIN_BONES_PER_VERTEX*cm.num_vertices);
+	skin->weights.resize(SKIN_BONES_PER_VERTEX*cm.num_vertices);
+
+	const char * vertices = (const char*)cooked.vertices(cm);
+	size_t vertex_size = PackedVertex::vertex_size(cm.format);
+	for(unsigned int v=0; v < cm.num_vertices; ++v) {
+		uint8_t * bones = &skin->bones[SKIN_BONES_PER_VERTEX*v];
+		PackedVertex::unpack(cm.format, vertices + vertex_size*v, skin->positions[v], skin->uvs[v],
+			skin->normals[v], skin->tangents[v], bones, &skin->weights[SKIN_BONES_PER_VERTEX*v]);
+		//The palette only has num_bones matrices
+		for(int i=0; i < SKIN_BONES_PER_VERTEX; ++i)
+			bones[i] = std::min(bones[i], (uint8_t)(cm.num_bones - 1));
+	}
+
+	skin->indices.resize(cm.num_indices);
+	const void * indices = cooked.indices(cm);
+	for(unsigned int i=0; i < cm.num_indices; ++i) {
+		if(cm.format & PackedVertex::SHORT_INDICES)
+			skin->indices[i] = ((const uint16_t*)indices)[i];
+		else
+			skin->indices[i] = ((const uint32_t*)indices)[i];
+	}
+	return skin;
+}
+
+size_t Model::upload_material(const CookedModel &cooked, unsigned int material) {
+	const CookedModel::material_t &cm = cooked.materials[material];
+	RenderObject::material_t mtl_data;
+	size_t bytes = 0;
+
+	mtl_data.attr = cm.attr;
+	mtl_data.two_sided = cm.two_sided;
+	mtl_data.index = MaterialBuffer::add(mtl_data.attr);
+
+	if(!cm.texture.empty()) {
+		mtl_data.texture = load_texture(cm.texture);
+		bytes += mtl_data.texture->width()*mtl_data.texture->height()*4;
+	}
+	if(!cm.normal_map.empty()) {
+		mtl_data.normal_map = load_texture(cm.normal_map);
+		bytes += mtl_data.normal_map->width()*mtl_data.normal_map->height()*4;
+	}
+	materials.push_back(mtl_data);
+
+	return bytes;
+}
+
+void Model::import_materials(const aiScene * scene, CookedModel &cooked) {
+	for(unsigned int i= 0; i < scene->mNumMaterials; ++i) {
+		const aiMaterial * mtl = scene->mMaterials[i];
+		CookedModel::material_t mtl_data;
+		mtl_data.two_sided = false;
+		aiString path;
+		if(mtl->GetTextureCount(aiTextureType_DIFFUSE) > 0 && 
+			mtl->GetTexture(aiTextureType_DIFFUSE, 0, &path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
+			mtl_data.texture = path.data;
+			mtl_data.attr.use_texture = 1;//toggle textures on
+		} else if(mtl->GetTextureCount(aiTextureType_AMBIENT) > 0 && 
+			mtl->GetTexture(aiTextureType_AMBIENT, 0, &path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
+			mtl_data.texture = path.data;
+			mtl_data.attr.use_texture = 1;//toggle textures on
+		} else {
+			mtl_data.attr.use_texture = 0; //toggle textures off
+		}
+	
+		//Check for normalmap:
+		if(mtl->GetTextureCount(aiTextureType_HEIGHT) > 0 && 
+			mtl->GetTexture(aiTextureType_HEIGHT, 0, &path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
+			mtl_data.normal_map = path.data;
+			mtl_data.attr.use_normal_map = 1;
+			printf("Using normal map: %s\n", path.data);
+		} else {
+			mtl_data.attr.use_normal_map = 0;
+		}
+
+		aiString name;
+		mtl->Get(AI_MATKEY_NAME, name);
+
+		aiColor4D diffuse;
+		aiColor4D specular;
+		aiColor4D ambient;
+		aiColor4D emission;	
+		mtl_data.attr.diffuse = glm::vec4( 0.8f, 0.8f, 0.8f, 1.0f);
+		if(AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_DIFFUSE, &diffuse))
+			color4_to_vec4(&diffuse, mtl_data.attr.diffuse);
+
+		mtl_data.attr.specular = glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f);
+		if(AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_SPECULAR, &specular))
+			color4_to_vec4(&specular, mtl_data.attr.specular);
+
+		mtl_data.attr.ambient = glm::vec4( 0.2f, 0.2f, 0.2f, 1.0f);
+		if(AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_AMBIENT, &ambient))
+			color4_to_vec4(&ambient, mtl_data.attr.ambient);
+
+		mtl_data.attr.emission = glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f);
+		if(AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_EMISSIVE, &emission))
+			color4_to_vec4(&emission, mtl_data.attr.emission);
+
+		unsigned int max = 1;
+		float strength;
+		int ret1 = aiGetMaterialFloatArray(mtl, AI_MATKEY_SHININESS, &mtl_data.attr.shininess, &max);
+		if(ret1 == AI_SUCCESS) {
+			max = 1;
+			int ret2 = aiGetMaterialFloatArray(mtl, AI_MATKEY_SHININESS_STRENGTH, &strength, &max);
+			if(ret2 == AI_SUCCESS)
+				mtl_data.attr.shininess *= strength;
+		} else {
+			mtl_data.attr.shininess = 0.0f;
+			mtl_data.attr.specular = glm::vec4(0.f, 0.f, 0.f, 0.f);
+		}
+		max = 1;
+		int two_sided;
+		if((AI_SUCCESS == aiGetMaterialIntegerArray(mtl, AI_MATKEY_TWOSIDED, &two_sided, &max)) && two_sided)
+			mtl_data.two_sided = true;
+
+		cooked.materials.push_back(mtl_data);
+	}
+}
+
+void Model::import_animations(const aiScene * scene, CookedModel &cooked) {
+	for(unsigned int i=0; i < scene->mNumAnimations; ++i) {
+		const aiAnimation * anim = scene->mAnimations[i];
+		RenderObject::animation_t animation;
+		animation.duration = anim->mDuration;
+		animation.ticks_per_second = anim->mTicksPerSecond;
+		animation.channels.resize(anim->mNumChannels);
+
+		for(unsigned int n=0; n<anim->mNumChannels; ++n) {
+			const aiNodeAnim * na = anim->mChannels[n];
+			RenderObject::node_anim_t &channel = animation.channels[n];
+
+			channel.position.times.resize(na->mNumPositionKeys);
+			channel.position.values.resize(na->mNumPositionKeys);
+			for(unsigned int k=0; k<na->mNumPositionKeys; ++k) {
+				channel.position.times[k] = na->mPositionKeys[k].mTime;
+				channel.position.values[k] = glm::make_vec3((float*)&na->mPositionKeys[k].mValue);
+			}
+
+			std::vector<glm::fquat> rotations(na->mNumRotationKeys);
+			channel.rotation.times.resize(na->mNumRotationKeys);
+			for(unsigned int k=0; k<na->mNumRotationKeys; ++k) {
+				const aiQuaternion &q = na->mRotationKeys[k].mValue;
+				channel.rotation.times[k] = na->mRotationKeys[k].mTime;
+				rotations[k] = glm::fquat(q.w, q.x, q.y, q.z);
+			}
+
+			channel.scaling.times.resize(na->mNumScalingKeys);
+			channel.scaling.values.resize(na->mNumScalingKeys);
+			for(unsigned int k=0; k<na->mNumScalingKeys; ++k) {
+				channel.scaling.times[k] = na->mScalingKeys[k].mTime;
+				channel.scaling.values[k] = glm::make_vec3((float*)&na->mScalingKeys[k].mValue);
+			}
+
+			ClipCompression::reduce(channel.position.times, channel.position.values, CLIP_POSITION_TOLERANCE);
+			ClipCompression::reduce(channel.rotation.times, rotations, CLIP_ROTATION_TOLERANCE);
+			ClipCompression::reduce(channel.scaling.times, channel.scaling.values, CLIP_SCALING_TOLERANCE);
+
+			channel.rotation.values.resize(4*rotations.size());
+			for(unsigned int k=0; k<rotations.size(); ++k) {
+				ClipCompression::pack_quat(rotations[k], &channel.rotation.values[4*k]);
+			}
+
+			cooked.source_animation_bytes += na->mNumPositionKeys*sizeof(aiVectorKey)
+				+ na->mNumRotationKeys*sizeof(aiQuatKey) + na->mNumScalingKeys*sizeof(aiVectorKey);
+		}
+
+		cooked.animations.push_back(animation);
+	}
+}
+
+/*
+ * Adds the bones of mesh to cooked and finds the SKIN_BONES_PER_VERTEX largest weights of each vertex.
+ * The weights are normalized so they sum to one.
+ */
+void Model::import_bones(const aiMesh * mesh, std::vector<uint8_t> &vertex_bones, std::vector<float> &vertex_weights,
+		CookedModel &cooked, std::vector<std::string> &bone_names) {
+	vertex_bones.assign(SKIN_BONES_PER_VERTEX*mesh->mNumVertices, 0);
+	vertex_weights.assign(SKIN_BONES_PER_VERTEX*mesh->mNumVertices, 0.f);
+
+	for(unsigned int b=0; b < mesh->mNumBones; ++b) {
+		const aiBone * bone = mesh->mBones[b];
+
+		RenderObject::bone_t bd;
+		bd.node = -1;
+		aiMatrix4x4 m = bone->mOffsetMatrix;
+		aiTransposeMatrix4(&m);
+		bd.offset = glm::make_mat4((float*)&m);
+		cooked.bones.push_back(bd);
+		bone_names.push_back(bone->mName.data);
+
+		for(unsigned int w=0; w < bone->mNumWeights; ++w) {
+			const aiVertexWeight &vw = bone->mWeights[w];
+			if(vw.mVertexId >= mesh->mNumVertices)
+				continue;
+			uint8_t * bones = &vertex_bones[SKIN_BONES_PER_VERTEX*vw.mVertexId];
+			float * weights = &vertex_weights[SKIN_BONES_PER_VERTEX*vw.mVertexId];
+
+			//Replace the smallest weight if this one is larger
+			int smallest = 0;
+			for(int i=1; i < SKIN_BONES_PER_VERTEX; ++i) {
+				if(weights[i] < weights[smallest])
+					smallest = i;
+			}
+			if(vw.mWeight > weights[smallest]) {
+				bones[smallest] = b;
+				weights[smallest] = vw.mWeight;
+			}
+		}
+	}
+
+	for(unsigned int v=0; v < mesh->mNumVertices; ++v) {
+		float * weights = &vertex_weights[SKIN_BONES_PER_VERTEX*v];
+		float sum = 0.f;
+		for(int i=0; i < SKIN_BONES_PER_VERTEX; ++i)
+			sum += weights[i];
+		if(sum > 0.f) {
+			for(int i=0; i < SKIN_BONES_PER_VERTEX; ++i)
+				weights[i] /= sum;
+		} else {
+			//Not attached to any bone, keep it with the first one
+			weights[0] = 1.f;
+		}
+	}
+}
+
+void Model::import_node(const aiNode * node, int parent, CookedModel &cooked) {
+	int index = cooked.nodes.size();
+	cooked.nodes.push_back(RenderObject::node_t());
+	RenderObject::node_t &nd = cooked.nodes.back();
+
+	nd.parent = parent;
+
+	aiMatrix4x4 m = node->mTransformation; 	
+	aiTransposeMatrix4(&m);
+	nd.transformation = glm::make_mat4((float*)&m);
+
+	nd.first_mesh = cooked.node_meshes.size();
+	nd.num_meshes = node->mNumMeshes;
+	for(unsigned int i=0; i<node->mNumMeshes; ++i) {
+		cooked.node_meshes.push_back(node->mMeshes[i]);
+	}
+
+	cooked.node_names.push_back(node->mName.data);
+
+	//nd is invalidated when children are added
+	for(unsigned int i=0; i<node->mNumChildren; ++i) {
+		import_node(node->mChildren[i], index, cooked);
+	}
+}
+
+/*
+ * Resolves the channel names of each animation to node indices,
+ * so no names have to be compared while animating.
+ */
+void Model::import_node_channels(const aiScene * scene, CookedModel &cooked) {
+	for(unsigned int i=0; i < cooked.animations.size(); ++i) {
+		aiAnimation * anim = scene->mAnimations[i];
+		std::vector<int> &node_channels = cooked.animations[i].node_channels;
+		node_channels.resize(cooked.nodes.size(), -1);
+		for(unsigned int n=0; n < cooked.nodes.size(); ++n) {
+			for(unsigned int c=0; c<anim->mNumChannels; ++c) {
+				if(cooked.node_names[n] == anim->mChannels[c]->mNodeName.data) {
+					node_channels[n] = c;
+					break;
+				}
+			}
+		}
+	}
+}
+
+void Model::get_bounding_box_for_node (const aiScene * scene, const struct aiNode* nd, 
+	struct aiVector3D* min, 
+	struct aiVector3D* max, 
+	struct aiMatrix4x4* trafo){
+
+	struct aiMatrix4x4 prev;
+	unsigned int n = 0, t;
+	prev = *trafo;
+	aiMultiplyMatrix4(trafo,&nd->mTransformation);
+
+	for (; n < nd->mNumMeshes; ++n) {
+		const struct aiMesh* mesh = scene->mMeshes[nd->mMeshes[n]];
+		for (t = 0; t < mesh->mNumVertices; ++t) {
+			struct aiVector3D tmp = mesh->mVertices[t];
+			aiTransformVecByMatrix4(&tmp,trafo);
+
+			min->x = aisgl_min(min->x,tmp.x);
+			min->y = aisgl_min(min->y,tmp.y);
+			min->z = aisgl_min(min->z,tmp.z);
+
+			max->x = aisgl_max(max->x,tmp.x);
+			max->y = aisgl_max(max->y,tmp.y);
+			max->z = aisgl_max(max->z,tmp.z);
+		}
+	}
+
+	for (n = 0; n < nd->mNumChildren; ++n) {
+		get_bounding_box_for_node(scene,nd->mChildren[n],min,max,trafo);
+	}
+	*trafo = prev;
+}
+
+void Model::get_bounding_box (const aiScene * scene, struct aiVector3D* min, struct aiVector3D* max) {
+	struct aiMatrix4x4 trafo;
+	aiIdentityMatrix4(&trafo);
+
+	min->x = min->y = min->z =  1e10f;
+	max->x = max->y = max->z = -1e10f;
+	get_bounding_box_for_node(scene,scene->mRootNode,min,max,&trafo);
+}
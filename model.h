@@ -0,0 +1,105 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <assimp/assimp.h>
+#include <assimp/aiScene.h>
+#include <glm/glm.hpp>
+
+#include "render_object.h"
+#include "texture.h"
+
+class CookedModel;
+class ModelLoader;
+
+/*
+ * The gpu resources and static data of a model file.
+ *
+ * Models are shared between all RenderObjects created from the same file with the same import options,
+ * per instance state (animation, material overrides) lives in RenderObject.
+ */
+class Model {
+public:
+	/*
+	 * Returns the model for the file and import options, loading it if it isn't loaded yet.
+	 * If loader is given and the model is not loaded it is loaded in the background.
+	 * Every acquire must be matched by a release.
+	 */
+	static Model * acquire(const std::string &file, unsigned int aiOptions, ModelLoader * loader=NULL);
+	static void release(Model * model);
+
+	//Reads the cooked model, or imports and cooks it. Does not touch gl, safe to call from any thread
+	static bool load_cooked(const std::string &file, unsigned int import_flags, CookedModel &cooked);
+
+	const std::string &name() const { return name_; };
+	bool ready() const { return ready_; };
+	//True if the file could not be loaded, the model then stays empty and never becomes ready
+	bool failed() const { return failed_; };
+
+	glm::vec3 scene_min, scene_max;
+
+	std::vector<RenderObject::mesh_data_t> meshes;
+	std::vector<RenderObject::material_t> materials; //Copied to each RenderObject
+	std::vector<RenderObject::node_t> nodes; //Depth first, nodes[0] is the root
+	std::vector<std::string> node_names;
+	std::vector<unsigned int> node_meshes; //Indices in meshes, referenced by node_t::first_mesh
+	std::vector<RenderObject::bone_t> bones; //Referenced by mesh_data_t::first_bone
+	std::vector<RenderObject::transform_t> rest_pose; //node_t::transformation of each node split up for blending
+	std::vector<RenderObject::animation_t> animations;
+
+	//Cpu memory used by the node tree and animations, the uncompressed size is what assimp used for the keys
+	size_t node_bytes() const;
+	size_t animation_bytes() const;
+	size_t source_animation_bytes() const { return source_animation_bytes_; };
+	void print_memory() const;
+	static void print_memory_all();
+
+private:
+	Model(const std::string &file, const std::string &key, unsigned int import_flags, ModelLoader * loader);
+	~Model();
+	//Copy not allowed (no body implemented, intentional!)
+	Model(const Model &other);
+
+	static std::map<std::string, Model*> loaded_models_;
+
+	std::string name_;
+	std::string key_;
+	unsigned int ref_count_;
+	size_t source_animation_bytes_;
+
+	bool ready_;
+	bool failed_;
+	ModelLoader * loader_; //Set while loading asynchronously
+	friend class ModelLoader;
+
+	//Uploads all meshes and loads all textures of cooked
+	void pre_render(CookedModel &cooked);
+	//Takes the node tree, animations and bounds from cooked
+	void init(CookedModel &cooked);
+	//Creates the buffers for one mesh, returns the number of bytes uploaded
+	size_t upload_mesh(const CookedModel &cooked, unsigned int mesh);
+	//Unpacks the bind pose of a skinned mesh for CPU_SKINNING
+	static Skinning::source_t * create_skin(const CookedModel &cooked, unsigned int mesh);
+	//Loads the textures of one material, returns the number of bytes uploaded
+	size_t upload_material(const CookedModel &cooked, unsigned int material);
+
+	//Trims path and loads texture
+	static Texture * load_texture(std::string path);
+
+	//Imports the model with assimp into cooked, returns false if the import failed
+	static bool import(const std::string &file, unsigned int import_flags, CookedModel &cooked);
+	static void import_bones(const aiMesh * mesh, std::vector<uint8_t> &vertex_bones, std::vector<float> &vertex_weights,
+		CookedModel &cooked, std::vector<std::string> &bone_names);
+	static void import_node(const aiNode * node, int parent, CookedModel &cooked);
+	static void import_node_channels(const aiScene * scene, CookedModel &cooked);
+	static void import_materials(const aiScene * scene, CookedModel &cooked);
+	static void import_animations(const aiScene * scene, CookedModel &cooked);
+
+	static void get_bounding_box_for_node (const aiScene * scene, const struct aiNode* nd,	struct aiVector3D* min, struct aiVector3D* max, struct aiMatrix4x4* trafo);
+	static void get_bounding_box (const aiScene * scene, struct aiVector3D* min, struct aiVector3D* max);
+	static void color4_to_vec4(const struct aiColor4D *c, glm::vec4 &target);
+};
+
+#endif
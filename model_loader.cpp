@@ -0,0 +1,177 @@
+#include "model_loader.h"
+#include "model.h"
+#include "cooked_model.h"
+
+#include <string>
+#include <cstdio>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+
+ModelLoader::ModelLoader(unsigned int num_threads) : stop_(false) {
+	if(num_threads == 0) {
+		unsigned int cores = std::thread::hardware_concurrency();
+		num_threads = (cores > 1) ? cores - 1 : 1;
+	}
+
+	for(unsigned int i=0; i < num_threads; ++i) {
+		threads_.push_back(std::thread(&ModelLoader::worker, this));
+	}
+}
+
+ModelLoader::~ModelLoader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	work_available_.notify_all();
+
+	for(std::vector<std::thread>::iterator it=threads_.begin(); it!=threads_.end(); ++it) {
+		it->join();
+	}
+
+	for(std::deque<job_t*>::iterator it=queued_.begin(); it!=queued_.end(); ++it) {
+		delete *it;
+	}
+	for(std::list<job_t*>::iterator it=loaded_.begin(); it!=loaded_.end(); ++it) {
+		delete (*it)->cooked;
+		delete *it;
+	}
+}
+
+void ModelLoader::load(Model * model, const std::string &file, unsigned int import_flags) {
+	job_t * job = new job_t();
+	job->model = model;
+	job->file = file;
+	job->import_flags = import_flags;
+	job->cooked = NULL;
+	job->success = false;
+	job->started_upload = false;
+	job->next_mesh = 0;
+	job->next_material = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queued_.push_back(job);
+	}
+	work_available_.notify_one();
+}
+
+void ModelLoader::cancel(Model * model) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for(std::deque<job_t*>::iterator it=queued_.begin(); it!=queued_.end(); ++it) {
+		if((*it)->model == model) {
+			delete *it;
+			queued_.erase(it);
+			return;
+		}
+	}
+
+	//A worker is busy with it, the job is thrown away when the worker is done
+	for(std::list<job_t*>::iterator it=in_progress_.begin(); it!=in_progress_.end(); ++it) {
+		if((*it)->model == model) {
+			(*it)->model = NULL;
+			return;
+		}
+	}
+
+	for(std::list<job_t*>::iterator it=loaded_.begin(); it!=loaded_.end(); ++it) {
+		if((*it)->model == model) {
+			delete (*it)->cooked;
+			delete *it;
+			loaded_.erase(it);
+			return;
+		}
+	}
+}
+
+unsigned int ModelLoader::pending() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return queued_.size() + in_progress_.size() + loaded_.size();
+}
+
+void ModelLoader::worker() {
+	while(true) {
+		job_t * job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while(!stop_ && queued_.empty()) {
+				work_available_.wait(lock);
+			}
+			if(stop_)
+				return;
+			job = queued_.front();
+			queued_.pop_front();
+			in_progress_.push_back(job);
+		}
+
+		//Only the job is touched here, never the Model
+		job->cooked = new CookedModel();
+		job->success = Model::load_cooked(job->file, job->import_flags, *job->cooked);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			in_progress_.remove(job);
+			if(job->model == NULL) {
+				delete job->cooked;
+				delete job;
+			} else {
+				loaded_.push_back(job);
+			}
+		}
+	}
+}
+
+void ModelLoader::upload(size_t max_bytes) {
+	size_t uploaded = 0;
+	do {
+		job_t * job;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if(loaded_.empty())
+				return;
+			job = loaded_.front();
+		}
+
+		uploaded += upload_step(job);
+	} while(uploaded < max_bytes);
+}
+
+size_t ModelLoader::upload_step(job_t * job) {
+	Model * model = job->model;
+	CookedModel * cooked = job->cooked;
+
+	if(!job->success) {
+		printf("Failed to load model %s\n", job->file.c_str());
+		model->failed_ = true;
+		finish(job);
+		return 0;
+	}
+
+	if(!job->started_upload) {
+		model->init(*cooked);
+		job->started_upload = true;
+		return 0;
+	}
+
+	if(job->next_mesh < cooked->meshes.size())
+		return model->upload_mesh(*cooked, job->next_mesh++);
+
+	if(job->next_material < cooked->materials.size())
+		return model->upload_material(*cooked, job->next_material++);
+
+	model->ready_ = true;
+	finish(job);
+	return 0;
+}
+
+void ModelLoader::finish(job_t * job) {
+	job->model->loader_ = NULL;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		loaded_.remove(job);
+	}
+	delete job->cooked;
+	delete job;
+}
@@ -0,0 +1,77 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <string>
+#include <deque>
+#include <list>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class Model;
+class CookedModel;
+
+/*
+ * Loads Models in the background.
+ *
+ * The import (or cache read) runs on a pool of worker threads, the resulting
+ * buffers and textures are created on the GL thread in upload(), a bit each frame.
+ * Objects render as nothing until they are ready.
+ */
+class ModelLoader {
+public:
+	//num_threads=0 uses one thread less than the number of cores (at least one)
+	ModelLoader(unsigned int num_threads=0);
+	~ModelLoader();
+
+	/*
+	 * Queues an model for loading. Called by Model when created with a loader,
+	 * the model must not be rendered or modified until it is ready()
+	 */
+	void load(Model * model, const std::string &file, unsigned int import_flags);
+
+	//Forgets about model (called when a Model is deleted before it is ready)
+	void cancel(Model * model);
+
+	/*
+	 * Creates gl buffers and textures for loaded models.
+	 * Stops when about max_bytes has been uploaded this call, but always does at least one step.
+	 * Must be called from the GL thread.
+	 */
+	void upload(size_t max_bytes);
+
+	//Number of objects not yet ready
+	unsigned int pending();
+
+private:
+	//Copy not allowed (no body implemented, intentional!)
+	ModelLoader(const ModelLoader &other);
+
+	struct job_t {
+		Model * model; //NULL if the model was deleted
+		std::string file;
+		unsigned int import_flags;
+		CookedModel * cooked;
+		bool success;
+		bool started_upload;
+		unsigned int next_mesh, next_material;
+	};
+
+	void worker();
+
+	//Uploads the next part of job, returns the number of bytes uploaded
+	size_t upload_step(job_t * job);
+	void finish(job_t * job);
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable work_available_;
+	bool stop_;
+
+	std::deque<job_t*> queued_;
+	std::list<job_t*> in_progress_;
+	std::list<job_t*> loaded_; //Waiting for upload, only touched by the GL thread after loading
+};
+
+#endif
@@ -67,6 +67,11 @@ void MovableObject::set_rotation(const glm::vec3 &axis, const float angle) {
 	orientation_ = glm::rotate(glm::fquat(1.f, 0.f, 0.f, 0.f), angle, axis);
 }
 
+void MovableObject::set_orientation(const glm::fquat &orientation) {
+	rotation_matrix_dirty_ = true;
+	orientation_ = orientation;
+}
+
 glm::vec3 MovableObject::orient_vector(const glm::vec3 &vec) const {
 	return glm::vec3(rotation_matrix()*glm::vec4(vec, 1.f));
 }
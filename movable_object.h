@@ -21,6 +21,7 @@
 		virtual ~MovableObject();
 
 		virtual const glm::vec3 &position() const { return position_; };
+		virtual const glm::fquat &orientation() const { return orientation_; };
 		virtual const glm::mat4 matrix() const;
 
 		virtual void relative_move(const glm::vec3 &move);
@@ -31,6 +32,7 @@
 
 		virtual void set_position(const glm::vec3 &pos);
 		virtual void set_rotation(const glm::vec3 &axis, const float angle);
+		virtual void set_orientation(const glm::fquat &orientation);
 
 	};
 #endif
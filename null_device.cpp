@@ -0,0 +1,213 @@
+#include "null_device.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+//Newer than the 3.3 headers
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+NullDevice::stats_t::stats_t() {
+	memset(this, 0, sizeof(stats_t));
+}
+
+NullDevice::NullDevice() : next_name_(1) { }
+
+bool NullDevice::has_extension(const char * name) const {
+	static const char * extensions[] = {
+		"GL_ARB_base_instance",
+		"GL_ARB_buffer_storage",
+		"GL_ARB_multi_draw_indirect",
+		NULL
+	};
+	for(const char ** ext = extensions; *ext != NULL; ++ext) {
+		if(strcmp(*ext, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+void NullDevice::print_stats(unsigned int frames) const {
+	if(frames == 0)
+		return;
+	printf("Null device: %.1f commands/frame, %.1f draws/frame (%.1f with multi draw commands), %.0f indices/frame, %.1f instances/frame\n",
+		stats.commands/(double)frames,
+		stats.draws/(double)frames,
+		stats.draw_commands/(double)frames,
+		stats.indices/(double)frames,
+		stats.instances/(double)frames);
+	printf("Null device: %.1f binds/frame, %.1f state changes/frame, %.1f syncs/frame\n",
+		stats.binds/(double)frames,
+		stats.state_changes/(double)frames,
+		stats.syncs/(double)frames);
+	printf("Null device: %.1f buffer uploads/frame (%.1f kB/frame), %.1f kB copied/frame, %.1f maps/frame (%.1f kB/frame), %.1f texture uploads/frame (%.1f kB/frame)\n",
+		stats.buffer_uploads/(double)frames,
+		stats.buffer_bytes/(1024.0*frames),
+		stats.copy_bytes/(1024.0*frames),
+		stats.maps/(double)frames,
+		stats.mapped_bytes/(1024.0*frames),
+		stats.texture_uploads/(double)frames,
+		stats.texture_bytes/(1024.0*frames));
+}
+
+void NullDevice::gen_names(GLsizei n, GLuint * names) {
+	++stats.commands;
+	for(GLsizei i=0; i < n; ++i) {
+		names[i] = next_name_++;
+	}
+}
+
+void NullDevice::delete_buffers(GLsizei n, const GLuint * buffers) {
+	++stats.commands;
+	for(GLsizei i=0; i < n; ++i) {
+		buffer_sizes_.erase(buffers[i]);
+		buffer_memory_.erase(buffers[i]);
+	}
+}
+
+void NullDevice::bind_buffer(GLenum target, GLuint buffer) {
+	bind();
+	bound_buffers_[target] = buffer;
+}
+
+void NullDevice::bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+	bind();
+	//Also binds the generic binding point, like GL
+	bound_buffers_[target] = buffer;
+}
+
+void NullDevice::buffer_data(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage) {
+	++stats.commands;
+	set_buffer_size(bound_buffers_[target], size);
+	if(data != NULL) {
+		++stats.buffer_uploads;
+		stats.buffer_bytes += size;
+	}
+}
+
+void NullDevice::buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid * data) {
+	++stats.commands;
+	++stats.buffer_uploads;
+	stats.buffer_bytes += size;
+}
+
+void NullDevice::copy_buffer_sub_data(GLenum read_target, GLenum write_target, GLintptr read_offset, GLintptr write_offset, GLsizeiptr size) {
+	++stats.commands;
+	stats.copy_bytes += size;
+}
+
+void * NullDevice::map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+	++stats.commands;
+	++stats.maps;
+	stats.mapped_bytes += length;
+
+	//Allocated for the whole buffer the first time, so persistent mappings stay valid
+	GLuint buffer = bound_buffers_[target];
+	std::vector<char> &memory = buffer_memory_[buffer];
+	size_t size = std::max((size_t)(offset + length), buffer_sizes_[buffer]);
+	if(memory.size() < size)
+		memory.resize(size);
+	return &memory[offset];
+}
+
+bool NullDevice::buffer_storage(GLenum target, GLsizeiptr size, const GLvoid * data, GLbitfield flags) {
+	buffer_data(target, size, data, 0);
+	return true;
+}
+
+void NullDevice::multi_draw_elements_indirect(GLenum mode, GLenum type, const GLvoid * indirect, GLsizei draw_count, GLsizei stride) {
+	++stats.commands;
+	++stats.draws;
+
+	//The commands are in the bound indirect buffer, written through a mapping
+	const size_t command_size = 5*sizeof(GLuint); //count, instance count, first index, base vertex, base instance
+	if(stride == 0)
+		stride = command_size;
+	GLuint buffer = bound_buffers_[GL_DRAW_INDIRECT_BUFFER];
+	const std::vector<char> &memory = buffer_memory_[buffer];
+	size_t offset = (size_t) indirect;
+	for(GLsizei i=0; i < draw_count; ++i, offset += stride) {
+		++stats.draw_commands;
+		if(offset + command_size > memory.size())
+			continue; //Not written through a mapping, only the command is counted
+		const GLuint * command = (const GLuint*) &memory[offset];
+		stats.indices += (unsigned long long) command[0]*command[1];
+		stats.instances += command[1];
+	}
+}
+
+GLsync NullDevice::fence_sync(GLenum condition, GLbitfield flags) {
+	++stats.commands;
+	++stats.syncs;
+	//Never dereferenced, only needs to be non-null
+	static char dummy;
+	return (GLsync) &dummy;
+}
+
+void NullDevice::get_integer_v(GLenum pname, GLint * params) {
+	++stats.commands;
+	*params = (pname == GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT) ? NULL_DEVICE_UBO_ALIGNMENT : 0;
+}
+
+const GLubyte * NullDevice::get_string(GLenum name) {
+	++stats.commands;
+	return (const GLubyte*) "null device";
+}
+
+void NullDevice::set_buffer_size(GLuint buffer, GLsizeiptr size) {
+	buffer_sizes_[buffer] = size;
+	//Respecified, like GL any old mapping is gone
+	std::map<GLuint, std::vector<char> >::iterator memory = buffer_memory_.find(buffer);
+	if(memory != buffer_memory_.end())
+		memory->second.resize(size);
+}
+
+void NullDevice::draw(GLsizei count, GLsizei instances) {
+	++stats.commands;
+	++stats.draws;
+	++stats.draw_commands;
+	stats.indices += (unsigned long long) count*instances;
+	stats.instances += instances;
+}
+
+static unsigned int pixel_size(GLenum format, GLenum type) {
+	switch(type) {
+		case GL_UNSIGNED_INT_8_8_8_8:
+		case GL_UNSIGNED_INT_8_8_8_8_REV:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+			return 4;
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_5_5_5_1:
+			return 2;
+	}
+
+	unsigned int component_size = 1;
+	if(type == GL_FLOAT || type == GL_INT || type == GL_UNSIGNED_INT)
+		component_size = 4;
+	else if(type == GL_HALF_FLOAT || type == GL_SHORT || type == GL_UNSIGNED_SHORT)
+		component_size = 2;
+
+	switch(format) {
+		case GL_RED:
+		case GL_DEPTH_COMPONENT:
+			return component_size;
+		case GL_RG:
+			return 2*component_size;
+		case GL_RGB:
+		case GL_BGR:
+			return 3*component_size;
+		default:
+			return 4*component_size;
+	}
+}
+
+void NullDevice::texture_upload(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid * pixels) {
+	++stats.commands;
+	if(pixels == NULL)
+		return; //Only allocates
+	++stats.texture_uploads;
+	stats.texture_bytes += (unsigned long long) width*height*depth*pixel_size(format, type);
+}
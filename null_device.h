@@ -0,0 +1,158 @@
+#ifndef NULL_DEVICE_H
+#define NULL_DEVICE_H
+
+#include "render_device.h"
+
+#include <map>
+
+//GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT reported by the null device, the largest common value
+#define NULL_DEVICE_UBO_ALIGNMENT 256
+
+/*
+ * RenderDevice that never touches GL (see render_device.h). Names are handed out from a
+ * counter, mapped buffers get host memory and everything else only adds to the counters
+ * below. Reports the extensions of the fastest paths (multi draw indirect, persistent
+ * buffers) so those are what gets measured.
+ */
+class NullDevice : public RenderDevice {
+public:
+	struct stats_t {
+		stats_t();
+
+		unsigned long long commands; //Every call
+		unsigned long long draws; //Draw calls, a multi draw counts once
+		unsigned long long draw_commands; //Draws including each command of a multi draw
+		unsigned long long indices;
+		unsigned long long instances;
+		unsigned long long binds; //Programs, buffers, vertex arrays and textures
+		unsigned long long state_changes; //Fixed function state and uniforms
+		unsigned long long buffer_uploads;
+		unsigned long long buffer_bytes; //buffer_data/buffer_sub_data/buffer_storage with data
+		unsigned long long copy_bytes; //copy_buffer_sub_data
+		unsigned long long maps;
+		unsigned long long mapped_bytes;
+		unsigned long long texture_uploads;
+		unsigned long long texture_bytes;
+		unsigned long long syncs; //fence_sync and client_wait_sync
+	};
+
+	NullDevice();
+
+	const char * name() const { return "null"; };
+	bool has_gpu() const { return false; };
+	bool has_extension(const char * name) const;
+
+	void print_stats(unsigned int frames) const;
+	void reset_stats() { stats = stats_t(); };
+
+	void gen_buffers(GLsizei n, GLuint * buffers) { gen_names(n, buffers); };
+	void delete_buffers(GLsizei n, const GLuint * buffers);
+	void bind_buffer(GLenum target, GLuint buffer);
+	void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	void buffer_data(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage);
+	void buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid * data);
+	void copy_buffer_sub_data(GLenum read_target, GLenum write_target, GLintptr read_offset, GLintptr write_offset, GLsizeiptr size);
+	void * map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+	GLboolean unmap_buffer(GLenum target) { ++stats.commands; return GL_TRUE; };
+	bool buffer_storage(GLenum target, GLsizeiptr size, const GLvoid * data, GLbitfield flags);
+
+	void gen_vertex_arrays(GLsizei n, GLuint * arrays) { gen_names(n, arrays); };
+	void delete_vertex_arrays(GLsizei n, const GLuint * arrays) { ++stats.commands; };
+	void bind_vertex_array(GLuint array) { bind(); };
+	void enable_vertex_attrib_array(GLuint index) { ++stats.commands; };
+	void disable_vertex_attrib_array(GLuint index) { ++stats.commands; };
+	void vertex_attrib_pointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid * pointer) { ++stats.commands; };
+	void vertex_attrib_i_pointer(GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid * pointer) { ++stats.commands; };
+	void vertex_attrib_divisor(GLuint index, GLuint divisor) { ++stats.commands; };
+	void vertex_attrib_3fv(GLuint index, const GLfloat * v) { state_change(); };
+	void vertex_attrib_4f(GLuint index, GLfloat x, GLfloat y, GLfloat z, GLfloat w) { state_change(); };
+	void vertex_attrib_4fv(GLuint index, const GLfloat * v) { state_change(); };
+
+	void gen_textures(GLsizei n, GLuint * textures) { gen_names(n, textures); };
+	void delete_textures(GLsizei n, const GLuint * textures) { ++stats.commands; };
+	void active_texture(GLenum texture) { state_change(); };
+	void bind_texture(GLenum target, GLuint texture) { bind(); };
+	void tex_parameter_i(GLenum target, GLenum pname, GLint param) { ++stats.commands; };
+	void pixel_store_i(GLenum pname, GLint param) { ++stats.commands; };
+	void tex_image_2d(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid * pixels) {
+		texture_upload(width, height, 1, format, type, pixels);
+	};
+	void tex_image_3d(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid * pixels) {
+		texture_upload(width, height, depth, format, type, pixels);
+	};
+	void tex_sub_image_3d(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid * pixels) {
+		texture_upload(width, height, depth, format, type, pixels);
+	};
+	void sampler_parameter_i(GLuint sampler, GLenum pname, GLint param) { ++stats.commands; };
+	void sampler_parameter_f(GLuint sampler, GLenum pname, GLfloat param) { ++stats.commands; };
+
+	GLuint compile_shader(GLenum type, const std::string &source) { ++stats.commands; return next_name_++; };
+	GLuint link_program(const std::vector<GLuint> &shaders) { ++stats.commands; return next_name_++; };
+	void delete_shader(GLuint shader) { ++stats.commands; };
+	void use_program(GLuint program) { bind(); };
+	GLint get_uniform_location(GLuint program, const GLchar * name) { ++stats.commands; return 0; };
+	GLuint get_uniform_block_index(GLuint program, const GLchar * name) { ++stats.commands; return 0; };
+	void uniform_block_binding(GLuint program, GLuint block_index, GLuint binding) { ++stats.commands; };
+	void uniform_1i(GLint location, GLint v) { state_change(); };
+	void uniform_1f(GLint location, GLfloat v) { state_change(); };
+	void uniform_2fv(GLint location, GLsizei count, const GLfloat * v) { state_change(); };
+
+	void enable(GLenum capability) { state_change(); };
+	void disable(GLenum capability) { state_change(); };
+	void depth_mask(GLboolean flag) { state_change(); };
+	void depth_func(GLenum func) { state_change(); };
+	void depth_range(GLclampd near_value, GLclampd far_value) { state_change(); };
+	void blend_func(GLenum src, GLenum dst) { state_change(); };
+	void cull_face(GLenum mode) { state_change(); };
+	void front_face(GLenum mode) { state_change(); };
+	void line_width(GLfloat width) { state_change(); };
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height) { state_change(); };
+	void clear_color(GLclampf r, GLclampf g, GLclampf b, GLclampf a) { state_change(); };
+	void clear(GLbitfield mask) { ++stats.commands; };
+
+	void draw_arrays(GLenum mode, GLint first, GLsizei count) { draw(count, 1); };
+	void draw_elements(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices) { draw(count, 1); };
+	void draw_elements_base_vertex(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices, GLint base_vertex) { draw(count, 1); };
+	void draw_elements_instanced_base_vertex(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices, GLsizei instances, GLint base_vertex) {
+		draw(count, instances);
+	};
+	void multi_draw_elements_indirect(GLenum mode, GLenum type, const GLvoid * indirect, GLsizei draw_count, GLsizei stride);
+
+	GLsync fence_sync(GLenum condition, GLbitfield flags);
+	GLenum client_wait_sync(GLsync sync, GLbitfield flags, GLuint64 timeout) { ++stats.commands; ++stats.syncs; return GL_ALREADY_SIGNALED; };
+	void delete_sync(GLsync sync) { ++stats.commands; };
+	void finish() { ++stats.commands; };
+
+	void gen_queries(GLsizei n, GLuint * queries) { gen_names(n, queries); };
+	void delete_queries(GLsizei n, const GLuint * queries) { ++stats.commands; };
+	void query_counter(GLuint query, GLenum target) { ++stats.commands; };
+	void get_query_object_iv(GLuint query, GLenum pname, GLint * params) { ++stats.commands; *params = 1; };
+	void get_query_object_ui64v(GLuint query, GLenum pname, GLuint64 * params) { ++stats.commands; *params = 0; };
+
+	void get_integer_v(GLenum pname, GLint * params);
+	void get_integer64_v(GLenum pname, GLint64 * params) { ++stats.commands; *params = 0; };
+	const GLubyte * get_string(GLenum name);
+	GLenum get_error() { ++stats.commands; return GL_NO_ERROR; };
+	bool debug_message_callback(debug_proc_t callback, const GLvoid * user_param) { return false; };
+	void object_label(GLenum identifier, GLuint name, GLsizei length, const GLchar * label) { };
+
+	stats_t stats;
+
+private:
+	//Copy not allowed (no body implemented, intentional!)
+	NullDevice(const NullDevice &other);
+
+	void gen_names(GLsizei n, GLuint * names);
+	void set_buffer_size(GLuint buffer, GLsizeiptr size);
+	void bind() { ++stats.commands; ++stats.binds; };
+	void state_change() { ++stats.commands; ++stats.state_changes; };
+	void draw(GLsizei count, GLsizei instances);
+	void texture_upload(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid * pixels);
+
+	GLuint next_name_;
+	std::map<GLenum, GLuint> bound_buffers_; //Target -> buffer
+	std::map<GLuint, size_t> buffer_sizes_;
+	std::map<GLuint, std::vector<char> > buffer_memory_; //Backs mapped ranges, allocated on the first map
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include "packed_vertex.h"
+#include "render_device.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+unsigned int PackedVertex::choose_format(size_t num_vertices, float max_abs_uv) {
+	unsigned int format = 0;
+	if(max_abs_uv <= PACKED_HALF_UV_RANGE)
+		format |= HALF_UV;
+	if(num_vertices < 65536)
+		format |= SHORT_INDICES;
+	return format;
+}
+
+size_t PackedVertex::vertex_size(unsigned int format) {
+	size_t uv_size = (format & HALF_UV) ? 2*sizeof(uint16_t) : 2*sizeof(float);
+	size_t bone_size = (format & SKINNED) ? 2*sizeof(uint32_t) : 0;
+	return 3*sizeof(float) + uv_size + 2*sizeof(uint32_t) + bone_size;
+}
+
+//Byte offset of the normal, the tangent and bones follow
+static size_t normal_offset(unsigned int format) {
+	size_t uv_size = (format & PackedVertex::HALF_UV) ? 2*sizeof(uint16_t) : 2*sizeof(float);
+	return 3*sizeof(float) + uv_size;
+}
+
+size_t PackedVertex::index_size(unsigned int format) {
+	return (format & SHORT_INDICES) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+GLenum PackedVertex::index_type(unsigned int format) {
+	return (format & SHORT_INDICES) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+void PackedVertex::pack(unsigned int format, void * dst, const glm::vec3 &pos, const glm::vec2 &uv,
+		const glm::vec3 &normal, const glm::vec3 &tangent, const glm::vec3 &bitangent) {
+	char * p = (char*)dst;
+
+	memcpy(p, &pos, 3*sizeof(float));
+	p += 3*sizeof(float);
+
+	if(format & HALF_UV) {
+		uint16_t half_uv[2] = { float_to_half(uv.x), float_to_half(uv.y) };
+		memcpy(p, half_uv, sizeof(half_uv));
+		p += sizeof(half_uv);
+	} else {
+		memcpy(p, &uv, 2*sizeof(float));
+		p += 2*sizeof(float);
+	}
+
+	//Handedness of the tangent space, the shader multiplies cross(normal, tangent) with this
+	float sign = (glm::dot(glm::cross(normal, tangent), bitangent) < 0.f) ? -1.f : 1.f;
+
+	uint32_t n = pack_snorm_10_10_10_2(normal, 0.f);
+	uint32_t t = pack_snorm_10_10_10_2(tangent, sign);
+	memcpy(p, &n, sizeof(uint32_t));
+	memcpy(p + sizeof(uint32_t), &t, sizeof(uint32_t));
+}
+
+void PackedVertex::pack_bones(unsigned int format, void * dst, const uint8_t * bones, const float * weights) {
+	char * p = (char*)dst + normal_offset(format) + 2*sizeof(uint32_t);
+
+	//Round the weights so they still sum to 255, the rounding error goes to the largest weight
+	uint8_t w[4];
+	int sum = 0, largest = 0;
+	for(int i=0; i < 4; ++i) {
+		w[i] = (uint8_t)floor(glm::clamp(weights[i], 0.f, 1.f) * 255.f + 0.5f);
+		sum += w[i];
+		if(weights[i] > weights[largest])
+			largest = i;
+	}
+	w[largest] = (uint8_t)glm::clamp((int)w[largest] + 255 - sum, 0, 255);
+
+	memcpy(p, bones, 4);
+	memcpy(p + 4, w, 4);
+}
+
+void PackedVertex::unpack(unsigned int format, const void * src, glm::vec3 &pos, glm::vec2 &uv,
+		glm::vec3 &normal, glm::vec4 &tangent, uint8_t * bones, float * weights) {
+	const char * p = (const char*)src;
+
+	memcpy(&pos, p, 3*sizeof(float));
+	p += 3*sizeof(float);
+
+	if(format & HALF_UV) {
+		uint16_t half_uv[2];
+		memcpy(half_uv, p, sizeof(half_uv));
+		uv = glm::vec2(half_to_float(half_uv[0]), half_to_float(half_uv[1]));
+		p += sizeof(half_uv);
+	} else {
+		memcpy(&uv, p, 2*sizeof(float));
+		p += 2*sizeof(float);
+	}
+
+	uint32_t n, t;
+	memcpy(&n, p, sizeof(uint32_t));
+	memcpy(&t, p + sizeof(uint32_t), sizeof(uint32_t));
+	normal = glm::vec3(unpack_snorm_10_10_10_2(n));
+	tangent = unpack_snorm_10_10_10_2(t);
+	p += 2*sizeof(uint32_t);
+
+	if(format & SKINNED) {
+		memcpy(bones, p, 4);
+		for(int i=0; i < 4; ++i)
+			weights[i] = (uint8_t)p[4 + i] / 255.f;
+	}
+}
+
+void PackedVertex::pack_indices(unsigned int format, void * dst, const unsigned int * indices, size_t count) {
+	if(format & SHORT_INDICES) {
+		uint16_t * p = (uint16_t*)dst;
+		for(size_t i=0; i < count; ++i)
+			p[i] = indices[i];
+	} else {
+		memcpy(dst, indices, count*sizeof(uint32_t));
+	}
+}
+
+void PackedVertex::set_attrib_pointers(unsigned int format) {
+	GLsizei stride = vertex_size(format);
+	size_t n_offset = normal_offset(format);
+
+	render_device()->enable_vertex_attrib_array(0);
+	render_device()->enable_vertex_attrib_array(1);
+	render_device()->enable_vertex_attrib_array(2);
+	render_device()->enable_vertex_attrib_array(3);
+
+	render_device()->vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+	if(format & HALF_UV)
+		render_device()->vertex_attrib_pointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, (const GLvoid*) (3*sizeof(float)));
+	else
+		render_device()->vertex_attrib_pointer(1, 2, GL_FLOAT, GL_FALSE, stride, (const GLvoid*) (3*sizeof(float)));
+	render_device()->vertex_attrib_pointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (const GLvoid*) (n_offset));
+	render_device()->vertex_attrib_pointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (const GLvoid*) (n_offset + sizeof(uint32_t)));
+
+	if(format & SKINNED) {
+		render_device()->enable_vertex_attrib_array(4);
+		render_device()->enable_vertex_attrib_array(5);
+		render_device()->vertex_attrib_i_pointer(4, 4, GL_UNSIGNED_BYTE, stride, (const GLvoid*) (n_offset + 2*sizeof(uint32_t)));
+		render_device()->vertex_attrib_pointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (const GLvoid*) (n_offset + 3*sizeof(uint32_t)));
+	}
+}
+
+uint16_t PackedVertex::float_to_half(float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(float));
+
+	uint16_t sign = (bits >> 16) & 0x8000;
+	int exponent = ((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if(exponent >= 31) {
+		//Too large (or inf/nan), clamp to inf
+		return sign | 0x7c00;
+	} else if(exponent <= 0) {
+		//Denormal or zero, these are too small to matter for texture coordinates
+		return sign;
+	}
+
+	//Round to nearest, a carry into the exponent is correct behaviour
+	uint32_t half = (exponent << 10) | (mantissa >> 13);
+	if(mantissa & 0x1000)
+		++half;
+	return sign | std::min(half, (uint32_t)0x7c00);
+}
+
+float PackedVertex::half_to_float(uint16_t h) {
+	uint32_t sign = (h & 0x8000) << 16;
+	int exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+
+	uint32_t bits;
+	if(exponent == 0) {
+		//float_to_half never writes denormals
+		bits = sign;
+	} else if(exponent == 31) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	} else {
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+
+	float f;
+	memcpy(&f, &bits, sizeof(float));
+	return f;
+}
+
+uint32_t PackedVertex::pack_snorm_10_10_10_2(const glm::vec3 &v, float w) {
+	int32_t x = (int32_t)floor(glm::clamp(v.x, -1.f, 1.f) * 511.f + 0.5f);
+	int32_t y = (int32_t)floor(glm::clamp(v.y, -1.f, 1.f) * 511.f + 0.5f);
+	int32_t z = (int32_t)floor(glm::clamp(v.z, -1.f, 1.f) * 511.f + 0.5f);
+	int32_t iw = (int32_t)floor(glm::clamp(w, -1.f, 1.f) + 0.5f);
+
+	return ((uint32_t)x & 0x3ff) | (((uint32_t)y & 0x3ff) << 10) | (((uint32_t)z & 0x3ff) << 20) | (((uint32_t)iw & 0x3) << 30);
+}
+
+glm::vec4 PackedVertex::unpack_snorm_10_10_10_2(uint32_t v) {
+	//Sign extend each field
+	int32_t x = (int32_t)(v << 22) >> 22;
+	int32_t y = (int32_t)(v << 12) >> 22;
+	int32_t z = (int32_t)(v << 2) >> 22;
+	int32_t w = (int32_t)v >> 30;
+	return glm::vec4(std::max(x / 511.f, -1.f), std::max(y / 511.f, -1.f), std::max(z / 511.f, -1.f), std::max((float)w, -1.f));
+}
@@ -0,0 +1,66 @@
+#ifndef PACKED_VERTEX_H
+#define PACKED_VERTEX_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <glload/gl_3_3.h>
+#include <glm/glm.hpp>
+
+//Half float precision is 1/1024 or better for texture coordinates in [-range, range]
+#define PACKED_HALF_UV_RANGE 2.f
+
+/*
+ * Compact vertex layout used for models and terrain, 24 or 28 bytes instead of 56:
+ *	location 0: position, 3 floats
+ *	location 1: texture coordinate, 2 half floats (HALF_UV) or 2 floats
+ *	location 2: normal, 10:10:10:2 signed normalized
+ *	location 3: tangent, 10:10:10:2 signed normalized, w is the sign of the bitangent
+ *	location 4: bone indices, 4 unsigned bytes (SKINNED only)
+ *	location 5: bone weights, 4 unsigned normalized bytes (SKINNED only)
+ * The bitangent is not stored, the shaders rebuild it as cross(normal, tangent.xyz)*sign(tangent.w)
+ *
+ * Indices are 16 bit (SHORT_INDICES) when the mesh has less than 65536 vertices.
+ */
+class PackedVertex {
+public:
+	enum format_flags_t {
+		HALF_UV = 0x1,
+		SHORT_INDICES = 0x2,
+		SKINNED = 0x4,
+
+		//Flags that change the vertex layout (not the indices)
+		LAYOUT_FLAGS = HALF_UV | SKINNED,
+		ALL_FLAGS = HALF_UV | SHORT_INDICES | SKINNED
+	};
+
+	//Smallest format that holds the mesh without visible difference
+	static unsigned int choose_format(size_t num_vertices, float max_abs_uv);
+
+	static size_t vertex_size(unsigned int format);
+	static size_t index_size(unsigned int format);
+	static GLenum index_type(unsigned int format);
+
+	//Writes vertex_size(format) bytes to dst
+	static void pack(unsigned int format, void * dst, const glm::vec3 &pos, const glm::vec2 &uv,
+		const glm::vec3 &normal, const glm::vec3 &tangent, const glm::vec3 &bitangent);
+
+	//Writes the bones of a SKINNED vertex packed by pack(), weights should sum to 1
+	static void pack_bones(unsigned int format, void * dst, const uint8_t * bones, const float * weights);
+
+	//Reverse of pack() and pack_bones(), tangent.w is the bitangent sign. bones and weights are only written for SKINNED formats
+	static void unpack(unsigned int format, const void * src, glm::vec3 &pos, glm::vec2 &uv,
+		glm::vec3 &normal, glm::vec4 &tangent, uint8_t * bones, float * weights);
+
+	//Writes count*index_size(format) bytes to dst
+	static void pack_indices(unsigned int format, void * dst, const unsigned int * indices, size_t count);
+
+	//Enables and sets up attributes 0-3 (and 4-5 for SKINNED) for the bound array buffer
+	static void set_attrib_pointers(unsigned int format);
+
+	static uint16_t float_to_half(float f);
+	static float half_to_float(uint16_t h);
+	static uint32_t pack_snorm_10_10_10_2(const glm::vec3 &v, float w);
+	static glm::vec4 unpack_snorm_10_10_10_2(uint32_t v);
+};
+
+#endif
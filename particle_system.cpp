@@ -6,6 +6,9 @@
 #include "particle_system.h"
 #include "util.h"
 #include "render_object.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "render_device.h"
 
 #define NUM_SIDES 2
 #define VERTICES_PER_SIDE 4
@@ -46,7 +49,11 @@ void ParticleSystem::particle_t::update_vertices(ParticleSystem::vertex_t * v) {
 
 ParticleSystem::~ParticleSystem() {
 	delete[] vertices_;
-	delete texture_;
+	delete cube_;
+	Texture::release(texture_);
+	GLState::delete_vertex_array(vao_);
+	GLState::delete_buffer(vb_);
+	GLState::delete_buffer(ib_);
 }	
 
 ParticleSystem::ParticleSystem(
@@ -64,7 +71,7 @@ ParticleSystem::ParticleSystem(
 {
 	cube_ = new RenderObject("models/cube.obj", Renderer::DEBUG_SHADER);
 	cube_->scale = spawn_area;
-	texture_ = new Texture(texture);
+	texture_ = Texture::acquire(texture);
 	vertices_ = new vertex_t[MAX_NUM_PARTICLES*NUM_SIDES*4];
 	generate_buffers();
 	enabled = true;
@@ -104,24 +111,36 @@ void ParticleSystem::generate_buffers() {
 		}
 	}
 	//Generate buffers and upload:
-	glGenBuffers(1, &vb_);
+	render_device()->gen_buffers(1, &vb_);
 	
-	glBindBuffer(GL_ARRAY_BUFFER,vb_);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_t)*MAX_NUM_PARTICLES*NUM_SIDES*4, NULL, GL_DYNAMIC_DRAW);
+	GLState::bind_buffer(GL_ARRAY_BUFFER, vb_);
+	render_device()->buffer_data(GL_ARRAY_BUFFER, sizeof(vertex_t)*MAX_NUM_PARTICLES*NUM_SIDES*4, NULL, GL_DYNAMIC_DRAW);
 	Renderer::checkForGLErrors("ParticleSystem::generate_buffers() - buffer vertices");
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glGenBuffers(1, &ib_);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,ib_);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*MAX_NUM_PARTICLES*NUM_SIDES*6, &indices.front(), GL_STATIC_DRAW);
+	//The index buffer binding is stored in the vao, so fill it with the vao bound
+	render_device()->gen_vertex_arrays(1, &vao_);
+	GLState::bind_vertex_array(vao_);
+
+	render_device()->gen_buffers(1, &ib_);
+	GLState::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ib_);
+	render_device()->buffer_data(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*MAX_NUM_PARTICLES*NUM_SIDES*6, &indices.front(), GL_STATIC_DRAW);
 	Renderer::checkForGLErrors("ParticleSystem::generate_buffers() - buffer indices");
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	GLState::bind_buffer(GL_ARRAY_BUFFER, vb_);
+
+	render_device()->enable_vertex_attrib_array(0);
+	render_device()->enable_vertex_attrib_array(1);
+	render_device()->enable_vertex_attrib_array(2);
+
+	render_device()->vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), 0);
+	render_device()->vertex_attrib_pointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)));
+	render_device()->vertex_attrib_pointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)+sizeof(glm::vec2)));
+	Renderer::checkForGLErrors("ParticleSystem::generate_buffers() - create vao");
 
 	assert(vb_ >0 && ib_>0);
 }
 
 void ParticleSystem::spawn_particles(int num_particles) {
-	srand(time(NULL));
 	for(int i=0;i<num_particles;++i) {
 		seed_random();
 		particle_t p;
@@ -144,6 +163,7 @@ void ParticleSystem::spawn_particles(int num_particles) {
 void ParticleSystem::update(double dt) {
 	if(!enabled)
 		return;
+	PROFILE_SCOPE("ParticleSystem::update");
 	//Spawn new particles:
 	float new_particles = regen_*dt+particle_rest_;
 	int num_new = (int)new_particles;
@@ -169,6 +189,8 @@ void ParticleSystem::update(double dt) {
 void ParticleSystem::render(double dt, Renderer * renderer) {
 	if(!enabled)
 		return;
+	PROFILE_SCOPE("ParticleSystem::render");
+	PROFILE_GPU("particles");
 
 	//Update vertices:
 	std::list<particle_t>::iterator it = particles_.begin();
@@ -185,50 +207,29 @@ void ParticleSystem::render(double dt, Renderer * renderer) {
 	//cube_->render(dt, renderer);
 
 
-	glUseProgram(renderer->shaders[shader_].program);
-	glUseProgram(renderer->shaders[Renderer::PARTICLES_SHADER].program);
-	glActiveTexture(GL_TEXTURE0);
-	texture_->bind();
+	GLState::use_program(renderer->shaders[Renderer::PARTICLES_SHADER].program);
+	texture_->bind(0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, vb_);
+	GLState::bind_buffer(GL_ARRAY_BUFFER, vb_);
 	Renderer::checkForGLErrors("ParticleSystem::render() - bind buffer");
 	
 	//Upload new vertex data
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertex_t)*count*NUM_SIDES*4, vertices_);
+	{
+		PROFILE_SCOPE("ParticleSystem::upload");
+		render_device()->buffer_sub_data(GL_ARRAY_BUFFER, 0, sizeof(vertex_t)*count*NUM_SIDES*4, vertices_);
+	}
 	Renderer::checkForGLErrors("ParticleSystem::render() - Upload new data");
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib_);
-	
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), 0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)));
-	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)+sizeof(glm::vec2)));
+	GLState::bind_vertex_array(vao_);
 
 	//Upload matrix (if parent have changed it)
 	renderer->upload_model_matrices(false);
-	//Disable depth mask to get alpha blending right
-	glDepthMask(GL_FALSE);
+	//Disable depth mask to get alpha blending right, whoever draws next with depth writes turns it on
+	GLState::depth_mask(false);
 
-	glDrawElements(GL_TRIANGLES, count*6*NUM_SIDES, GL_UNSIGNED_INT, 0);
+	render_device()->draw_elements(GL_TRIANGLES, count*6*NUM_SIDES, GL_UNSIGNED_INT, 0);
+	++Renderer::stats.draw_calls;
 	Renderer::checkForGLErrors("ParticleSystem::render() - draw");
-
-	//And turn depth mask on again
-	glDepthMask(GL_TRUE);
-
-	glDisableVertexAttribArray(2);
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(0);
-		
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-	texture_->unbind();
-
-	glUseProgram(0);
-
 }
 
 float ParticleSystem::rand(float var, bool d) {
@@ -29,6 +29,7 @@ class ParticleSystem : public RenderGroup {
 
 	GLuint ib_;
 	GLuint vb_;
+	GLuint vao_;
 
 	Renderer::shader_program_t shader_;	
 
@@ -0,0 +1,187 @@
+#include "png_file.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <zlib.h>
+
+static const unsigned char png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+static void put_u32(std::vector<unsigned char> &out, unsigned long v) {
+	out.push_back((v >> 24) & 0xff);
+	out.push_back((v >> 16) & 0xff);
+	out.push_back((v >> 8) & 0xff);
+	out.push_back(v & 0xff);
+}
+
+static unsigned long get_u32(const unsigned char * p) {
+	return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+}
+
+static void write_chunk(FILE * file, const char * type, const std::vector<unsigned char> &data) {
+	std::vector<unsigned char> chunk;
+	put_u32(chunk, data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	//The crc covers type and data
+	put_u32(chunk, crc32(crc32(0, NULL, 0), &chunk[4], chunk.size() - 4));
+	fwrite(&chunk[0], 1, chunk.size(), file);
+}
+
+bool write_png(const std::string &path, const unsigned char * pixels, int width, int height) {
+	//Each row starts with its filter type, 0 is none
+	size_t row = width*4;
+	std::vector<unsigned char> raw((row + 1)*height);
+	for(int y=0; y < height; ++y) {
+		raw[y*(row + 1)] = 0;
+		memcpy(&raw[y*(row + 1) + 1], pixels + y*row, row);
+	}
+
+	uLongf compressed_size = compressBound(raw.size());
+	std::vector<unsigned char> compressed(compressed_size);
+	if(compress(&compressed[0], &compressed_size, &raw[0], raw.size()) != Z_OK) {
+		fprintf(stderr, "PNG: Failed to compress %s\n", path.c_str());
+		return false;
+	}
+	compressed.resize(compressed_size);
+
+	FILE * file = fopen(path.c_str(), "wb");
+	if(file == NULL) {
+		fprintf(stderr, "PNG: Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+	fwrite(png_signature, 1, sizeof(png_signature), file);
+
+	std::vector<unsigned char> header;
+	put_u32(header, width);
+	put_u32(header, height);
+	header.push_back(8); //Bit depth
+	header.push_back(6); //Color type RGBA
+	header.push_back(0); //Compression
+	header.push_back(0); //Filter
+	header.push_back(0); //Interlace
+	write_chunk(file, "IHDR", header);
+	write_chunk(file, "IDAT", compressed);
+	write_chunk(file, "IEND", std::vector<unsigned char>());
+
+	bool ok = (ferror(file) == 0);
+	fclose(file);
+	if(!ok)
+		fprintf(stderr, "PNG: Failed to write %s\n", path.c_str());
+	return ok;
+}
+
+static int paeth(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if(pa <= pb && pa <= pc)
+		return a;
+	return (pb <= pc) ? b : c;
+}
+
+bool read_png(const std::string &path, std::vector<unsigned char> &pixels, int &width, int &height) {
+	FILE * file = fopen(path.c_str(), "rb");
+	if(file == NULL) {
+		fprintf(stderr, "PNG: Failed to open %s\n", path.c_str());
+		return false;
+	}
+	std::vector<unsigned char> data;
+	unsigned char buffer[4096];
+	size_t read;
+	while((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + read);
+	}
+	fclose(file);
+
+	if(data.size() < sizeof(png_signature) || memcmp(&data[0], png_signature, sizeof(png_signature)) != 0) {
+		fprintf(stderr, "PNG: %s is not a PNG file\n", path.c_str());
+		return false;
+	}
+
+	int channels = 0;
+	std::vector<unsigned char> compressed;
+	for(size_t pos = sizeof(png_signature); pos + 12 <= data.size(); ) {
+		unsigned long length = get_u32(&data[pos]);
+		const unsigned char * type = &data[pos + 4];
+		const unsigned char * chunk = &data[pos + 8];
+		if(pos + 12 + length > data.size()) {
+			fprintf(stderr, "PNG: %s is truncated\n", path.c_str());
+			return false;
+		}
+		if(memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+			width = get_u32(chunk);
+			height = get_u32(chunk + 4);
+			if(chunk[8] != 8 || (chunk[9] != 2 && chunk[9] != 6) || chunk[12] != 0) {
+				fprintf(stderr, "PNG: %s is not 8 bit RGB or RGBA without interlacing\n", path.c_str());
+				return false;
+			}
+			channels = (chunk[9] == 6) ? 4 : 3;
+		} else if(memcmp(type, "IDAT", 4) == 0) {
+			compressed.insert(compressed.end(), chunk, chunk + length);
+		} else if(memcmp(type, "IEND", 4) == 0) {
+			break;
+		}
+		pos += 12 + length;
+	}
+	if(channels == 0 || compressed.empty()) {
+		fprintf(stderr, "PNG: %s has no image data\n", path.c_str());
+		return false;
+	}
+
+	size_t row = width*channels;
+	std::vector<unsigned char> raw((row + 1)*height);
+	uLongf raw_size = raw.size();
+	if(uncompress(&raw[0], &raw_size, &compressed[0], compressed.size()) != Z_OK || raw_size != raw.size()) {
+		fprintf(stderr, "PNG: Failed to decompress %s\n", path.c_str());
+		return false;
+	}
+
+	//Undo the filter of each row in place, a is the byte to the left, b above and c above left
+	for(int y=0; y < height; ++y) {
+		unsigned char filter = raw[y*(row + 1)];
+		unsigned char * cur = &raw[y*(row + 1) + 1];
+		const unsigned char * prev = (y > 0) ? &raw[(y - 1)*(row + 1) + 1] : NULL;
+		for(size_t x=0; x < row; ++x) {
+			int a = (x >= (size_t)channels) ? cur[x - channels] : 0;
+			int b = (prev != NULL) ? prev[x] : 0;
+			int c = (prev != NULL && x >= (size_t)channels) ? prev[x - channels] : 0;
+			switch(filter) {
+				case 0: break;
+				case 1: cur[x] += a; break;
+				case 2: cur[x] += b; break;
+				case 3: cur[x] += (a + b)/2; break;
+				case 4: cur[x] += paeth(a, b, c); break;
+				default:
+					fprintf(stderr, "PNG: %s has an unknown filter type %d\n", path.c_str(), filter);
+					return false;
+			}
+		}
+	}
+
+	pixels.resize(width*height*4);
+	for(int y=0; y < height; ++y) {
+		const unsigned char * src = &raw[y*(row + 1) + 1];
+		for(int x=0; x < width; ++x) {
+			unsigned char * dst = &pixels[(y*width + x)*4];
+			memcpy(dst, src + x*channels, channels);
+			if(channels == 3)
+				dst[3] = 255;
+		}
+	}
+	return true;
+}
+
+image_diff_t compare_pixels(const unsigned char * a, const unsigned char * b, int width, int height, int tolerance) {
+	image_diff_t diff;
+	for(int i=0; i < width*height; ++i) {
+		int max = 0;
+		for(int c=0; c < 3; ++c) {
+			max = std::max(max, abs((int)a[i*4 + c] - (int)b[i*4 + c]));
+		}
+		if(max > tolerance)
+			++diff.differing_pixels;
+		diff.max_difference = std::max(diff.max_difference, max);
+	}
+	return diff;
+}
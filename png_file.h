@@ -0,0 +1,27 @@
+#ifndef PNG_FILE_H
+#define PNG_FILE_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Minimal PNG reading and writing (with zlib) for frame captures and golden images.
+ * Pixels are RGBA, 4 bytes each with the top row first.
+ */
+
+//Returns false (and prints why) if the file can't be written
+bool write_png(const std::string &path, const unsigned char * pixels, int width, int height);
+
+//8 bit RGB or RGBA, not interlaced. Returns false (and prints why) if the file can't be read
+bool read_png(const std::string &path, std::vector<unsigned char> &pixels, int &width, int &height);
+
+struct image_diff_t {
+	image_diff_t() : differing_pixels(0), max_difference(0) {};
+	unsigned long differing_pixels; //Pixels with a channel differing more than the tolerance
+	int max_difference; //Largest difference of any channel
+};
+
+//Compares two images of the same size channel by channel, alpha is ignored
+image_diff_t compare_pixels(const unsigned char * a, const unsigned char * b, int width, int height, int tolerance);
+
+#endif
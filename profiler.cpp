@@ -0,0 +1,269 @@
+#include "profiler.h"
+#include "util.h"
+#include "render_device.h"
+
+#include <cstdio>
+#include <algorithm>
+
+bool Profiler::enabled = false;
+
+std::mutex Profiler::mutex_;
+std::vector<Profiler::event_t> Profiler::events_;
+std::map<std::string, Profiler::scope_stats_t> Profiler::cpu_stats_;
+std::map<std::string, Profiler::scope_stats_t> Profiler::gpu_stats_;
+std::map<std::thread::id, unsigned int> Profiler::threads_;
+bool Profiler::events_full_ = false;
+bool Profiler::keep_frames_ = false;
+
+bool Profiler::gpu_ = false;
+Profiler::gpu_frame_t Profiler::gpu_frames_[PROFILER_GPU_FRAMES];
+int Profiler::gpu_frame_ = 0;
+double Profiler::gpu_offset_ = 0;
+unsigned int Profiler::dropped_gpu_frames_ = 0;
+double Profiler::start_ = 0;
+
+void Profiler::init() {
+	if(!enabled)
+		return;
+
+	start_ = monotonic_seconds();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		thread_index(); //The GL thread becomes thread 1
+	}
+
+	//Only cpu scopes on the null device
+	if(!render_device()->has_gpu())
+		return;
+
+	for(int f=0; f < PROFILER_GPU_FRAMES; ++f) {
+		render_device()->gen_queries(PROFILER_MAX_GPU_SCOPES*2, gpu_frames_[f].queries);
+		gpu_frames_[f].scopes.reserve(PROFILER_MAX_GPU_SCOPES);
+	}
+	gpu_frame_ = 0;
+
+	//Timestamps count from an unspecified point, line them up with the cpu clock
+	GLint64 gpu_time;
+	render_device()->get_integer64_v(GL_TIMESTAMP, &gpu_time);
+	gpu_offset_ = monotonic_seconds() - gpu_time/1000000000.0;
+	gpu_ = true;
+}
+
+void Profiler::cleanup() {
+	if(!gpu_)
+		return;
+	for(int f=0; f < PROFILER_GPU_FRAMES; ++f) {
+		render_device()->delete_queries(PROFILER_MAX_GPU_SCOPES*2, gpu_frames_[f].queries);
+		gpu_frames_[f].scopes.clear();
+	}
+	gpu_ = false;
+}
+
+unsigned int Profiler::thread_index() {
+	std::thread::id id = std::this_thread::get_id();
+	std::map<std::thread::id, unsigned int>::iterator it = threads_.find(id);
+	if(it != threads_.end())
+		return it->second;
+	unsigned int index = threads_.size() + 1;
+	threads_[id] = index;
+	return index;
+}
+
+void Profiler::add_event(const char * name, double start, double duration, unsigned int thread, std::map<std::string, scope_stats_t> &stats) {
+	scope_stats_t &scope = stats[name];
+	scope.frame_time += duration;
+	scope.measured = true;
+
+	if(events_.size() < PROFILER_MAX_EVENTS) {
+		event_t event;
+		event.name = name;
+		event.start = start;
+		event.duration = duration;
+		event.thread = thread;
+		events_.push_back(event);
+	} else if(!events_full_) {
+		fprintf(stderr, "Profiler: %d events recorded, not recording more\n", PROFILER_MAX_EVENTS);
+		events_full_ = true;
+	}
+}
+
+Profiler::CPUScope::CPUScope(const char * name) : name_(NULL) {
+	if(!enabled)
+		return;
+	name_ = name;
+	start_ = monotonic_seconds();
+}
+
+Profiler::CPUScope::~CPUScope() {
+	if(name_ == NULL)
+		return;
+	double end = monotonic_seconds();
+	std::lock_guard<std::mutex> lock(mutex_);
+	add_event(name_, start_, end - start_, thread_index(), cpu_stats_);
+}
+
+Profiler::GPUScope::GPUScope(const char * name) : frame_(-1), index_(-1) {
+	if(!gpu_)
+		return;
+	gpu_frame_t &frame = gpu_frames_[gpu_frame_];
+	if(frame.scopes.size() >= PROFILER_MAX_GPU_SCOPES)
+		return;
+
+	frame_ = gpu_frame_;
+	index_ = frame.scopes.size();
+	gpu_scope_t scope;
+	scope.name = name;
+	scope.begin = frame.queries[index_*2];
+	scope.end = frame.queries[index_*2 + 1];
+	scope.ended = false;
+	frame.scopes.push_back(scope);
+	render_device()->query_counter(scope.begin, GL_TIMESTAMP);
+}
+
+Profiler::GPUScope::~GPUScope() {
+	if(index_ < 0 || frame_ != gpu_frame_)
+		return;
+	gpu_scope_t &scope = gpu_frames_[frame_].scopes[index_];
+	render_device()->query_counter(scope.end, GL_TIMESTAMP);
+	scope.ended = true;
+}
+
+void Profiler::read_gpu_frame(gpu_frame_t &frame) {
+	//Never wait for the gpu, if any result is missing the frame is dropped
+	bool available = true;
+	for(std::vector<gpu_scope_t>::iterator it=frame.scopes.begin(); available && it!=frame.scopes.end(); ++it) {
+		if(!it->ended)
+			continue;
+		GLint result = 0;
+		render_device()->get_query_object_iv(it->end, GL_QUERY_RESULT_AVAILABLE, &result);
+		available = (result != 0);
+	}
+
+	if(!available) {
+		++dropped_gpu_frames_;
+	} else {
+		std::lock_guard<std::mutex> lock(mutex_);
+		for(std::vector<gpu_scope_t>::iterator it=frame.scopes.begin(); it!=frame.scopes.end(); ++it) {
+			if(!it->ended)
+				continue;
+			GLuint64 begin, end;
+			render_device()->get_query_object_ui64v(it->begin, GL_QUERY_RESULT, &begin);
+			render_device()->get_query_object_ui64v(it->end, GL_QUERY_RESULT, &end);
+			add_event(it->name, begin/1000000000.0 + gpu_offset_, (end - begin)/1000000000.0, GPU_THREAD, gpu_stats_);
+		}
+	}
+	frame.scopes.clear();
+}
+
+void Profiler::next_frame() {
+	if(!enabled)
+		return;
+
+	if(gpu_) {
+		gpu_frame_ = (gpu_frame_ + 1) % PROFILER_GPU_FRAMES;
+		read_gpu_frame(gpu_frames_[gpu_frame_]);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::map<std::string, scope_stats_t> * all_stats[] = { &cpu_stats_, &gpu_stats_ };
+	for(int s=0; s < 2; ++s) {
+		for(std::map<std::string, scope_stats_t>::iterator it=all_stats[s]->begin(); it!=all_stats[s]->end(); ++it) {
+			scope_stats_t &stats = it->second;
+			stats.history[stats.next] = stats.frame_time;
+			stats.next = (stats.next + 1) % PROFILER_HISTORY;
+			stats.count = std::min(stats.count + 1, (unsigned int)PROFILER_HISTORY);
+			if(keep_frames_ && stats.measured)
+				stats.frames.push_back(stats.frame_time);
+			stats.frame_time = 0;
+			stats.measured = false;
+		}
+	}
+}
+
+void Profiler::flush() {
+	if(!enabled)
+		return;
+	render_device()->finish();
+	for(int f=0; f < PROFILER_GPU_FRAMES; ++f) {
+		next_frame();
+	}
+}
+
+void Profiler::print_stats() {
+	if(!enabled)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	printf("Profiler (ms/frame over the last %d frames):      avg      min      max\n", PROFILER_HISTORY);
+	std::map<std::string, scope_stats_t> * all_stats[] = { &cpu_stats_, &gpu_stats_ };
+	const char * kind[] = { "cpu", "gpu" };
+	for(int s=0; s < 2; ++s) {
+		for(std::map<std::string, scope_stats_t>::iterator it=all_stats[s]->begin(); it!=all_stats[s]->end(); ++it) {
+			const scope_stats_t &stats = it->second;
+			if(stats.count == 0)
+				continue;
+			double sum = 0, min = stats.history[0], max = stats.history[0];
+			for(unsigned int i=0; i < stats.count; ++i) {
+				sum += stats.history[i];
+				min = std::min(min, stats.history[i]);
+				max = std::max(max, stats.history[i]);
+			}
+			printf("  %s %-40s %8.3f %8.3f %8.3f\n", kind[s], it->first.c_str(),
+				1000.0*sum/stats.count, 1000.0*min, 1000.0*max);
+		}
+	}
+	if(dropped_gpu_frames_ > 0)
+		printf("  gpu times of %u frames dropped, the gpu was more than %d frames behind\n", dropped_gpu_frames_, PROFILER_GPU_FRAMES - 1);
+}
+
+void Profiler::keep_frame_times(bool keep) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	keep_frames_ = keep;
+	if(!keep)
+		return;
+	std::map<std::string, scope_stats_t> * all_stats[] = { &cpu_stats_, &gpu_stats_ };
+	for(int s=0; s < 2; ++s) {
+		for(std::map<std::string, scope_stats_t>::iterator it=all_stats[s]->begin(); it!=all_stats[s]->end(); ++it) {
+			it->second.frames.clear();
+		}
+	}
+}
+
+std::map<std::string, std::vector<double> > Profiler::frame_times(bool gpu) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::map<std::string, std::vector<double> > times;
+	std::map<std::string, scope_stats_t> &stats = gpu ? gpu_stats_ : cpu_stats_;
+	for(std::map<std::string, scope_stats_t>::iterator it=stats.begin(); it!=stats.end(); ++it) {
+		if(!it->second.frames.empty())
+			times[it->first] = it->second.frames;
+	}
+	return times;
+}
+
+bool Profiler::write_trace(const std::string &path) {
+	FILE * file = fopen(path.c_str(), "w");
+	if(file == NULL) {
+		fprintf(stderr, "Profiler: Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"GPU\"}}", GPU_THREAD);
+	for(std::map<std::thread::id, unsigned int>::iterator it=threads_.begin(); it!=threads_.end(); ++it) {
+		std::string name = (it->second == 1) ? std::string("GL thread") : format("Thread %u", it->second);
+		fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+			it->second, name.c_str());
+	}
+	//Names are string literals in the code, they need no escaping
+	for(std::vector<event_t>::iterator it=events_.begin(); it!=events_.end(); ++it) {
+		fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+			it->name, (it->thread == GPU_THREAD) ? "gpu" : "cpu", it->thread,
+			1000000.0*(it->start - start_), 1000000.0*it->duration);
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("Wrote %lu profiler events to %s\n", events_.size(), path.c_str());
+	return true;
+}
@@ -0,0 +1,136 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <glload/gl_3_3.h>
+
+//Frames of gpu timer queries in flight, results are read this many frames later so the cpu never waits for them
+#define PROFILER_GPU_FRAMES 2
+//Gpu scopes per frame, more are not measured
+#define PROFILER_MAX_GPU_SCOPES 64
+//Frames in the rolling statistics of each scope
+#define PROFILER_HISTORY 120
+//Events kept for write_trace(), later ones are dropped
+#define PROFILER_MAX_EVENTS 1000000
+
+//Times the enclosing block on the cpu, name must be a string literal
+#define PROFILE_SCOPE(name) Profiler::CPUScope PROFILER_CONCAT(profile_scope_, __LINE__)(name)
+//Times the GL commands issued in the enclosing block on the gpu, GL thread only
+#define PROFILE_GPU(name) Profiler::GPUScope PROFILER_CONCAT(profile_gpu_, __LINE__)(name)
+
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+#define PROFILER_CONCAT_(a, b) a##b
+
+/*
+ * Frame profiler with cpu scopes (any thread) and gpu scopes (GL_TIMESTAMP queries around
+ * the commands of a pass). Scopes nest.
+ *
+ * Each scope's time per frame is kept for the last PROFILER_HISTORY frames (print_stats()) and every
+ * scope becomes an event in a Chrome trace (write_trace(), open it in chrome://tracing or Perfetto),
+ * with the gpu as a thread of its own.
+ *
+ * The gpu queries of a frame are read PROFILER_GPU_FRAMES - 1 frames later. If the gpu is further
+ * behind than that the frame's gpu times are dropped instead of waiting.
+ *
+ * Set enabled before the Renderer is created, the scopes do nothing when it is false.
+ */
+class Profiler {
+public:
+	static bool enabled;
+
+	//Called by the Renderer once the context is created, and when it is deleted
+	static void init();
+	static void cleanup();
+
+	//Ends the last frame: reads old gpu queries and moves the frame's times to the statistics. Called by the Renderer at the start of each frame
+	static void next_frame();
+	//Waits for the gpu and ends all frames, so every time measured so far is in the statistics
+	static void flush();
+
+	//Average, min and max ms per frame of each scope
+	static void print_stats();
+	//Writes all events recorded since init() as Chrome trace JSON, returns false if the file can't be written
+	static bool write_trace(const std::string &path);
+
+	//Keeps the time of every frame of each scope from now on (for percentiles), true clears the times kept so far
+	static void keep_frame_times(bool keep);
+	//Seconds per frame of each cpu or gpu scope, for the frames it was measured in since keep_frame_times(true)
+	static std::map<std::string, std::vector<double> > frame_times(bool gpu);
+
+	class CPUScope {
+	public:
+		CPUScope(const char * name);
+		~CPUScope();
+	private:
+		//Copy not allowed (no body implemented, intentional!)
+		CPUScope(const CPUScope &other);
+
+		const char * name_;
+		double start_;
+	};
+
+	class GPUScope {
+	public:
+		GPUScope(const char * name);
+		~GPUScope();
+	private:
+		//Copy not allowed (no body implemented, intentional!)
+		GPUScope(const GPUScope &other);
+
+		int frame_, index_; //-1 if not measured
+	};
+
+private:
+	struct event_t {
+		const char * name;
+		double start, duration; //Seconds, start from monotonic_seconds()
+		unsigned int thread; //GPU_THREAD for gpu scopes
+	};
+
+	struct scope_stats_t {
+		scope_stats_t() : frame_time(0), measured(false), next(0), count(0) {};
+		double frame_time; //Summed over the current frame
+		bool measured; //If frame_time has any event this frame
+		double history[PROFILER_HISTORY];
+		unsigned int next, count;
+		std::vector<double> frames; //All frames it was measured in, with keep_frame_times
+	};
+
+	struct gpu_scope_t {
+		const char * name;
+		GLuint begin, end; //Timestamp queries
+		bool ended; //False if the scope was still open when the frame ended
+	};
+
+	struct gpu_frame_t {
+		GLuint queries[PROFILER_MAX_GPU_SCOPES*2];
+		std::vector<gpu_scope_t> scopes;
+	};
+
+	static const unsigned int GPU_THREAD = 0;
+
+	//Must be called with mutex_ locked
+	static void add_event(const char * name, double start, double duration, unsigned int thread, std::map<std::string, scope_stats_t> &stats);
+	static unsigned int thread_index();
+	static void read_gpu_frame(gpu_frame_t &frame);
+
+	static std::mutex mutex_;
+	static std::vector<event_t> events_;
+	static std::map<std::string, scope_stats_t> cpu_stats_, gpu_stats_;
+	static std::map<std::thread::id, unsigned int> threads_; //Trace thread of each thread, the GL thread is 1
+	static bool events_full_;
+	static bool keep_frames_;
+
+	static bool gpu_; //Timer queries created
+	static gpu_frame_t gpu_frames_[PROFILER_GPU_FRAMES];
+	static int gpu_frame_;
+	static double gpu_offset_; //Added to gpu timestamps (in seconds) to get monotonic_seconds()
+	static unsigned int dropped_gpu_frames_;
+	static double start_;
+};
+
+#endif
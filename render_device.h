@@ -0,0 +1,138 @@
+#ifndef RENDER_DEVICE_H
+#define RENDER_DEVICE_H
+
+#include <string>
+#include <vector>
+#include <glload/gl_3_3.h>
+
+/*
+ * Everything the renderer asks of the graphics api. The functions are the GL calls
+ * of the same name with the same arguments (glBufferData is buffer_data), so GLDevice
+ * (gl_device.h) is a thin forward and GL enums are used throughout.
+ *
+ * NullDevice (null_device.h) runs without any GL: it hands out names, keeps memory for
+ * mapped buffers and counts commands and bytes, so a whole frame (culling, animation,
+ * particles, draw submission and uploads) can be measured on a machine without GL.
+ *
+ * Only called from the GL thread.
+ */
+class RenderDevice {
+public:
+	static RenderDevice * current;
+
+	virtual ~RenderDevice() {};
+
+	//Name of the device in reports
+	virtual const char * name() const = 0;
+	//False if the commands never reach a gpu (the null device): there are no gpu timings and no pixels
+	virtual bool has_gpu() const = 0;
+	virtual bool has_extension(const char * name) const = 0;
+
+	//Prints the commands and bytes counted over frames since the last reset_stats(), if the device counts them
+	virtual void print_stats(unsigned int frames) const {};
+	virtual void reset_stats() {};
+
+	//Buffers
+	virtual void gen_buffers(GLsizei n, GLuint * buffers) = 0;
+	virtual void delete_buffers(GLsizei n, const GLuint * buffers) = 0;
+	virtual void bind_buffer(GLenum target, GLuint buffer) = 0;
+	virtual void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) = 0;
+	virtual void buffer_data(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage) = 0;
+	virtual void buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid * data) = 0;
+	virtual void copy_buffer_sub_data(GLenum read_target, GLenum write_target, GLintptr read_offset, GLintptr write_offset, GLsizeiptr size) = 0;
+	virtual void * map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) = 0;
+	virtual GLboolean unmap_buffer(GLenum target) = 0;
+	//ARB_buffer_storage, returns false if not supported
+	virtual bool buffer_storage(GLenum target, GLsizeiptr size, const GLvoid * data, GLbitfield flags) = 0;
+
+	//Vertex arrays
+	virtual void gen_vertex_arrays(GLsizei n, GLuint * arrays) = 0;
+	virtual void delete_vertex_arrays(GLsizei n, const GLuint * arrays) = 0;
+	virtual void bind_vertex_array(GLuint array) = 0;
+	virtual void enable_vertex_attrib_array(GLuint index) = 0;
+	virtual void disable_vertex_attrib_array(GLuint index) = 0;
+	virtual void vertex_attrib_pointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid * pointer) = 0;
+	virtual void vertex_attrib_i_pointer(GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid * pointer) = 0;
+	virtual void vertex_attrib_divisor(GLuint index, GLuint divisor) = 0;
+	virtual void vertex_attrib_3fv(GLuint index, const GLfloat * v) = 0;
+	virtual void vertex_attrib_4f(GLuint index, GLfloat x, GLfloat y, GLfloat z, GLfloat w) = 0;
+	virtual void vertex_attrib_4fv(GLuint index, const GLfloat * v) = 0;
+
+	//Textures
+	virtual void gen_textures(GLsizei n, GLuint * textures) = 0;
+	virtual void delete_textures(GLsizei n, const GLuint * textures) = 0;
+	virtual void active_texture(GLenum texture) = 0;
+	virtual void bind_texture(GLenum target, GLuint texture) = 0;
+	virtual void tex_parameter_i(GLenum target, GLenum pname, GLint param) = 0;
+	virtual void pixel_store_i(GLenum pname, GLint param) = 0;
+	virtual void tex_image_2d(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid * pixels) = 0;
+	virtual void tex_image_3d(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid * pixels) = 0;
+	virtual void tex_sub_image_3d(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid * pixels) = 0;
+	virtual void sampler_parameter_i(GLuint sampler, GLenum pname, GLint param) = 0;
+	virtual void sampler_parameter_f(GLuint sampler, GLenum pname, GLfloat param) = 0;
+
+	//Programs. compile_shader and link_program throw glutil::ShaderException on errors
+	virtual GLuint compile_shader(GLenum type, const std::string &source) = 0;
+	virtual GLuint link_program(const std::vector<GLuint> &shaders) = 0;
+	virtual void delete_shader(GLuint shader) = 0;
+	virtual void use_program(GLuint program) = 0;
+	virtual GLint get_uniform_location(GLuint program, const GLchar * name) = 0;
+	virtual GLuint get_uniform_block_index(GLuint program, const GLchar * name) = 0;
+	virtual void uniform_block_binding(GLuint program, GLuint block_index, GLuint binding) = 0;
+	virtual void uniform_1i(GLint location, GLint v) = 0;
+	virtual void uniform_1f(GLint location, GLfloat v) = 0;
+	virtual void uniform_2fv(GLint location, GLsizei count, const GLfloat * v) = 0;
+
+	//Fixed function state
+	virtual void enable(GLenum capability) = 0;
+	virtual void disable(GLenum capability) = 0;
+	virtual void depth_mask(GLboolean flag) = 0;
+	virtual void depth_func(GLenum func) = 0;
+	virtual void depth_range(GLclampd near_value, GLclampd far_value) = 0;
+	virtual void blend_func(GLenum src, GLenum dst) = 0;
+	virtual void cull_face(GLenum mode) = 0;
+	virtual void front_face(GLenum mode) = 0;
+	virtual void line_width(GLfloat width) = 0;
+	virtual void viewport(GLint x, GLint y, GLsizei width, GLsizei height) = 0;
+	virtual void clear_color(GLclampf r, GLclampf g, GLclampf b, GLclampf a) = 0;
+	virtual void clear(GLbitfield mask) = 0;
+
+	//Draws
+	virtual void draw_arrays(GLenum mode, GLint first, GLsizei count) = 0;
+	virtual void draw_elements(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices) = 0;
+	virtual void draw_elements_base_vertex(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices, GLint base_vertex) = 0;
+	virtual void draw_elements_instanced_base_vertex(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices, GLsizei instances, GLint base_vertex) = 0;
+	//ARB_multi_draw_indirect, only call when the extension is supported
+	virtual void multi_draw_elements_indirect(GLenum mode, GLenum type, const GLvoid * indirect, GLsizei draw_count, GLsizei stride) = 0;
+
+	//Synchronization
+	virtual GLsync fence_sync(GLenum condition, GLbitfield flags) = 0;
+	virtual GLenum client_wait_sync(GLsync sync, GLbitfield flags, GLuint64 timeout) = 0;
+	virtual void delete_sync(GLsync sync) = 0;
+	virtual void finish() = 0;
+
+	//Timer queries
+	virtual void gen_queries(GLsizei n, GLuint * queries) = 0;
+	virtual void delete_queries(GLsizei n, const GLuint * queries) = 0;
+	virtual void query_counter(GLuint query, GLenum target) = 0;
+	virtual void get_query_object_iv(GLuint query, GLenum pname, GLint * params) = 0;
+	virtual void get_query_object_ui64v(GLuint query, GLenum pname, GLuint64 * params) = 0;
+
+	//State queries and debugging
+	virtual void get_integer_v(GLenum pname, GLint * params) = 0;
+	virtual void get_integer64_v(GLenum pname, GLint64 * params) = 0;
+	virtual const GLubyte * get_string(GLenum name) = 0;
+	virtual GLenum get_error() = 0;
+	typedef void (APIENTRY * debug_proc_t)(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar * message, const GLvoid * user_param);
+	//KHR_debug or ARB_debug_output, returns false if neither is supported
+	virtual bool debug_message_callback(debug_proc_t callback, const GLvoid * user_param) = 0;
+	//KHR_debug, does nothing if not supported
+	virtual void object_label(GLenum identifier, GLuint name, GLsizei length, const GLchar * label) = 0;
+};
+
+//The device everything renders through, created by the Renderer
+inline RenderDevice * render_device() {
+	return RenderDevice::current;
+}
+
+#endif
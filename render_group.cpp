@@ -36,3 +36,10 @@ void RenderGroup::render(double dt, Renderer * renderer) {
 	renderer->modelMatrix.Pop();
 }
 
+
+void RenderGroup::collect_render_objects(const glm::mat4 &parent, std::vector<RenderObject*> &out) {
+	glm::mat4 m = parent * matrix();
+	for(std::vector<RenderGroup*>::iterator it=objects_.begin(); it!=objects_.end(); ++it) {
+		(*it)->collect_render_objects(m, out);
+	}
+}
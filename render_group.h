@@ -5,6 +5,7 @@
 #include <vector>
 
 class Renderer; //Forward declaration
+class RenderObject;
 
 class RenderGroup : public MovableObject {
 	std::vector<RenderGroup*> objects_;
@@ -23,6 +24,9 @@ public:
 	virtual void render(double dt, Renderer * renderer);
 	virtual const glm::mat4 matrix() const;
 
+	//Appends all RenderObjects in this group (and its subgroups) to out, parent is the matrix the group is rendered with
+	virtual void collect_render_objects(const glm::mat4 &parent, std::vector<RenderObject*> &out);
+
 };
 
 #endif
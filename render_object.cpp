@@ -2,103 +2,126 @@
 #include "render_group.h"
 #include "renderer.h"
 #include "texture.h"
+#include "model.h"
+#include "util.h"
+#include "clip_compression.h"
+#include "frustum.h"
+#include "render_queue.h"
+#include "material_buffer.h"
+#include "gl_state.h"
+#include "render_device.h"
 #include <string>
 #include <cstdio>
+#include <cassert>
+#include <cmath>
+#include <cfloat>
 #include <algorithm>
 
-#include <assimp/assimp.h>
-#include <assimp/aiScene.h>
-#include <assimp/aiPostProcess.h>
 #include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/glm.hpp>
 
-#define aisgl_min(x,y) (x<y?x:y)
 #define aisgl_max(x,y) (y>x?y:x)
 
-void RenderObject::color4_to_vec4(const struct aiColor4D *c, glm::vec4 &target) {
-	target.x = c->r;
-	target.y = c->g;
-	target.z = c->b;
-	target.w = c->a;
-}
+//Keys to step over before a cursor gives up and does a binary search
+#define ANIM_CURSOR_MAX_STEPS 4
+
+RenderObject::anim_lod_t RenderObject::anim_lod[ANIM_LOD_LEVELS] = {
+	{ 0.25f, 1 },
+	{ 0.08f, 2 },
+	{ 0.f, 4 }
+};
 
 RenderObject::~RenderObject() {
-	aiReleaseImport(scene);
-	for(std::map<const aiMesh*, mesh_data_t>::iterator it=mesh_data.begin(); it!=mesh_data.end(); ++it) {
-		glDeleteBuffers(1, &it->second.vb);
-		glDeleteBuffers(1, &it->second.ib);
+	for(std::vector<cpu_skin_t*>::iterator it=cpu_skins_.begin(); it!=cpu_skins_.end(); ++it) {
+		if(*it == NULL)
+			continue;
+		if((*it)->vao != 0) {
+			GLState::delete_vertex_array((*it)->vao);
+			GLState::delete_buffer((*it)->vb);
+			GLState::delete_buffer((*it)->ib);
+		}
+		delete *it;
 	}
 
-	for(std::vector<material_t>::iterator it=materials.begin(); it!=materials.end(); ++it) {
-		if(it->texture != NULL)
-			delete it->texture;
-		if(it->normal_map != NULL)
-			delete it->normal_map;
+	//The materials only point to the textures, they belong to the model
+	if(ready_) {
+		for(std::vector<material_t>::iterator it=materials.begin(); it!=materials.end(); ++it) {
+			MaterialBuffer::release(it->index);
+		}
 	}
+	Model::release(model_);
 }
 
-RenderObject::RenderObject(std::string model, Renderer::shader_program_t shader_program, bool normalize_scale, unsigned int aiOptions) 
-	: RenderGroup(), shader_program_(shader_program) {
+RenderObject::RenderObject(std::string model, Renderer::shader_program_t shader_program, bool normalize_scale, unsigned int aiOptions, ModelLoader * loader) 
+	: RenderGroup(), shader_program_(shader_program), normalize_scale_(normalize_scale), ready_(false) {
 
 	name = model;
 	current_animation_ = -1;
 	run_animation_ = false;
 	current_frame_ = 0;
 	loop_back_frame_ = 0;
+	fading_ = false;
+	fade_time_ = 0;
+	fade_duration_ = 0;
+	animation_updated_ = false;
+	collected_ = false;
+	culled = false;
+	tint = glm::vec4(1.f);
+	world_min_ = world_max_ = glm::vec3(0.f);
+	//Bounds of an empty model until loaded
+	scene_min = scene_max = scene_center = glm::vec3(0.f);
+	lod_frame_ = 0;
+	lod_interval_ = 0;
+	lod_blending_ = false;
+	last_samples_ = 0;
+
+	model_ = Model::acquire(model, aiOptions, loader);
+
+	if(model_->ready())
+		init_instance();
+}
 
-	scene = aiImportFile( model.c_str(), 
-		aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-		aiProcess_JoinIdenticalVertices |  
-		aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph  |
-		aiProcess_ImproveCacheLocality | aiProcess_GenUVCoords |
-		aiProcess_ValidateDataStructure | aiProcess_FixInfacingNormals |
-		aiProcess_CalcTangentSpace | aiOptions
-		);
-
-	if(scene != 0) {
-		printf("Loaded model %s: \nMeshes: %d\nTextures: %d\nMaterials: %d\nAnimations: %d\n",model.c_str(), scene->mNumMeshes, scene->mNumTextures, scene->mNumMaterials, scene->mNumAnimations);
-
-		//Get bounds:
-		aiVector3D s_min, s_max;
-		get_bounding_box(&s_min, &s_max);
-		scene_min = glm::make_vec3((float*)&s_min);
-		scene_max = glm::make_vec3((float*)&s_max);
-		scene_center  = (scene_min+scene_max)/2.0f;
-
-		//Calculate normalization matrix
-		glutil::MatrixStack normMatrix;
-		if(normalize_scale) {
-			glm::vec3 size = scene_max - scene_min;
-			float tmp = aisgl_max(size.x, size.y);
-			tmp = aisgl_max(tmp, size.z);
-			normMatrix.Scale(1.f/tmp);
-		}
-		normMatrix.Translate(-scene_center.x, -scene_center.y, -scene_center.z);
-		
-		normalization_matrix_ = normMatrix.Top();
+void RenderObject::init_instance() {
+	materials = model_->materials;
+	//References of its own, so changed materials don't free the slots of the model
+	for(std::vector<material_t>::iterator it=materials.begin(); it!=materials.end(); ++it) {
+		it->index = MaterialBuffer::add(it->attr);
+	}
 
-		pre_render();
-/*
-		if(scene->HasAnimations()) {
-			printf("Animation data:\n");
-			for(unsigned int i=0; i < scene->mNumAnimations; ++i) {
-				aiAnimation * anim = scene->mAnimations[i];
-				printf("Name: %s, Bone Channels: %d, Mesh channels: %d, tps: %f, duration: %f\n", anim->mName.data, anim->mNumChannels, anim->mNumMeshChannels, anim->mTicksPerSecond, anim->mDuration);
-				for(unsigned int n=0; n<anim->mNumChannels; ++n) {
-					aiNodeAnim * na = anim->mChannels[n];
-					printf("nodeAnim: Node name: %s, position keys: %d, rotation keys: %d, scaling keys: %d\n", na->mNodeName.data, na->mNumPositionKeys, na->mNumRotationKeys, na->mNumScalingKeys);
-				}
-			}
-		}
-*/
-	} else {
-		printf("Failed to load model %s\n", model.c_str());
+	scene_min = model_->scene_min;
+	scene_max = model_->scene_max;
+	scene_center  = (scene_min+scene_max)/2.0f;
+
+	//Calculate normalization matrix
+	glutil::MatrixStack normMatrix;
+	if(normalize_scale_) {
+		glm::vec3 size = scene_max - scene_min;
+		float tmp = aisgl_max(size.x, size.y);
+		tmp = aisgl_max(tmp, size.z);
+		normMatrix.Scale(1.f/tmp);
 	}
+	normMatrix.Translate(-scene_center.x, -scene_center.y, -scene_center.z);
+	
+	normalization_matrix_ = normMatrix.Top();
+
+	ready_ = true;
+}
+
+bool RenderObject::ready() {
+	//The model may have finished loading since last time
+	if(!ready_ && model_->ready())
+		init_instance();
+	return ready_;
+}
+
+bool RenderObject::failed() const {
+	return model_->failed();
 }
 
 void RenderObject::run_animation(double dt) {
 	if(current_animation_ != -1) {
-		double tps = scene->mAnimations[current_animation_]->mTicksPerSecond;
+		double tps = model_->animations[current_animation_].ticks_per_second;
 		tps = (tps == 0) ? 50.0 : tps;
 		current_frame_ += tps*dt;
 		if(current_frame_ >= end_frame_) {
@@ -131,16 +154,17 @@ void RenderObject::run_animation(double dt) {
 }
 
 bool RenderObject::start_animation(unsigned int anim, double start_frame, double end_frame, anim_end_behaviour_t end_behaviour) {
-	if(!scene->HasAnimations() || anim >= scene->mNumAnimations) 
+	if(anim >= model_->animations.size()) 
 		return false;
 	current_animation_ = anim;
 	run_animation_ = true;
+	cursors_.assign(model_->animations[anim].channels.size(), channel_cursor_t());
 	if(start_frame != -1) {
 		current_frame_ = start_frame;
 		loop_back_frame_ = start_frame;
 	}
 	if(end_frame == -1)
-		end_frame_ = scene->mAnimations[current_animation_]->mDuration;
+		end_frame_ = model_->animations[current_animation_].duration;
 	else
 		end_frame_ = end_frame;
 
@@ -148,6 +172,52 @@ bool RenderObject::start_animation(unsigned int anim, double start_frame, double
 	return true;
 }
 
+bool RenderObject::crossfade_animation(unsigned int anim, double fade_time, double start_frame, double end_frame, anim_end_behaviour_t end_behaviour) {
+	if(anim >= model_->animations.size())
+		return false;
+
+	fade_ = clip_state_t();
+	if(run_animation_) {
+		fade_.animation = current_animation_;
+		fade_.frame = current_frame_;
+		fade_.cursors.swap(cursors_);
+	}
+	fading_ = fade_time > 0;
+	fade_time_ = 0;
+	fade_duration_ = fade_time;
+
+	return start_animation(anim, start_frame, end_frame, end_behaviour);
+}
+
+int RenderObject::add_layer(unsigned int anim, float weight) {
+	if(anim >= model_->animations.size())
+		return -1;
+
+	//Reuse a removed layer
+	unsigned int layer = 0;
+	while(layer < layers_.size() && layers_[layer].animation != -1)
+		++layer;
+	if(layer == layers_.size())
+		layers_.push_back(clip_state_t());
+
+	clip_state_t &clip = layers_[layer];
+	clip.animation = anim;
+	clip.frame = 0;
+	clip.weight = weight;
+	clip.cursors.assign(model_->animations[anim].channels.size(), channel_cursor_t());
+	return layer;
+}
+
+void RenderObject::set_layer_weight(unsigned int layer, float weight) {
+	if(layer < layers_.size())
+		layers_[layer].weight = weight;
+}
+
+void RenderObject::remove_layer(unsigned int layer) {
+	if(layer < layers_.size())
+		layers_[layer] = clip_state_t();
+}
+
 bool RenderObject::stop_animation(double end_frame, double stop_frame) {
 	if(!run_animation_)
 		return false;
@@ -172,422 +242,530 @@ bool RenderObject::stop_animation(double end_frame, double stop_frame) {
 	return true;
 }
 
-Texture * RenderObject::load_texture(std::string path) {
-	size_t last_slash = path.rfind("/");
-	if(last_slash != std::string::npos) 
-		path = path.substr(last_slash+1);
-	std::string full_path = std::string("textures/")+path;
-	return new Texture(full_path);
-}
+/*
+ * Moves cursor to the last key at or before t (0 if t is before the first key)
+ * and returns the blend factor towards the key after it.
+ * Steps forward from the cursor during normal playback, seeks and loops fall back to a binary search.
+ */
+static float seek_key(const std::vector<float> &times, float t, unsigned int &cursor) {
+	unsigned int last = times.size() - 1;
+	if(cursor > last || times[cursor] > t) {
+		cursor = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+		cursor = (cursor > 0) ? cursor - 1 : 0;
+	} else {
+		unsigned int steps = 0;
+		while(cursor < last && times[cursor+1] <= t) {
+			if(++steps > ANIM_CURSOR_MAX_STEPS) {
+				cursor = std::upper_bound(times.begin() + cursor, times.end(), t) - times.begin() - 1;
+				break;
+			}
+			++cursor;
+		}
+	}
 
-void RenderObject::pre_render() {
+	if(cursor == last || t <= times[cursor])
+		return 0.f;
+	return std::min((t - times[cursor]) / (times[cursor+1] - times[cursor]), 1.f);
+}
 
-	recursive_pre_render(scene->mRootNode);
+void RenderObject::sample(const animation_t &anim, unsigned int channel, float t, channel_cursor_t &cursor, transform_t &out) {
+	const node_anim_t &na = anim.channels[channel];
+	float blend;
+	unsigned int k;
 
+	blend = seek_key(na.position.times, t, cursor.position);
+	k = cursor.position;
+	out.translation = (blend > 0.f) ? glm::mix(na.position.values[k], na.position.values[k+1], blend) : na.position.values[k];
 
-	//Init materials:
-	for(unsigned int i= 0; i < scene->mNumMaterials; ++i) {
-		const aiMaterial * mtl = scene->mMaterials[i];
-		material_t mtl_data;
-		aiString path;
-		if(mtl->GetTextureCount(aiTextureType_DIFFUSE) > 0 && 
-			mtl->GetTexture(aiTextureType_DIFFUSE, 0, &path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-			std::string p(path.data);
-			mtl_data.texture = load_texture(p);
-			mtl_data.attr.use_texture = 1;//toggle textures on
-		} else if(mtl->GetTextureCount(aiTextureType_AMBIENT) > 0 && 
-			mtl->GetTexture(aiTextureType_AMBIENT, 0, &path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-			std::string p(path.data);
-			mtl_data.texture = load_texture(p);
-			mtl_data.attr.use_texture = 1;//toggle textures on
-		} else {
-			mtl_data.attr.use_texture = 0; //toggle textures off
-		}
-	
-		//Check for normalmap:
-		if(mtl->GetTextureCount(aiTextureType_HEIGHT) > 0 && 
-			mtl->GetTexture(aiTextureType_HEIGHT, 0, &path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-			std::string p(path.data);
-			mtl_data.normal_map = load_texture(p);
-			mtl_data.attr.use_normal_map = 1;
-			printf("Using normal map: %s\n", p.c_str());
-		} else {
-			mtl_data.attr.use_normal_map = 0;
-		}
+	blend = seek_key(na.rotation.times, t, cursor.rotation);
+	k = cursor.rotation;
+	out.rotation = ClipCompression::unpack_quat(&na.rotation.values[4*k]);
+	if(blend > 0.f)
+		out.rotation = ClipCompression::slerp(out.rotation, ClipCompression::unpack_quat(&na.rotation.values[4*(k+1)]), blend);
 
-		aiString name;
-		mtl->Get(AI_MATKEY_NAME, name);
-
-		aiColor4D diffuse;
-		aiColor4D specular;
-		aiColor4D ambient;
-		aiColor4D emission;	
-		mtl_data.attr.diffuse = glm::vec4( 0.8f, 0.8f, 0.8f, 1.0f);
-		if(AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_DIFFUSE, &diffuse))
-			color4_to_vec4(&diffuse, mtl_data.attr.diffuse);
-
-		mtl_data.attr.specular = glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f);
-		if(AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_SPECULAR, &specular))
-			color4_to_vec4(&specular, mtl_data.attr.specular);
-
-		mtl_data.attr.ambient = glm::vec4( 0.2f, 0.2f, 0.2f, 1.0f);
-		if(AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_AMBIENT, &ambient))
-			color4_to_vec4(&ambient, mtl_data.attr.ambient);
-
-		mtl_data.attr.emission = glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f);
-		if(AI_SUCCESS == aiGetMaterialColor(mtl, AI_MATKEY_COLOR_EMISSIVE, &emission))
-			color4_to_vec4(&emission, mtl_data.attr.emission);
-
-		unsigned int max = 1;
-		float strength;
-		int ret1 = aiGetMaterialFloatArray(mtl, AI_MATKEY_SHININESS, &mtl_data.attr.shininess, &max);
-		if(ret1 == AI_SUCCESS) {
-			max = 1;
-			int ret2 = aiGetMaterialFloatArray(mtl, AI_MATKEY_SHININESS_STRENGTH, &strength, &max);
-			if(ret2 == AI_SUCCESS)
-				mtl_data.attr.shininess *= strength;
-		} else {
-			mtl_data.attr.shininess = 0.0f;
-			mtl_data.attr.specular = glm::vec4(0.f, 0.f, 0.f, 0.f);
-		}
-		max = 1;
-		int two_sided;
-		if((AI_SUCCESS == aiGetMaterialIntegerArray(mtl, AI_MATKEY_TWOSIDED, &two_sided, &max)) && two_sided)
-			mtl_data.two_sided = true;
+	blend = seek_key(na.scaling.times, t, cursor.scaling);
+	k = cursor.scaling;
+	out.scaling = (blend > 0.f) ? glm::mix(na.scaling.values[k], na.scaling.values[k+1], blend) : na.scaling.values[k];
+}
 
-		materials.push_back(mtl_data);
-	}
+glm::mat4 RenderObject::transform_t::matrix() const {
+	glm::mat4 m = glm::translate(glm::mat4(1.f), translation);
+	m *= glm::mat4_cast(rotation);
+	return glm::scale(m, scaling);
+}
 
+RenderObject::transform_t RenderObject::transform_t::mix(const transform_t &a, const transform_t &b, float w) {
+	transform_t t;
+	t.translation = glm::mix(a.translation, b.translation, w);
+	t.rotation = ClipCompression::slerp(a.rotation, b.rotation, w);
+	t.scaling = glm::mix(a.scaling, b.scaling, w);
+	return t;
 }
 
-void RenderObject::recursive_pre_render(const aiNode* node) {
-	const aiVector3D zero_3d(0.0f,0.0f,0.0f);
+RenderObject::transform_t RenderObject::transform_t::from_matrix(const glm::mat4 &m) {
+	transform_t t;
+	t.translation = glm::vec3(m[3]);
+	t.scaling = glm::vec3(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2])));
 
-	node_data_t nd;
-	nd.name = node->mName;
-	//Find animation:
+	glm::mat3 rotation(glm::vec3(m[0]) / t.scaling.x, glm::vec3(m[1]) / t.scaling.y, glm::vec3(m[2]) / t.scaling.z);
+	//A mirrored node, keep the rotation a rotation and put the mirroring in the scale
+	if(glm::determinant(rotation) < 0.f) {
+		t.scaling.x = -t.scaling.x;
+		rotation[0] = -rotation[0];
+	}
+	t.rotation = glm::quat_cast(rotation);
+	return t;
+}
 
-	if(scene->HasAnimations()) {
-		nd.animations = new aiNodeAnim*[scene->mNumAnimations];
-		for(unsigned int i=0; i < scene->mNumAnimations; ++i) {
-			nd.animations[i] = NULL;
-			aiAnimation * anim = scene->mAnimations[i];
-			for(unsigned int n=0; n<anim->mNumChannels; ++n) {
-				aiNodeAnim * na = anim->mChannels[n];
-				if(na->mNodeName == node->mName) {
-					nd.animations[i] = na;
-					break;
-				}
-			}
+void RenderObject::advance_clip(clip_state_t &clip, double dt) {
+	const animation_t &anim = model_->animations[clip.animation];
+	double tps = (anim.ticks_per_second == 0) ? 50.0 : anim.ticks_per_second;
+	clip.frame += tps*dt;
+	if(clip.frame >= anim.duration)
+		clip.frame = (anim.duration > 0) ? fmod(clip.frame, anim.duration) : 0;
+}
 
+void RenderObject::run_blends(double dt) {
+	if(fading_) {
+		fade_time_ += dt;
+		if(fade_time_ >= fade_duration_) {
+			fading_ = false;
+			fade_ = clip_state_t();
+		} else if(fade_.animation != -1) {
+			advance_clip(fade_, dt);
 		}
-	} else {
-		nd.animations = NULL;
 	}
-	for(unsigned int i=0; i<node->mNumMeshes; ++i) {
-		const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		mesh_data_t md;
-
-		md.mtl_index = mesh->mMaterialIndex;
-
-		std::vector<vertex_t> vertexData;
-		std::vector<unsigned int> indexData;
-
-		for(unsigned int n = 0; n<mesh->mNumVertices; ++n) {
-			const aiVector3D* pos = &(mesh->mVertices[n]);
-			const aiVector3D* texCoord = mesh->HasTextureCoords(0) ? &(mesh->mTextureCoords[0][n]) : &zero_3d;
-			const aiVector3D* normal = &(mesh->mNormals[n]);
-			const aiVector3D* tangent, *bitangent;
-			if(mesh->HasTangentsAndBitangents()) {
-				tangent = &(mesh->mTangents[n]);
-				bitangent= &(mesh->mBitangents[n]);
-			} else {
-				tangent = &zero_3d;
-				bitangent = &zero_3d;
-			}
-			if(!mesh->HasNormals())
-				normal = &zero_3d;
-			vertexData.push_back(vertex_t(pos, texCoord, normal, tangent, bitangent));
+
+	for(std::vector<clip_state_t>::iterator it=layers_.begin(); it!=layers_.end(); ++it) {
+		if(it->animation != -1)
+			advance_clip(*it, dt);
+	}
+}
+
+/*
+ * Samples the current animation, and only when they are active the animation faded from and the layers.
+ */
+unsigned int RenderObject::update_pose() {
+	const std::vector<transform_t> &rest = model_->rest_pose;
+	unsigned int num_nodes = model_->nodes.size();
+
+	const animation_t * base = run_animation_ ? &model_->animations[current_animation_] : NULL;
+	const animation_t * from = (fading_ && fade_.animation != -1) ? &model_->animations[fade_.animation] : NULL;
+	float fade = fading_ ? fade_time_ / fade_duration_ : 1.f;
+
+	unsigned int samples = 0;
+	pose_.resize(num_nodes);
+	posed_.assign(num_nodes, 0);
+	for(unsigned int i=0; i < num_nodes; ++i) {
+		transform_t &p = pose_[i];
+
+		int channel = (base != NULL) ? base->node_channels[i] : -1;
+		if(channel != -1) {
+			sample(*base, channel, current_frame_, cursors_[channel], p);
+			++samples;
+			posed_[i] = 1;
 		}
 
-		for(unsigned int n = 0 ; n<mesh->mNumFaces; ++n) {
-			const aiFace* face = &mesh->mFaces[n];
-			assert(face->mNumIndices == 3);
-			md.num_indices+=3;
+		if(fading_) {
+			int from_channel = (from != NULL) ? from->node_channels[i] : -1;
+			//Nothing to blend if neither side moves the node
+			if(from_channel != -1 || posed_[i]) {
+				transform_t f;
+				if(from_channel != -1) {
+					sample(*from, from_channel, fade_.frame, fade_.cursors[from_channel], f);
+					++samples;
+				} else {
+					f = rest[i];
+				}
+				if(!posed_[i])
+					p = rest[i];
 
-			for(unsigned int j = 0; j< face->mNumIndices; ++j) {
-				int index = face->mIndices[j];
-				indexData.push_back(index);
+				p = transform_t::mix(f, p, fade);
+				posed_[i] = 1;
 			}
 		}
 
-		glGenBuffers(1, &md.vb);
+		for(std::vector<clip_state_t>::iterator it=layers_.begin(); it!=layers_.end(); ++it) {
+			if(it->animation == -1 || it->weight <= 0.f)
+				continue;
+			const animation_t &anim = model_->animations[it->animation];
+			int layer_channel = anim.node_channels[i];
+			if(layer_channel == -1)
+				continue;
+
+			transform_t l;
+			sample(anim, layer_channel, it->frame, it->cursors[layer_channel], l);
+			++samples;
+			if(!posed_[i])
+				p = rest[i];
+
+			//Add the layer's difference from the rest pose
+			const transform_t &r = rest[i];
+			p.translation += (l.translation - r.translation) * it->weight;
+			glm::fquat delta = l.rotation * glm::conjugate(r.rotation);
+			p.rotation = ClipCompression::slerp(glm::fquat(), delta, it->weight) * p.rotation;
+			p.scaling *= glm::mix(glm::vec3(1.f), l.scaling / r.scaling, it->weight);
+			posed_[i] = 1;
+		}
+	}
+	return samples;
+}
 
-		glBindBuffer(GL_ARRAY_BUFFER, md.vb);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_t)*vertexData.size(), &vertexData.front(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+void RenderObject::update_lod_pose(unsigned int interval) {
+	const std::vector<transform_t> &rest = model_->rest_pose;
+	unsigned int num_nodes = model_->nodes.size();
 
-		glGenBuffers(1, &md.ib);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, md.ib);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indexData.size(), &indexData.front(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	if(lod_frame_ >= lod_interval_) {
+		//Start the next blend from what is on screen now
+		bool first = pose_.empty();
+		if(lod_blending_) {
+			lod_from_ = lod_shown_;
+			lod_from_posed_ = lod_shown_posed_;
+		} else {
+			lod_from_ = pose_;
+			lod_from_posed_ = posed_;
+		}
 
-		mesh_data[mesh] = md;
+		last_samples_ = update_pose();
+		update_stats_.samples = last_samples_;
+		if(first) {
+			lod_from_ = pose_;
+			lod_from_posed_ = posed_;
+		}
+		lod_frame_ = 0;
+		lod_interval_ = interval;
+	} else {
+		update_stats_.skipped_samples = last_samples_;
 	}
 
-	node_data_[node] = nd;
+	++lod_frame_;
+	float w = lod_frame_ / (float)lod_interval_;
 
-	for(unsigned int i=0; i<node->mNumChildren; ++i) {
-		recursive_pre_render(node->mChildren[i]);
+	lod_shown_.resize(num_nodes);
+	lod_shown_posed_.resize(num_nodes);
+	for(unsigned int i=0; i < num_nodes; ++i) {
+		lod_shown_posed_[i] = lod_from_posed_[i] || posed_[i];
+		if(lod_shown_posed_[i]) {
+			lod_shown_[i] = transform_t::mix(lod_from_posed_[i] ? lod_from_[i] : rest[i],
+				posed_[i] ? pose_[i] : rest[i], w);
+		}
 	}
+	lod_blending_ = true;
 }
 
-void RenderObject::recursive_render(const aiNode* node, double dt, Renderer * renderer) {
-	renderer->modelMatrix.Push();
-	
-	node_data_t nd = node_data_[node];
-
-	//Run animation or apply default transform
-	if(run_animation_ && nd.animations !=NULL && nd.animations[current_animation_] != NULL) {
-		aiNodeAnim * na = nd.animations[current_animation_];
-		int next_keyframe;
-	
-		//Translation:
-			//Find next keyframe:
-			next_keyframe = na->mNumPositionKeys-1;
-			for(unsigned int i=0; i< na->mNumPositionKeys; ++i) {
-				if(na->mPositionKeys[i].mTime > current_frame_) {
-					next_keyframe = i;
-					break;
-				}
-			}
-			glm::vec3 translation; //Translation to apply
-			if(next_keyframe == 0) {
-				//no keyframe before this one
-				translation = glm::make_vec3((float*)&na->mPositionKeys[next_keyframe].mValue);
-			} else {
-				glm::vec3 prev, next;
-				float blend; 
-				aiVectorKey &k_prev = na->mPositionKeys[next_keyframe-1];
-				aiVectorKey &k_next = na->mPositionKeys[next_keyframe];
-				prev = glm::make_vec3((float*)&k_prev.mValue);
-				next = glm::make_vec3((float*)&k_next.mValue);
-				float interval = k_next.mTime - k_prev.mTime;
-				float pos = current_frame_ - k_prev.mTime;
-				blend = pos/interval;
-				blend = std::min(blend, 1.f);
-				translation = glm::mix(prev, next, blend);
-			}
-			renderer->modelMatrix.Translate(translation);
-
-		//Rotation
-			//Find next keyframe:
-			next_keyframe = na->mNumRotationKeys-1;
-			for(unsigned int i=0; i<na->mNumRotationKeys; ++i) {
-				if(na->mRotationKeys[i].mTime > current_frame_) {
-					next_keyframe = i;
-					break;
-				}
-			}
-			aiQuaternion rotation; //Rotation to apply
-			if(next_keyframe == 0) {
-				//no keyframe before this one
-				rotation = na->mRotationKeys[next_keyframe].mValue;
-			} else {
-				float blend; 
-				aiQuatKey &k_prev = na->mRotationKeys[next_keyframe-1];
-				aiQuatKey &k_next = na->mRotationKeys[next_keyframe];
-				float interval = k_next.mTime - k_prev.mTime;
-				float pos = current_frame_ - k_prev.mTime;
-				blend = pos/interval;
-				blend = std::min(blend, 1.f);
-				aiQuaternion::Interpolate(rotation, k_prev.mValue, k_next.mValue, blend); 
-			}
-			glm::fquat q;
-			q.x = rotation.x;
-			q.y = rotation.y;
-			q.z = rotation.z;
-			q.w = rotation.w;
-			renderer->modelMatrix *= glm::mat4_cast(q);
-
-		//Scaling
-			//Find next keyframe:
-			next_keyframe = na->mNumScalingKeys-1;
-			for(unsigned int i=0; i<na->mNumScalingKeys; ++i) {
-				if(na->mScalingKeys[i].mTime > current_frame_) {
-					next_keyframe = i;
-					break;
-				}
-			}
-			glm::vec3 scaling; //scaling to apply
-			if(next_keyframe == 0) {
-				//no keyframe before this one
-				scaling = glm::make_vec3((float*)&na->mScalingKeys[next_keyframe].mValue);
-			} else {
-				glm::vec3 prev, next;
-				float blend; 
-				aiVectorKey & k_prev = na->mScalingKeys[next_keyframe-1];
-				aiVectorKey & k_next = na->mScalingKeys[next_keyframe];
-				prev = glm::make_vec3((float*)&k_prev.mValue);
-				next = glm::make_vec3((float*)&k_next.mValue);
-				float interval = k_next.mTime - k_prev.mTime;
-				float pos = current_frame_ - k_prev.mTime;
-				blend = pos/interval;
-				blend = std::min(blend, 1.f);
-				scaling = glm::mix(prev, next, blend);
-			}
-			renderer->modelMatrix.Scale(scaling);
-	} else {
-		aiMatrix4x4 m = node->mTransformation; 	
-		aiTransposeMatrix4(&m);
-		renderer->modelMatrix *= glm::make_mat4((float*)&m);
+/*
+ * Nodes are stored with parents before children, so the matrices are
+ * calculated front to back without recursion or lookups.
+ */
+void RenderObject::update_node_matrices(const std::vector<transform_t> &pose, const std::vector<char> &posed) {
+	const std::vector<node_t> &nodes = model_->nodes;
+	node_matrices_.resize(nodes.size());
+	for(unsigned int i=0; i < nodes.size(); ++i) {
+		const node_t &node = nodes[i];
+		glm::mat4 local = posed[i] ? pose[i].matrix() : node.transformation;
+
+		if(node.parent < 0)
+			node_matrices_[i] = local;
+		else
+			node_matrices_[i] = node_matrices_[node.parent] * local;
 	}
+}
 
-	renderer->upload_model_matrices();
-
-	for(unsigned int i=0; i<node->mNumMeshes; ++i) {
-		const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-
-		if(mesh->mNumFaces > 0) {
-			mesh_data_t *md = &mesh_data[mesh];
-
-			glBindBuffer(GL_ARRAY_BUFFER, md->vb);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, md->ib);
-			glEnableVertexAttribArray(0);
-			glEnableVertexAttribArray(1);
-			glEnableVertexAttribArray(2);
-			glEnableVertexAttribArray(3);
-			glEnableVertexAttribArray(4);
-
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), 0);
-			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)));
-			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (sizeof(glm::vec3)+sizeof(glm::vec2)));
-			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (2*sizeof(glm::vec3)+sizeof(glm::vec2)));
-			glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const GLvoid*) (3*sizeof(glm::vec3)+sizeof(glm::vec2)));
-
-			materials[md->mtl_index].activate(renderer);
-			Renderer::checkForGLErrors("RenderObject::activate material");
-
-			glDrawElements(GL_TRIANGLES, md->num_indices, GL_UNSIGNED_INT,0 );
-			Renderer::checkForGLErrors("RenderObject::render()");
-
-			materials[md->mtl_index].deactivate(renderer);
+void RenderObject::update_animation(double dt, unsigned int interval) {
+	update_stats_ = anim_update_stats_t();
+	//Set up by ready() on the GL thread, this runs on the workers
+	if(!ready_)
+		return;
 
-			glDisableVertexAttribArray(4);
-			glDisableVertexAttribArray(3);
-			glDisableVertexAttribArray(2);
-			glDisableVertexAttribArray(1);
-			glDisableVertexAttribArray(0);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-		}
+	if(run_animation_)
+		run_animation(dt);
+	run_blends(dt);
+	animation_updated_ = true;
+
+	//The matrices must have been calculated once before the pose can be left alone
+	bool first = node_matrices_.size() != model_->nodes.size();
+	if(interval == ANIM_LOD_OFF_SCREEN && !first) {
+		update_stats_.skipped_samples = last_samples_;
+		//Sample as soon as the object is visible again
+		lod_frame_ = lod_interval_;
+		return;
 	}
 
-	for(unsigned int i=0; i<node->mNumChildren; ++i) {
-		recursive_render(node->mChildren[i], dt, renderer);
+	if(interval <= 1) {
+		last_samples_ = update_pose();
+		update_stats_.samples = last_samples_;
+		lod_frame_ = lod_interval_ = 0;
+		lod_blending_ = false;
+		update_node_matrices(pose_, posed_);
+	} else {
+		update_lod_pose(interval);
+		update_node_matrices(lod_shown_, lod_shown_posed_);
 	}
+	update_palettes();
+	skin_meshes();
+	update_stats_.nodes = model_->nodes.size();
+}
 
-	renderer->modelMatrix.Pop();
+unsigned int RenderObject::animation_update_interval(float screen_size) const {
+	if(screen_size < 0.f)
+		return ANIM_LOD_OFF_SCREEN;
+	for(unsigned int i=0; i < ANIM_LOD_LEVELS; ++i) {
+		if(screen_size >= anim_lod[i].screen_size)
+			return anim_lod[i].interval;
+	}
+	return anim_lod[ANIM_LOD_LEVELS - 1].interval;
 }
 
 void RenderObject::render(double dt, Renderer * renderer) {
 
-	if(run_animation_)
-		run_animation(dt);
-
-	glUseProgram(renderer->shaders[shader_program_].program);
-
-	renderer->modelMatrix.Push();
-	renderer->modelMatrix.ApplyMatrix(matrix());
+	if(!ready())
+		return;
 
-	recursive_render(scene->mRootNode, dt, renderer);		
+	if(culled) {
+		animation_updated_ = false;
+		collected_ = false;
+		return;
+	}
 
-	renderer->modelMatrix.Pop();
+	if(!animation_updated_) {
+		double start = monotonic_seconds();
+		update_animation(dt);
+		Renderer::stats.nodes += update_stats_.nodes;
+		Renderer::stats.channel_samples += update_stats_.samples;
+		Renderer::stats.skinned_vertices += update_stats_.skinned_vertices;
+		Renderer::stats.skin_time += update_stats_.skin_time;
+		Renderer::stats.node_time += monotonic_seconds() - start;
+	}
+	animation_updated_ = false;
 
-	glUseProgram(0);
-}
+	for(std::vector<material_t>::iterator it=materials.begin(); it!=materials.end(); ++it) {
+		if(!MaterialBuffer::matches(it->index, it->attr))
+			it->index = MaterialBuffer::update(it->index, it->attr);
+	}
 
-const glm::mat4 RenderObject::matrix() const {
-	return RenderGroup::matrix() * normalization_matrix_;
-}
+	//The matrix of objects outside the renderer's list isn't known, they only have their meshes culled by the gpu
+	bool cull_meshes = collected_ && renderer->frustum_culling;
+	collected_ = false;
 
-void RenderObject::material_t::activate(Renderer * renderer) {
-	if(two_sided && renderer->cull_face)
-		glDisable(GL_CULL_FACE);
-	
+	glm::mat4 group_matrix = renderer->modelMatrix.Top() * RenderGroup::matrix();
 
-	if(attr.use_texture) {
-		glActiveTexture(GL_TEXTURE0);
-		texture->bind();
+	if(instances.empty()) {
+		queue_meshes(group_matrix * normalization_matrix_, world_matrix_, tint, cull_meshes, renderer);
+		return;
 	}
-	
-	if(attr.use_normal_map) {
-		glActiveTexture(GL_TEXTURE1);
-		normal_map->bind();
+
+	for(std::vector<instance_t>::const_iterator it=instances.begin(); it!=instances.end(); ++it) {
+		glm::mat4 local = it->transform * normalization_matrix_;
+		if(cull_meshes) {
+			glm::vec3 min, max;
+			Frustum::transform_box(world_group_matrix_ * local, scene_min, scene_max, min, max);
+			if(!renderer->frustum().intersects_box(min, max)) {
+				++Renderer::stats.culled_instances;
+				continue;
+			}
+		}
+		queue_meshes(group_matrix * local, world_group_matrix_ * local, tint * it->tint, cull_meshes, renderer);
 	}
+}
 
-	//Upload material attributes to shader
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.materialBuffer);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Shader::material_t), &attr);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+void RenderObject::queue_meshes(const glm::mat4 &object_matrix, const glm::mat4 &world_matrix, const glm::vec4 &tint, bool cull_meshes, Renderer * renderer) {
+	const glm::mat4 * palette = palettes_.empty() ? NULL : &palettes_.front();
+	const std::vector<node_t> &nodes = model_->nodes;
+	for(unsigned int i=0; i < nodes.size(); ++i) {
+		const node_t &node = nodes[i];
+		if(node.num_meshes == 0)
+			continue;
+
+		glm::mat4 mesh_matrix = object_matrix * node_matrices_[i];
+
+		for(unsigned int n=node.first_mesh; n < node.first_mesh + node.num_meshes; ++n) {
+			const mesh_data_t *md = &model_->meshes[model_->node_meshes[n]];
+
+			//Skinned meshes move away from their bounds, the object bounds were tested instead
+			bool visible = true;
+			if(cull_meshes && md->num_bones == 0 && md->buffer->num_indices > 0) {
+				glm::vec3 min, max;
+				Frustum::transform_box(world_matrix * node_matrices_[i], md->bounds_min, md->bounds_max, min, max);
+				visible = renderer->frustum().intersects_box(min, max);
+				if(!visible)
+					++Renderer::stats.culled_meshes;
+			}
 
+			if(visible && md->buffer->num_indices > 0) {
+				RenderQueue::packet_t packet;
+				packet.shader = (md->num_bones > 0 && md->skin == NULL) ? Renderer::SKINNED_SHADER : shader_program_;
+				packet.model_matrix = mesh_matrix;
+				packet.material = &materials[md->mtl_index];
+				packet.buffer = (md->num_bones > 0) ? NULL : md->buffer;
+				packet.object = this;
+				packet.mesh = model_->node_meshes[n];
+				packet.palette = palette;
+				packet.tint = tint;
+
+				glm::vec3 center = glm::vec3(mesh_matrix * glm::vec4((md->bounds_min + md->bounds_max) * 0.5f, 1.f));
+				renderer->render_queue->push(packet, renderer->normalized_depth(center));
+			}
+			palette += md->num_bones;
+		}
+	}
 }
 
-void RenderObject::material_t::deactivate(Renderer * renderer) {
-	if(two_sided && renderer->cull_face)
-		glEnable(GL_CULL_FACE);
-
-	if(attr.use_texture) {
-		glActiveTexture(GL_TEXTURE0);
-		texture->unbind();
+/*
+ * Bone matrices relative to the node each mesh is drawn at,
+ * that node's matrix is already applied to the model matrix.
+ */
+void RenderObject::update_palettes() {
+	palettes_.clear();
+
+	const std::vector<node_t> &nodes = model_->nodes;
+	for(unsigned int i=0; i < nodes.size(); ++i) {
+		const node_t &node = nodes[i];
+		bool skinned = false;
+		glm::mat4 mesh_inverse;
+
+		for(unsigned int n=node.first_mesh; n < node.first_mesh + node.num_meshes; ++n) {
+			const mesh_data_t &md = model_->meshes[model_->node_meshes[n]];
+			if(md.num_bones == 0)
+				continue;
+
+			if(!skinned) {
+				mesh_inverse = glm::inverse(node_matrices_[i]);
+				skinned = true;
+			}
+			for(unsigned int b=0; b < md.num_bones; ++b) {
+				const bone_t &bone = model_->bones[md.first_bone + b];
+				palettes_.push_back(mesh_inverse * node_matrices_[bone.node] * bone.offset);
+			}
+		}
 	}
-	
-	if(attr.use_normal_map) {
-		glActiveTexture(GL_TEXTURE1);
-		normal_map->unbind();
+}
+
+void RenderObject::skin_meshes() {
+	const glm::mat4 * palette = palettes_.empty() ? NULL : &palettes_.front();
+	const std::vector<node_t> &nodes = model_->nodes;
+	for(unsigned int i=0; i < nodes.size(); ++i) {
+		const node_t &node = nodes[i];
+		for(unsigned int n=node.first_mesh; n < node.first_mesh + node.num_meshes; ++n) {
+			unsigned int mesh = model_->node_meshes[n];
+			const mesh_data_t &md = model_->meshes[mesh];
+			if(md.skin != NULL) {
+				double start = monotonic_seconds();
+				if(cpu_skins_.size() < model_->meshes.size())
+					cpu_skins_.resize(model_->meshes.size(), NULL);
+				cpu_skin_t *&cs = cpu_skins_[mesh];
+				if(cs == NULL) {
+					cs = new cpu_skin_t();
+					cs->vertices.resize(md.skin->positions.size());
+				}
+				Skinning::skin(*md.skin, palette, &cs->vertices.front(), 0, cs->vertices.size());
+				cs->uploaded = false;
+				update_stats_.skinned_vertices += cs->vertices.size();
+				update_stats_.skin_time += monotonic_seconds() - start;
+			}
+			palette += md.num_bones;
+		}
 	}
 }
 
+/*
+ * Called by RenderQueue::submit with the program, material and model matrix set up,
+ * the SKINNED_SHADER program for GPU_SKINNING
+ */
+void RenderObject::draw_skinned(unsigned int mesh, const glm::mat4 * palette, Renderer * renderer) {
+	const mesh_data_t &md = model_->meshes[mesh];
+
+	if(md.skin == NULL) {
+		//GPU_SKINNING
+		Skinning::upload_palette(palette, md.num_bones);
+		BufferArena::draw(md.buffer);
+		return;
+	}
 
-void RenderObject::get_bounding_box_for_node (const struct aiNode* nd, 
-	struct aiVector3D* min, 
-	struct aiVector3D* max, 
-	struct aiMatrix4x4* trafo){
+	//Skinned by skin_meshes() during the animation update
+	cpu_skin_t * cs = cpu_skins_[mesh];
+	if(cs->vao == 0)
+		create_cpu_skin_buffers(mesh, palette, renderer);
+
+	if(!cs->uploaded) {
+		//Orphan the old contents instead of waiting for the last draw to finish with them
+		size_t size = cs->vertices.size()*sizeof(Skinning::vertex_t);
+		GLState::bind_buffer(GL_ARRAY_BUFFER, cs->vb);
+		render_device()->buffer_data(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+		render_device()->buffer_sub_data(GL_ARRAY_BUFFER, 0, size, &cs->vertices.front());
+		cs->uploaded = true;
+	}
 
-	struct aiMatrix4x4 prev;
-	unsigned int n = 0, t;
-	prev = *trafo;
-	aiMultiplyMatrix4(trafo,&nd->mTransformation);
+	GLState::bind_vertex_array(cs->vao);
+	render_device()->draw_elements(GL_TRIANGLES, md.skin->indices.size(), GL_UNSIGNED_INT, 0);
+}
 
-	for (; n < nd->mNumMeshes; ++n) {
-		const struct aiMesh* mesh = scene->mMeshes[nd->mMeshes[n]];
-		for (t = 0; t < mesh->mNumVertices; ++t) {
-			struct aiVector3D tmp = mesh->mVertices[t];
-			aiTransformVecByMatrix4(&tmp,trafo);
+void RenderObject::create_cpu_skin_buffers(unsigned int mesh, const glm::mat4 * palette, Renderer * renderer) {
+	const Skinning::source_t &skin = *model_->meshes[mesh].skin;
+	cpu_skin_t * cs = cpu_skins_[mesh];
+
+	render_device()->gen_buffers(1, &cs->vb);
+	render_device()->gen_buffers(1, &cs->ib);
+	render_device()->gen_vertex_arrays(1, &cs->vao);
+
+	GLState::bind_vertex_array(cs->vao);
+	GLState::bind_buffer(GL_ARRAY_BUFFER, cs->vb);
+	render_device()->buffer_data(GL_ARRAY_BUFFER, cs->vertices.size()*sizeof(Skinning::vertex_t), NULL, GL_STREAM_DRAW);
+	Skinning::set_attrib_pointers();
+	GLState::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, cs->ib);
+	render_device()->buffer_data(GL_ELEMENT_ARRAY_BUFFER, skin.indices.size()*sizeof(unsigned int), &skin.indices.front(), GL_STATIC_DRAW);
+	Renderer::checkForGLErrors("RenderObject::create_cpu_skin_buffers()");
+
+	if(renderer->print_stats) {
+		//The reference does the same math as the skinned shader
+		printf("Skinning %s mesh %u: cpu skinning differs from the reference by %g\n",
+			name.c_str(), mesh, Skinning::compare(skin, palette));
+	}
+}
 
-			min->x = aisgl_min(min->x,tmp.x);
-			min->y = aisgl_min(min->y,tmp.y);
-			min->z = aisgl_min(min->z,tmp.z);
+const glm::mat4 RenderObject::matrix() const {
+	return RenderGroup::matrix() * normalization_matrix_;
+}
 
-			max->x = aisgl_max(max->x,tmp.x);
-			max->y = aisgl_max(max->y,tmp.y);
-			max->z = aisgl_max(max->z,tmp.z);
+void RenderObject::collect_render_objects(const glm::mat4 &parent, std::vector<RenderObject*> &out) {
+	world_group_matrix_ = parent * RenderGroup::matrix();
+	world_matrix_ = world_group_matrix_ * normalization_matrix_;
+	collected_ = true;
+
+	/*
+	 * The box of the whole model in the rest pose, animations moving
+	 * far outside of it may have the object culled while still visible.
+	 */
+	if(instances.empty()) {
+		Frustum::transform_box(world_matrix_, scene_min, scene_max, world_min_, world_max_);
+	} else {
+		world_min_ = glm::vec3(FLT_MAX);
+		world_max_ = glm::vec3(-FLT_MAX);
+		for(std::vector<instance_t>::const_iterator it=instances.begin(); it!=instances.end(); ++it) {
+			glm::vec3 min, max;
+			Frustum::transform_box(world_group_matrix_ * it->transform * normalization_matrix_, scene_min, scene_max, min, max);
+			world_min_ = glm::min(world_min_, min);
+			world_max_ = glm::max(world_max_, max);
 		}
 	}
 
-	for (n = 0; n < nd->mNumChildren; ++n) {
-		get_bounding_box_for_node(nd->mChildren[n],min,max,trafo);
-	}
-	*trafo = prev;
+	out.push_back(this);
 }
 
+void RenderObject::world_bounds(glm::vec3 &min, glm::vec3 &max) const {
+	min = world_min_;
+	max = world_max_;
+}
 
+glm::vec3 RenderObject::world_center() const {
+	if(!instances.empty())
+		return (world_min_ + world_max_) * 0.5f;
+	return glm::vec3(world_matrix_ * glm::vec4(scene_center, 1.f));
+}
 
-void RenderObject::get_bounding_box (struct aiVector3D* min, struct aiVector3D* max) {
-	struct aiMatrix4x4 trafo;
-	aiIdentityMatrix4(&trafo);
-
-	min->x = min->y = min->z =  1e10f;
-	max->x = max->y = max->z = -1e10f;
-	get_bounding_box_for_node(scene->mRootNode,min,max,&trafo);
+float RenderObject::world_radius() const {
+	if(!instances.empty())
+		return 0.5f * glm::length(world_max_ - world_min_);
+	float scale = std::max(glm::length(glm::vec3(world_matrix_[0])),
+		std::max(glm::length(glm::vec3(world_matrix_[1])), glm::length(glm::vec3(world_matrix_[2]))));
+	return 0.5f * glm::length(scene_max - scene_min) * scale;
 }
@@ -6,13 +6,26 @@
 #include <assimp/aiScene.h>
 #include <map>
 #include <vector>
+#include <stdint.h>
 #include <glload/gl_3_3.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glutil/glutil.h>
 
 #include "renderer.h"
 #include "render_group.h"
 #include "texture.h"
+#include "buffer_arena.h"
+#include "skinning.h"
+
+//Number of entries in RenderObject::anim_lod
+#define ANIM_LOD_LEVELS 3
+
+//Update interval that only advances the animation clocks, returned for objects off screen
+#define ANIM_LOD_OFF_SCREEN 0
+
+class Model; //Forward declaration
+class ModelLoader;
 
 class RenderObject : public RenderGroup {
 public:
@@ -26,18 +39,18 @@ public:
 private:
 	glm::mat4 normalization_matrix_;
 
-	void get_bounding_box_for_node (const struct aiNode* nd,	struct aiVector3D* min, struct aiVector3D* max, struct aiMatrix4x4* trafo);
-	void get_bounding_box (struct aiVector3D* min, struct aiVector3D* max);
-	void color4_to_vec4(const struct aiColor4D *c, glm::vec4 &target);
-
 	//Hide these functions:
 	RenderGroup::operator[];
 	RenderGroup::add_object;
 
 	Renderer::shader_program_t shader_program_;
+	bool normalize_scale_;
+
+	Model * model_; //Shared by all objects using the same file
+	bool ready_;
 
-	//Trims path and loads texture
-	static Texture * load_texture(std::string path);
+	//Sets up materials and bounds from the model, called once the model is ready. GL thread only (MaterialBuffer::add)
+	void init_instance();
 
 	double current_frame_;
 	int current_animation_;
@@ -46,68 +59,210 @@ private:
 	double post_frame_; //Frame to stop at if ANIM_STOP_AT_POST_FRAME is specified
 	double end_frame_;
 	anim_end_behaviour_t anim_end_behaviour_;
-	
-	struct node_data_t {
-		aiNodeAnim ** animations;
-		aiString name;
-	};
-
-	std::map<const aiNode*, node_data_t> node_data_;
 
 	//Updates the current_frame and other animation statuses
 	void run_animation(double dt);
 
 public:
-	const aiScene* scene;
 	glm::vec3 scene_min, scene_max, scene_center;
 	std::string name;
 	double anim_speed;
 
 	struct mesh_data_t {
-		mesh_data_t() : num_indices(0) {};
-		GLuint vb, ib; //vertex buffer, index buffer
-		GLenum draw_mode;
-		unsigned int num_indices;
+		mesh_data_t() : buffer(NULL), first_bone(0), num_bones(0), skin(NULL) {};
+		BufferArena::allocation_t * buffer; //Vertices and indices in the shared buffers
 		unsigned int mtl_index;
+		unsigned int first_bone, num_bones; //Range in Model::bones, no bones if the mesh is not skinned
+		Skinning::source_t * skin; //Bind pose of skinned meshes with CPU_SKINNING, otherwise NULL
+		glm::vec3 bounds_min, bounds_max; //Mesh space, in the bind pose for skinned meshes
+	};
+
+	struct bone_t {
+		int node; //Index in Model::nodes
+		glm::mat4 offset; //From mesh space to the bone's space in the bind pose
+	};
+
+	//Key times (in ticks) and values are kept in separate arrays, the search only touches times
+	struct vector_track_t {
+		std::vector<float> times;
+		std::vector<glm::vec3> values;
+	};
+
+	//Rotations are quantized to 16 bit x, y, z, w (see ClipCompression)
+	struct quat_track_t {
+		std::vector<float> times;
+		std::vector<int16_t> values; //4 per key
+	};
+
+	//Keyframes for one node in one animation
+	struct node_anim_t {
+		vector_track_t position;
+		quat_track_t rotation;
+		vector_track_t scaling;
+	};
+
+	struct animation_t {
+		double duration;
+		double ticks_per_second;
+		std::vector<node_anim_t> channels;
+		std::vector<int> node_channels; //Channel for each node, -1 if the node is not animated
+	};
+
+	/*
+	 * Nodes are stored depth first, so a parent always comes before its children
+	 * and the node matrices can be calculated in one pass.
+	 */
+	struct node_t {
+		int parent; //Index in Model::nodes, -1 for the root
+		unsigned int first_mesh, num_meshes; //Range in Model::node_meshes
+		glm::mat4 transformation;
+	};
+
+	//Local transform of a node split up so poses can be blended
+	struct transform_t {
+		glm::vec3 translation;
+		glm::fquat rotation;
+		glm::vec3 scaling;
+
+		glm::mat4 matrix() const;
+		//Splits m, shear is lost
+		static transform_t from_matrix(const glm::mat4 &m);
+		//a at w=0, b at w=1
+		static transform_t mix(const transform_t &a, const transform_t &b, float w);
 	};
 
+	//Objects at least screen_size (bounding sphere diameter / screen height) tall sample their animation every interval frames
+	struct anim_lod_t {
+		float screen_size;
+		unsigned int interval;
+	};
+	//Ordered from the largest screen size, the last level should have screen_size 0
+	static anim_lod_t anim_lod[ANIM_LOD_LEVELS];
+
+	//Counters from the last update_animation()
+	struct anim_update_stats_t {
+		anim_update_stats_t() : nodes(0), samples(0), skipped_samples(0), skinned_vertices(0), skin_time(0) {};
+		unsigned int nodes; //Node matrices calculated
+		unsigned int samples; //Channels sampled
+		unsigned int skipped_samples; //Channels that would have been sampled without animation lod
+		unsigned int skinned_vertices; //With CPU_SKINNING
+		double skin_time;
+	};
+
+private:
+	//Object space matrix of each node, updated before each render
+	std::vector<glm::mat4> node_matrices_;
+	void update_node_matrices(const std::vector<transform_t> &pose, const std::vector<char> &posed);
+	/*
+	 * Last key used in each track of each channel in the current animation.
+	 * Playback moves forward a key or two per frame, so searching from here is constant time.
+	 */
+	struct channel_cursor_t {
+		channel_cursor_t() : position(0), rotation(0), scaling(0) {};
+		unsigned int position, rotation, scaling;
+	};
+	std::vector<channel_cursor_t> cursors_;
+
+	//Samples channel of anim at frame t
+	static void sample(const animation_t &anim, unsigned int channel, float t, channel_cursor_t &cursor, transform_t &out);
+
+	//A clip played besides the current animation: the one faded out from, or an additive layer
+	struct clip_state_t {
+		clip_state_t() : animation(-1), frame(0), weight(0) {};
+		int animation; //-1 if unused (or fading out from the rest pose)
+		double frame;
+		float weight;
+		std::vector<channel_cursor_t> cursors;
+	};
+
+	clip_state_t fade_;
+	bool fading_;
+	double fade_time_, fade_duration_;
+	std::vector<clip_state_t> layers_;
+
+	//Advances the fade and the layers, they loop over their whole duration
+	void run_blends(double dt);
+	void advance_clip(clip_state_t &clip, double dt);
+
+	/*
+	 * Local transform of each node, evaluated once per frame before the node matrices.
+	 * Nodes not touched by any animation are not posed and use node_t::transformation as is.
+	 */
+	std::vector<transform_t> pose_;
+	std::vector<char> posed_;
+	//Returns the number of channels sampled
+	unsigned int update_pose();
+
+	/*
+	 * Animation lod: with an update interval of n the pose is sampled every n frames,
+	 * the frames in between blend from the pose shown when the sample was taken to the sample.
+	 * The shown pose lags behind by up to n frames but moves smoothly.
+	 */
+	std::vector<transform_t> lod_from_, lod_shown_;
+	std::vector<char> lod_from_posed_, lod_shown_posed_;
+	unsigned int lod_frame_, lod_interval_; //Frames since the last sample, and the interval it was taken with
+	bool lod_blending_; //The last frame showed lod_shown_ instead of pose_
+	unsigned int last_samples_; //Channels sampled the last time the pose was sampled
+	anim_update_stats_t update_stats_;
+	void update_lod_pose(unsigned int interval);
 
+	/*
+	 * Bone matrices of all skinned meshes, one range per mesh in the order they are drawn.
+	 * Written by update_animation(), only read while rendering.
+	 */
+	std::vector<glm::mat4> palettes_;
+	void update_palettes();
+	void draw_skinned(unsigned int mesh, const glm::mat4 * palette, Renderer * renderer);
+	friend class RenderQueue;
+
+	bool animation_updated_; //Set by update_animation(), cleared by render()
+	glm::mat4 world_matrix_; //Set by collect_render_objects()
+	glm::mat4 world_group_matrix_; //world_matrix_ without the normalization, instances are applied after it
+	glm::vec3 world_min_, world_max_; //Bounds of all instances, set by collect_render_objects()
+	bool collected_; //world_matrix_ is up to date this frame, cleared by render()
 
-	struct vertex_t {
-		glm::vec3 pos;
-		glm::vec2 texCoord;
-		glm::vec3 normal;
-		glm::vec3 tangent;
-		glm::vec3 bitangent;
+	//Queues the meshes of the model drawn with object_matrix (world_matrix for culling)
+	void queue_meshes(const glm::mat4 &object_matrix, const glm::mat4 &world_matrix, const glm::vec4 &tint, bool cull_meshes, Renderer * renderer);
 
-		vertex_t(const aiVector3D* pos_,const  aiVector3D* texCoord_,
-					const aiVector3D* normal_, const aiVector3D * tangent_, const aiVector3D * bitangent_) {
-			pos = glm::vec3(pos_->x,pos_->y, pos_->z);
-			texCoord = glm::vec2(texCoord_->x,texCoord_->y);
-			normal = glm::vec3(normal_->x, normal_->y, normal_->z);
-			tangent = glm::vec3(tangent_->x, tangent_->y, tangent_->z);
-			bitangent = glm::vec3(bitangent_->x, bitangent_->y, bitangent_->z);
-		}
+	//Skinned vertices of one mesh with CPU_SKINNING
+	struct cpu_skin_t {
+		cpu_skin_t() : vb(0), ib(0), vao(0), uploaded(false) {};
+		GLuint vb, ib, vao; //0 until the mesh is first drawn
+		std::vector<Skinning::vertex_t> vertices;
+		bool uploaded; //vertices are in vb, cleared when they are skinned again
 	};
+	std::vector<cpu_skin_t*> cpu_skins_; //Per mesh in the model, created when the mesh is first skinned
 
+	/*
+	 * Skins the CPU_SKINNING meshes with this frame's palettes, called by update_animation() so it runs
+	 * on the workers. Drawing only uploads the vertices, once however many times the mesh is drawn.
+	 */
+	void skin_meshes();
+	//Creates the buffers and vao of a mesh the first time it is drawn
+	void create_cpu_skin_buffers(unsigned int mesh, const glm::mat4 * palette, Renderer * renderer);
+
+public:
 	struct material_t {
-		material_t() : two_sided(false), texture(NULL), normal_map(NULL) {};
+		material_t() : two_sided(false), texture(NULL), normal_map(NULL), index(0) {};
 		Shader::material_t attr;
 		bool two_sided;
 		Texture * texture, *normal_map;
-
-		void activate(Renderer * renderer);
-		void deactivate(Renderer * renderer);
+		unsigned int index; //Of attr in MaterialBuffer, updated by render() when attr is changed
 	};
 
-	//Set normalize_scale to false to not scale down to 1.0
-	RenderObject(std::string model, Renderer::shader_program_t shader_program, bool normalize_scale=true, unsigned int aiOptions=0);
+	/*
+	 * Set normalize_scale to false to not scale down to 1.0
+	 * Objects created from the same file share buffers and textures (see Model).
+	 * If loader is given the constructor returns directly and the model is loaded in the background,
+	 * until ready() returns true the object renders as nothing and has no materials or animations.
+	 * If the model fails to load failed() returns true and the object stays that way.
+	 */
+	RenderObject(std::string model, Renderer::shader_program_t shader_program, bool normalize_scale=true, unsigned int aiOptions=0, ModelLoader * loader=NULL);
 	virtual ~RenderObject();
 
+	//Copied from the model, can be changed per object. The textures are owned by the model
 	std::vector<material_t> materials;
 
-	std::map<const aiMesh*, mesh_data_t > mesh_data;
-
 	/*
 	 * If start_frame is -1 the animation will start from the current frame (0 from the begining)
 	 * The frame to loop back to is not changed (0 from the begining)
@@ -121,16 +276,77 @@ public:
 	 * Returns true if an anmiation was running
 	*/
 	bool stop_animation(double end_frame=-1, double set_frame=-2);
+
+	/*
+	 * Starts anim like start_animation, blending from the current pose to it over fade_time seconds.
+	 * The animation faded out from keeps playing (looping) until the fade is done.
+	 */
+	bool crossfade_animation(unsigned int anim, double fade_time, double start_frame=0, double end_frame=-1, anim_end_behaviour_t end_behaviour=ANIM_RESET);
+
+	/*
+	 * Plays anim looping on top of the current pose. The layer adds its difference from the
+	 * rest pose scaled by weight, so it works with any base animation (or none).
+	 * Returns the layer index, or -1 if there is no such animation.
+	 */
+	int add_layer(unsigned int anim, float weight=1.f);
+	void set_layer_weight(unsigned int layer, float weight);
+	void remove_layer(unsigned int layer);
+
 	float current_frame() { return current_frame_; };
 	bool is_animating() { return run_animation_; };
+	//Sets the object up if its model has finished loading, GL thread only (adds materials)
+	bool ready();
+	//ready() without setting anything up, safe from any thread
+	bool is_ready() const { return ready_; };
+	//The model could not be loaded, ready() will never return true
+	bool failed() const;
+
+	/*
+	 * Advances the animations and calculates the node matrices and bone palettes for this frame.
+	 * Touches nothing but this object (and reads its Model), so different objects can be updated
+	 * in parallel. The pose is only sampled every interval frames (see animation_update_interval),
+	 * with ANIM_LOD_OFF_SCREEN only the animation clocks are advanced.
+	 * The Renderer calls this for everything in render_objects before drawing, other objects
+	 * are updated every frame when rendered.
+	 */
+	void update_animation(double dt, unsigned int interval=1);
+	const anim_update_stats_t &update_stats() const { return update_stats_; };
+
+	/*
+	 * Budget hook for animation lod. screen_size is the bounding sphere diameter over the screen
+	 * height, or negative if the object is outside the view. The default picks a level from anim_lod,
+	 * override to keep important objects at full rate or to throttle crowds harder.
+	 */
+	virtual unsigned int animation_update_interval(float screen_size) const;
+
+	//World space bounding sphere and box, valid after collect_render_objects()
+	glm::vec3 world_center() const;
+	float world_radius() const;
+	void world_bounds(glm::vec3 &min, glm::vec3 &max) const;
+
+	//Set by the Renderer each frame, culled objects are not drawn
+	bool culled;
+
+	struct instance_t {
+		instance_t() : tint(1.f) {};
+		instance_t(const glm::mat4 &transform_, const glm::vec4 &tint_=glm::vec4(1.f)) : transform(transform_), tint(tint_) {};
+		glm::mat4 transform; //Applied before the normalization, like the object's own position, rotation and scale
+		glm::vec4 tint;
+	};
+
+	/*
+	 * If not empty the object is drawn once for each instance instead of once.
+	 * All instances share the animation. Instances outside the view are culled one by one,
+	 * the draws of unskinned meshes are merged into instanced draws by the render queue.
+	 */
+	std::vector<instance_t> instances;
+
+	//Multiplies the material colors (and the instance tints)
+	glm::vec4 tint;
 
-	void pre_render();
-	void recursive_pre_render(const aiNode* node);
-	void recursive_render(const aiNode* node, double dt, Renderer * renderer);
 	virtual void render(double dt, Renderer * renderer);
 	virtual const glm::mat4 matrix() const;
-
-	
+	virtual void collect_render_objects(const glm::mat4 &parent, std::vector<RenderObject*> &out);
 };
 
 #endif
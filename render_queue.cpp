@@ -0,0 +1,376 @@
+#include "render_queue.h"
+#include "renderer.h"
+#include "render_object.h"
+#include "texture.h"
+#include "shader.h"
+#include "uniform_ring.h"
+#include "material_buffer.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "render_device.h"
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cstddef>
+#include <cstdio>
+#include <glm/glm.hpp>
+
+//ARB_draw_indirect is newer than the 3.3 headers
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#define RENDER_QUEUE_DEPTH_MAX ((1ull << RENDER_QUEUE_DEPTH_BITS) - 1)
+
+//Width of the state part of the key (shader to material)
+#define RENDER_QUEUE_STATE_BITS 37
+
+RenderQueue::RenderQueue() : instancing(true), multi_draw(true), multi_draw_supported_(false) {
+	reset_instance_attributes();
+
+	//Core in 4.3, the base instance is needed to select the transforms of each command
+	multi_draw_supported_ = Renderer::has_extension("GL_ARB_multi_draw_indirect") && Renderer::has_extension("GL_ARB_base_instance");
+}
+
+uint64_t RenderQueue::make_key(const packet_t &packet, float depth) {
+	const RenderObject::material_t &mtl = *packet.material;
+
+	uint64_t texture = (mtl.attr.use_texture && mtl.texture != NULL) ? mtl.texture->texture() & 0xfff : 0;
+	uint64_t normal_map = (mtl.attr.use_normal_map && mtl.normal_map != NULL) ? mtl.normal_map->texture() & 0xfff : 0;
+	uint64_t state = ((uint64_t)packet.shader & 0xf) << 33
+		| (uint64_t)(mtl.two_sided ? 1 : 0) << 32
+		| texture << 20
+		| normal_map << 8
+		| (mtl.index & 0xff);
+
+	uint64_t d = (uint64_t)(glm::clamp(depth, 0.f, 1.f) * RENDER_QUEUE_DEPTH_MAX);
+
+	if(mtl.attr.diffuse.a < 1.f)
+		return (uint64_t)BLENDED_PASS << 62 | (RENDER_QUEUE_DEPTH_MAX - d) << RENDER_QUEUE_STATE_BITS | state;
+	return (uint64_t)OPAQUE_PASS << 62 | state << RENDER_QUEUE_DEPTH_BITS | d;
+}
+
+void RenderQueue::push(packet_t &packet, float depth) {
+	packet.key = make_key(packet, depth);
+	packets_.push_back(packet);
+}
+
+bool RenderQueue::instanced_shader(Renderer::shader_program_t shader) {
+	return shader == Renderer::NORMAL_SHADER;
+}
+
+void RenderQueue::reset_instance_attributes() {
+	for(int c=0; c < 4; ++c) {
+		glm::vec4 column(0.f);
+		column[c] = 1.f;
+		render_device()->vertex_attrib_4fv(INSTANCE_MATRIX_ATTRIB + c, &column[0]);
+		if(c < 3)
+			render_device()->vertex_attrib_3fv(INSTANCE_NORMAL_MATRIX_ATTRIB + c, &column[0]);
+	}
+	render_device()->vertex_attrib_4f(INSTANCE_TINT_ATTRIB, 1.f, 1.f, 1.f, 1.f);
+}
+
+bool RenderQueue::same_state(const packet_t &a, const packet_t &b) {
+	if(a.buffer == NULL || b.buffer == NULL || a.shader != b.shader || !instanced_shader(a.shader))
+		return false;
+	if((a.key >> 62) != OPAQUE_PASS || (b.key >> 62) != OPAQUE_PASS)
+		return false;
+
+	//The key only has part of the material index and the texture names
+	const RenderObject::material_t &ma = *a.material, &mb = *b.material;
+	return ma.two_sided == mb.two_sided
+		&& (!ma.attr.use_texture || ma.texture == mb.texture)
+		&& (!ma.attr.use_normal_map || ma.normal_map == mb.normal_map)
+		&& ma.index == mb.index;
+}
+
+void RenderQueue::build_draws(bool instancing) {
+	draws_.clear();
+	for(unsigned int i=0; i < order_.size(); ++i) {
+		if(instancing && !draws_.empty()) {
+			draw_t &last = draws_.back();
+			const packet_t &a = packets_[order_[last.first].second], &b = packets_[order_[i].second];
+			if(a.buffer == b.buffer && same_state(a, b)) {
+				++last.count;
+				continue;
+			}
+		}
+		draw_t draw = { i, 1, NO_INSTANCE };
+		draws_.push_back(draw);
+	}
+}
+
+void RenderQueue::build_batches(bool multi_draw) {
+	batches_.clear();
+	for(unsigned int i=0; i < draws_.size(); ++i) {
+		if(multi_draw && !batches_.empty()) {
+			batch_t &last = batches_.back();
+			const packet_t &a = packets_[order_[draws_[last.first].first].second];
+			const packet_t &b = packets_[order_[draws_[i].first].second];
+			if(same_state(a, b) && BufferArena::vao(a.buffer) == BufferArena::vao(b.buffer) && a.buffer->index_type == b.buffer->index_type) {
+				++last.count;
+				continue;
+			}
+		}
+		batch_t batch = { i, 1 };
+		batches_.push_back(batch);
+	}
+}
+
+unsigned int RenderQueue::assign_instances() {
+	unsigned int instances = 0;
+	for(unsigned int b=0; b < batches_.size(); ++b) {
+		const batch_t &batch = batches_[b];
+		for(unsigned int i=batch.first; i < batch.first + batch.count; ++i) {
+			draw_t &draw = draws_[i];
+			if(batch.count > 1 || draw.count > 1) {
+				draw.instance = instances;
+				instances += draw.count;
+			} else {
+				draw.instance = NO_INSTANCE;
+			}
+		}
+	}
+	return instances;
+}
+
+void RenderQueue::set_instance_attributes(GLuint buffer, size_t offset) {
+	const GLsizei stride = sizeof(instance_data_t);
+
+	//The attributes are part of the page's vao, they are set up and disabled again for each draw
+	GLState::bind_buffer(GL_ARRAY_BUFFER, buffer);
+	for(int c=0; c < 4; ++c) {
+		render_device()->vertex_attrib_pointer(INSTANCE_MATRIX_ATTRIB + c, 4, GL_FLOAT, GL_FALSE, stride,
+			(const GLvoid*) (offset + offsetof(instance_data_t, model_matrix) + c*sizeof(glm::vec4)));
+		render_device()->vertex_attrib_divisor(INSTANCE_MATRIX_ATTRIB + c, 1);
+		render_device()->enable_vertex_attrib_array(INSTANCE_MATRIX_ATTRIB + c);
+	}
+	for(int c=0; c < 3; ++c) {
+		render_device()->vertex_attrib_pointer(INSTANCE_NORMAL_MATRIX_ATTRIB + c, 3, GL_FLOAT, GL_FALSE, stride,
+			(const GLvoid*) (offset + offsetof(instance_data_t, normal_matrix) + c*sizeof(glm::vec4)));
+		render_device()->vertex_attrib_divisor(INSTANCE_NORMAL_MATRIX_ATTRIB + c, 1);
+		render_device()->enable_vertex_attrib_array(INSTANCE_NORMAL_MATRIX_ATTRIB + c);
+	}
+	render_device()->vertex_attrib_pointer(INSTANCE_TINT_ATTRIB, 4, GL_FLOAT, GL_FALSE, stride,
+		(const GLvoid*) (offset + offsetof(instance_data_t, tint)));
+	render_device()->vertex_attrib_divisor(INSTANCE_TINT_ATTRIB, 1);
+	render_device()->enable_vertex_attrib_array(INSTANCE_TINT_ATTRIB);
+}
+
+void RenderQueue::clear_instance_attributes() {
+	for(int a=INSTANCE_MATRIX_ATTRIB; a <= INSTANCE_TINT_ATTRIB; ++a) {
+		render_device()->disable_vertex_attrib_array(a);
+	}
+	//The constant values are undefined after drawing from an array
+	reset_instance_attributes();
+}
+
+void RenderQueue::submit(Renderer * renderer) {
+	PROFILE_SCOPE("RenderQueue::submit");
+	PROFILE_GPU("render queue");
+	order_.resize(packets_.size());
+	for(unsigned int i=0; i < packets_.size(); ++i) {
+		order_[i] = std::make_pair(packets_[i].key, i);
+	}
+	//Opaque draws with equal state are sorted on the page and mesh before the depth, so draws that can be merged end up next to each other
+	const std::vector<packet_t> &packets = packets_;
+	std::sort(order_.begin(), order_.end(),
+		[&packets](const std::pair<uint64_t, unsigned int> &a, const std::pair<uint64_t, unsigned int> &b) {
+			uint64_t state_a = a.first >> RENDER_QUEUE_DEPTH_BITS, state_b = b.first >> RENDER_QUEUE_DEPTH_BITS;
+			if(state_a != state_b)
+				return state_a < state_b;
+			const BufferArena::allocation_t * mesh_a = packets[a.second].buffer, * mesh_b = packets[b.second].buffer;
+			if((a.first >> 62) == OPAQUE_PASS && mesh_a != mesh_b) {
+				GLuint vao_a = (mesh_a != NULL) ? BufferArena::vao(mesh_a) : 0;
+				GLuint vao_b = (mesh_b != NULL) ? BufferArena::vao(mesh_b) : 0;
+				if(vao_a != vao_b)
+					return vao_a < vao_b;
+				return std::less<const BufferArena::allocation_t*>()(mesh_a, mesh_b);
+			}
+			return a < b;
+		});
+
+	UniformRing * ring = renderer->transform_ring;
+	build_draws(instancing);
+	build_batches(multi_draw && multi_draw_supported());
+
+	//Per instance data of all instanced draws and multi-draws
+	size_t instance_base = 0;
+	unsigned int num_instances = assign_instances();
+	if(num_instances > 0) {
+		instance_data_t * instance = (instance_data_t*) ring->map(num_instances*sizeof(instance_data_t), instance_base);
+		if(instance != NULL) {
+			for(unsigned int i=0; i < draws_.size(); ++i) {
+				const draw_t &draw = draws_[i];
+				for(unsigned int n=draw.first; draw.instance != NO_INSTANCE && n < draw.first + draw.count; ++n) {
+					const packet_t &p = packets_[order_[n].second];
+					glm::mat4 normal_matrix = Renderer::normal_matrix(p.model_matrix);
+					instance->model_matrix = p.model_matrix;
+					for(int c=0; c < 3; ++c) {
+						instance->normal_matrix[c] = normal_matrix[c];
+					}
+					instance->tint = p.tint;
+					++instance;
+				}
+			}
+			ring->unmap();
+			Renderer::stats.transform_bytes += num_instances*sizeof(instance_data_t);
+		} else {
+			fprintf(stderr, "RenderQueue: %u instances don't fit in the transform ring, drawing them one at a time\n", num_instances);
+			build_draws(false);
+			build_batches(false);
+			assign_instances();
+		}
+	}
+
+	//Commands of the multi-draws
+	size_t command_base = 0;
+	unsigned int num_commands = 0;
+	for(unsigned int b=0; b < batches_.size(); ++b) {
+		if(batches_[b].count > 1)
+			num_commands += batches_[b].count;
+	}
+	if(num_commands > 0) {
+		indirect_command_t * command = (indirect_command_t*) ring->map(num_commands*sizeof(indirect_command_t), command_base);
+		if(command != NULL) {
+			for(unsigned int b=0; b < batches_.size(); ++b) {
+				const batch_t &batch = batches_[b];
+				for(unsigned int i=batch.first; batch.count > 1 && i < batch.first + batch.count; ++i) {
+					const draw_t &draw = draws_[i];
+					const BufferArena::allocation_t * mesh = packets_[order_[draw.first].second].buffer;
+					size_t index_size = (mesh->index_type == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+					command->count = mesh->num_indices;
+					command->instance_count = draw.count;
+					command->first_index = mesh->index_offset / index_size;
+					command->base_vertex = mesh->base_vertex;
+					command->base_instance = draw.instance;
+					++command;
+				}
+			}
+			ring->unmap();
+			Renderer::stats.transform_bytes += num_commands*sizeof(indirect_command_t);
+		} else {
+			//The instance data stays, the draws of the batches read it one by one
+			fprintf(stderr, "RenderQueue: %u multi-draw commands don't fit in the transform ring, drawing them one at a time\n", num_commands);
+			num_commands = 0;
+		}
+	}
+
+	//Write the Matrices block of every call before drawing, each call then binds its range
+	const size_t block_size = 3*sizeof(glm::mat4);
+	size_t slot_size = ring->aligned_size(block_size);
+	size_t base = 0;
+	char * slots = (char*) ring->map(slot_size*draws_.size(), base);
+	if(slots != NULL) {
+		const glm::mat4 &projection_view = renderer->projectionViewMatrix.Top();
+		for(unsigned int i=0; i < draws_.size(); ++i) {
+			const draw_t &draw = draws_[i];
+			const packet_t &p = packets_[order_[draw.first].second];
+			glm::mat4 * block = (glm::mat4*) (slots + i*slot_size);
+			block[0] = projection_view;
+			if(draw.instance == NO_INSTANCE) {
+				block[1] = p.model_matrix;
+				block[2] = Renderer::normal_matrix(p.model_matrix);
+			} else {
+				//The instance attributes carry the whole transform
+				block[1] = glm::mat4(1.f);
+				block[2] = glm::mat4(1.f);
+			}
+		}
+		ring->unmap();
+		Renderer::stats.transform_bytes += slot_size*draws_.size();
+	} else if(!draws_.empty()) {
+		fprintf(stderr, "RenderQueue: %lu draws don't fit in the transform ring, uploading them one at a time\n", draws_.size());
+	}
+
+	//Particle systems turn depth writes off
+	GLState::depth_mask(true);
+
+	glm::vec4 tint(1.f);
+	size_t command_offset = command_base;
+
+	for(unsigned int b=0; b < batches_.size(); ++b) {
+		const batch_t &batch = batches_[b];
+		const packet_t &p = packets_[order_[draws_[batch.first].first].second];
+		const RenderObject::material_t &mtl = *p.material;
+
+		if(GLState::use_program(renderer->shaders[p.shader].program))
+			++Renderer::stats.program_switches;
+
+		GLState::set(GL_CULL_FACE, renderer->cull_face && !mtl.two_sided);
+
+		//Shaders ignore the texture units the material doesn't use, so whatever is bound can stay
+		if(mtl.attr.use_texture && mtl.texture->bind(0))
+			++Renderer::stats.texture_binds;
+		if(mtl.attr.use_normal_map && mtl.normal_map->bind(1))
+			++Renderer::stats.texture_binds;
+
+		if(MaterialBuffer::bind(mtl.index))
+			++Renderer::stats.material_binds;
+
+		if(batch.count > 1 && num_commands > 0) {
+			//All draws of the batch have identity Matrices blocks
+			if(slots != NULL)
+				GLState::bind_buffer_range(GL_UNIFORM_BUFFER, Shader::MATRICES_BLOCK_INDEX, ring->buffer(), base + batch.first*slot_size, block_size);
+			else
+				renderer->upload_model_matrices(glm::mat4(1.f));
+
+			BufferArena::bind(p.buffer);
+			set_instance_attributes(ring->buffer(), instance_base);
+			GLState::bind_buffer(GL_DRAW_INDIRECT_BUFFER, ring->buffer());
+			render_device()->multi_draw_elements_indirect(GL_TRIANGLES, p.buffer->index_type, (const GLvoid*) command_offset, batch.count, 0);
+			clear_instance_attributes();
+
+			command_offset += batch.count*sizeof(indirect_command_t);
+			tint = glm::vec4(1.f);
+			++Renderer::stats.draw_calls;
+			++Renderer::stats.multi_draws;
+			Renderer::stats.multi_draw_commands += batch.count;
+			Renderer::checkForGLErrors("RenderQueue::submit() multi-draw");
+			continue;
+		}
+
+		for(unsigned int i=batch.first; i < batch.first + batch.count; ++i) {
+			const draw_t &draw = draws_[i];
+			const packet_t &dp = packets_[order_[draw.first].second];
+
+			if(slots != NULL)
+				GLState::bind_buffer_range(GL_UNIFORM_BUFFER, Shader::MATRICES_BLOCK_INDEX, ring->buffer(), base + i*slot_size, block_size);
+			else
+				renderer->upload_model_matrices(draw.instance == NO_INSTANCE ? dp.model_matrix : glm::mat4(1.f));
+
+			if(draw.instance != NO_INSTANCE) {
+				BufferArena::bind(dp.buffer);
+				set_instance_attributes(ring->buffer(), instance_base + draw.instance*sizeof(instance_data_t));
+				BufferArena::draw_instanced(dp.buffer, draw.count);
+				clear_instance_attributes();
+				tint = glm::vec4(1.f);
+				if(draw.count > 1) {
+					++Renderer::stats.instanced_draws;
+					Renderer::stats.instances += draw.count;
+				}
+			} else {
+				if(dp.tint != tint) {
+					render_device()->vertex_attrib_4fv(INSTANCE_TINT_ATTRIB, &dp.tint[0]);
+					tint = dp.tint;
+				}
+				if(dp.buffer != NULL)
+					BufferArena::draw(dp.buffer);
+				else
+					dp.object->draw_skinned(dp.mesh, dp.palette, renderer);
+			}
+			++Renderer::stats.draw_calls;
+			Renderer::checkForGLErrors("RenderQueue::submit()");
+		}
+	}
+
+	//Two sided materials turned culling off, the rest of the scene uses the renderer's setting
+	GLState::set(GL_CULL_FACE, renderer->cull_face);
+	//The tint is a constant attribute, not part of any vao, and everything else draws white
+	if(tint != glm::vec4(1.f))
+		reset_instance_attributes();
+
+	Renderer::stats.queued_draws += packets_.size();
+	packets_.clear();
+}
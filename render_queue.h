@@ -0,0 +1,148 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "renderer.h"
+#include "render_object.h"
+#include "buffer_arena.h"
+
+//Precision of the depth in the sort key
+#define RENDER_QUEUE_DEPTH_BITS 24
+
+/*
+ * Per instance vertex attributes of instanced draws, after the PackedVertex attributes.
+ * Outside instanced draws they are constant: identity matrices and the tint of the draw.
+ */
+#define INSTANCE_MATRIX_ATTRIB 6 //mat4, locations 6 to 9
+#define INSTANCE_NORMAL_MATRIX_ATTRIB 10 //mat3, locations 10 to 12
+#define INSTANCE_TINT_ATTRIB 13
+
+/*
+ * Draws of RenderObject meshes, sorted to change as little GL state as possible.
+ *
+ * RenderObjects push one packet per mesh while the scene is traversed, submit() sorts them on a
+ * 64 bit key and draws them. Program, textures, face culling and the range of the MaterialBuffer
+ * bound to the Material block are set through GLState, so only the ones that differ from the
+ * previous draw reach GL.
+ *
+ * Key layout, from the most significant bit:
+ *	opaque:  pass (2) | shader (4) | two sided (1) | texture (12) | normal map (12) | material index (8) | depth (24)
+ *	blended: pass (2) | inverted depth (24) | shader (4) | two sided (1) | texture (12) | normal map (12) | material index (8)
+ * Opaque draws are grouped by state, then by buffer page and mesh, and front to back within a mesh
+ * (for early depth rejection). Blended draws (diffuse alpha below 1) come after them back to front.
+ *
+ * Within a state group opaque draws of the same unskinned mesh are merged into one
+ * glDrawElementsInstancedBaseVertex, if the shader reads the instance attributes
+ * (see instanced_shader). The model matrix, normal matrix and tint of each draw go to the
+ * transform ring as vertex attributes with divisor 1.
+ *
+ * With ARB_multi_draw_indirect and ARB_base_instance the draws of a state group that are in the
+ * same buffer page are submitted with one glMultiDrawElementsIndirect. Each command reads its
+ * transforms through the instance attributes, its base instance selects them (in place of a draw id).
+ * Without the extensions, or with multi_draw off, each draw is its own call.
+ */
+class RenderQueue {
+public:
+	enum pass_t {
+		OPAQUE_PASS = 0,
+		BLENDED_PASS = 1
+	};
+
+	struct packet_t {
+		uint64_t key;
+		Renderer::shader_program_t shader;
+		glm::mat4 model_matrix;
+		const RenderObject::material_t * material;
+		const BufferArena::allocation_t * buffer; //NULL for skinned meshes
+		//Skinned meshes are drawn by the object
+		RenderObject * object;
+		unsigned int mesh;
+		const glm::mat4 * palette;
+		glm::vec4 tint; //Multiplies the material color
+	};
+
+	RenderQueue();
+
+	/*
+	 * Adds a draw, key is set from the packet. depth is the distance from the camera
+	 * in [0, 1] (see Renderer::normalized_depth)
+	 */
+	void push(packet_t &packet, float depth);
+
+	//Draws and clears all packets
+	void submit(Renderer * renderer);
+
+	unsigned int size() const { return packets_.size(); };
+
+	static uint64_t make_key(const packet_t &packet, float depth);
+
+	//Shaders that read the instance attributes (standard.vert)
+	static bool instanced_shader(Renderer::shader_program_t shader);
+
+	//Sets the instance attributes to their constant values (identity matrices and white)
+	static void reset_instance_attributes();
+
+	//Merge draws of the same mesh into instanced draws
+	bool instancing;
+	//Merge draws with the same state into multi-draws, if supported
+	bool multi_draw;
+	bool multi_draw_supported() const { return multi_draw_supported_; };
+
+private:
+	//Copy not allowed (no body implemented, intentional!)
+	RenderQueue(const RenderQueue &other);
+
+	//Layout of the instance attributes in the transform ring
+	struct instance_data_t {
+		glm::mat4 model_matrix;
+		glm::vec4 normal_matrix[3]; //mat3 columns, w unused
+		glm::vec4 tint;
+	};
+
+	//Same layout as DrawElementsIndirectCommand
+	struct indirect_command_t {
+		GLuint count;
+		GLuint instance_count;
+		GLuint first_index;
+		GLint base_vertex;
+		GLuint base_instance;
+	};
+
+	//Consecutive entries in order_ drawn as one mesh (instanced if count > 1)
+	struct draw_t {
+		unsigned int first, count;
+		unsigned int instance; //First instance in the instance data, NO_INSTANCE if drawn without
+	};
+	static const unsigned int NO_INSTANCE = ~0u;
+
+	//Consecutive entries in draws_ submitted with one call (a multi-draw if count > 1)
+	struct batch_t {
+		unsigned int first, count;
+	};
+
+	//Unskinned opaque draws with the same state, that can be drawn in one call
+	static bool same_state(const packet_t &a, const packet_t &b);
+	//Splits order_ into draws_, merging packets of the same mesh if instancing is true
+	void build_draws(bool instancing);
+	//Splits draws_ into batches_, merging draws in the same page if multi_draw is true
+	void build_batches(bool multi_draw);
+	//Numbers the draws that read instance attributes, returns the number of instances
+	unsigned int assign_instances();
+
+	//Points the instance attributes of the bound vao at buffer, offset is the first instance
+	static void set_instance_attributes(GLuint buffer, size_t offset);
+	static void clear_instance_attributes();
+
+	bool multi_draw_supported_;
+
+	std::vector<packet_t> packets_;
+	std::vector<std::pair<uint64_t, unsigned int> > order_; //Key and index in packets_
+	std::vector<draw_t> draws_;
+	std::vector<batch_t> batches_;
+};
+
+#endif
@@ -8,16 +8,33 @@
 #include "skybox.h"
 
 #include "texture.h"
+#include "model_loader.h"
+#include "buffer_arena.h"
+#include "model.h"
+#include "skinning.h"
+#include "thread_pool.h"
+#include "render_queue.h"
+#include "material_buffer.h"
+#include "uniform_ring.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "headless.h"
+#include "gl_device.h"
+#include "null_device.h"
+#include "util.h"
+#include "render_device.h"
 
 #include <glload/gll.hpp>
 #include <glload/gl_3_3.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glutil/MatrixStack.h>
 #include <vector>
 #include <cstdio>
+#include <cstring>
 #include <algorithm>
+#include <sys/time.h>
 #include <SDL/SDL.h>
-#include <GL/glu.h>
 
 std::string Renderer::shader_files_[] = {
 	"standard",
@@ -25,117 +42,145 @@ std::string Renderer::shader_files_[] = {
 	"terrain",
 	"water",
 	"particles",
-	"debug"
+	"debug",
+	"skinned"
 };
 
+Renderer::render_stats_t Renderer::stats;
+HeadlessContext * Renderer::headless_ = NULL;
+RenderDevice * RenderDevice::current = NULL;
+
 void Renderer::load_shader_uniform_location(shader_program_t shader, std::string uniform_name) {
-	shaders[shader].uniform[uniform_name] = glGetUniformLocation(shaders[shader].program, uniform_name.c_str());
+	shaders[shader].uniform[uniform_name] = render_device()->get_uniform_location(shaders[shader].program, uniform_name.c_str());
 	checkForGLErrors((std::string("load uniform ")+uniform_name+" from shader "+shaders[shader].name).c_str());
 }
 
 void Renderer::init_shader(Shader &shader) {
 
 	//Local uniforms
-	shader.texture1 = glGetUniformLocation(shader.program, "tex1");
+	shader.texture1 = render_device()->get_uniform_location(shader.program, "tex1");
 
-	shader.texture2 = glGetUniformLocation(shader.program, "tex2");
-	shader.texture_array1 = glGetUniformLocation(shader.program, "tex_array1");
-	shader.texture_array2 = glGetUniformLocation(shader.program, "tex_array2");
-	shader.skybox = glGetUniformLocation(shader.program, "skybox");
+	shader.texture2 = render_device()->get_uniform_location(shader.program, "tex2");
+	shader.texture_array1 = render_device()->get_uniform_location(shader.program, "tex_array1");
+	shader.texture_array2 = render_device()->get_uniform_location(shader.program, "tex_array2");
+	shader.skybox = render_device()->get_uniform_location(shader.program, "skybox");
 
 	checkForGLErrors((std::string("init shader: local uniforms ")+shader.name).c_str());
 
 	//Global uniforms
-	shader.Matrices = glGetUniformBlockIndex(shader.program, "Matrices");
-	shader.LightsData = glGetUniformBlockIndex(shader.program, "LightsData");
-	shader.Material = glGetUniformBlockIndex(shader.program, "Material");
-	shader.Camera = glGetUniformBlockIndex(shader.program, "Camera");
+	shader.Matrices = render_device()->get_uniform_block_index(shader.program, "Matrices");
+	shader.LightsData = render_device()->get_uniform_block_index(shader.program, "LightsData");
+	shader.Material = render_device()->get_uniform_block_index(shader.program, "Material");
+	shader.Camera = render_device()->get_uniform_block_index(shader.program, "Camera");
+	shader.Bones = render_device()->get_uniform_block_index(shader.program, "Bones");
 
 	checkForGLErrors((std::string("init shader: global uniforms ")+shader.name).c_str());
 
 	//Bind to blocks
 	if(shader.Matrices!=-1) {
-		glUniformBlockBinding(shader.program, shader.Matrices, Shader::MATRICES_BLOCK_INDEX);
+		render_device()->uniform_block_binding(shader.program, shader.Matrices, Shader::MATRICES_BLOCK_INDEX);
 		checkForGLErrors((std::string("init shader: bind uniform block MATRICES in ")+shader.name).c_str());
 	} else {
 		printf("Not binding global Matrices for %s, probably not used\n", shader.name.c_str());
 	}
 
 	if(shader.LightsData!=-1) {
-		glUniformBlockBinding(shader.program, shader.LightsData, Shader::LIGHTS_DATA_BLOCK_INDEX);
+		render_device()->uniform_block_binding(shader.program, shader.LightsData, Shader::LIGHTS_DATA_BLOCK_INDEX);
 		checkForGLErrors((std::string("init shader: bind uniform block LIGHTS in ")+shader.name).c_str());
 	} else {
 		printf("Not binding global LightsData for %s, probably not used\n", shader.name.c_str());
 	}
 
 	if(shader.Material!=-1) {
-		glUniformBlockBinding(shader.program, shader.Material, Shader::MATERIAL_BLOCK_INDEX);
+		render_device()->uniform_block_binding(shader.program, shader.Material, Shader::MATERIAL_BLOCK_INDEX);
 		checkForGLErrors((std::string("init shader: bind uniform block MATERIAL in ")+shader.name).c_str());
 	} else {
 		printf("Not binding global Material for %s, probably not used\n", shader.name.c_str());
 	}
 
 	if(shader.Camera!=-1) {
-		glUniformBlockBinding(shader.program, shader.Camera, Shader::CAMERA_BLOCK_INDEX);
+		render_device()->uniform_block_binding(shader.program, shader.Camera, Shader::CAMERA_BLOCK_INDEX);
 		checkForGLErrors((std::string("init shader: bind uniform block CAMERA in ")+shader.name).c_str());
 	} else {
 		printf("Not binding global Camera for %s, probably not used\n", shader.name.c_str());
 	}
 
+	if(shader.Bones!=-1) {
+		render_device()->uniform_block_binding(shader.program, shader.Bones, Shader::BONES_BLOCK_INDEX);
+		checkForGLErrors((std::string("init shader: bind uniform block BONES in ")+shader.name).c_str());
+	}
+
+	GLValidation::label(GL_PROGRAM, shader.program, shader.name);
+
 	//Bind texture
-	glUseProgram(shader.program);
+	GLState::use_program(shader.program);
 	if(shader.texture1!=-1) {
-		glUniform1i(shader.texture1, 0);
+		render_device()->uniform_1i(shader.texture1, 0);
 	} else {
 		printf("texture1 not used in %s\n", shader.name.c_str());
 	}
 	if(shader.texture2!=-1) {
-		glUniform1i(shader.texture2, 1);
+		render_device()->uniform_1i(shader.texture2, 1);
 	} else {
 		printf("texture2 not used in %s\n", shader.name.c_str());
 	}
 	if(shader.texture_array1!=-1) {
-		glUniform1i(shader.texture_array1, 0);
+		render_device()->uniform_1i(shader.texture_array1, 0);
 	} else {
 		printf("texture_array1 not used in %s\n", shader.name.c_str());
 	}
 	if(shader.texture_array2!=-1) {
-		glUniform1i(shader.texture_array2, 1);
+		render_device()->uniform_1i(shader.texture_array2, 1);
 	} else {
 		printf("texture_array2 not used in %s\n", shader.name.c_str());
 	}
 	if(shader.skybox!=-1) {
-		glUniform1i(shader.skybox, 2);
+		render_device()->uniform_1i(shader.skybox, 2);
 	} else {
 		printf("skybox texture not used in %s\n", shader.name.c_str());
 	}
-	glUseProgram(0);
 
 	checkForGLErrors((std::string("init shader: bind textures")+shader.name).c_str());
 }
 
-Renderer::Renderer(int w, int h, bool fullscreen) {
-	float zNear = 1.0f;
-	float zFar = 10000.0f;
+Renderer::Renderer(int w, int h, bool fullscreen, context_t context) {
+	zNear = 1.0f;
+	zFar = 10000.0f;
 	ambient_intensity = glm::vec3(0.1f,0.1f,0.1f);
 
 	skybox_texture = NULL;
+	print_stats = false;
+	animation_lod = true;
+	frustum_culling = true;
+	stats_time_ = 0;
 
 	width_ = w;
 	height_ = h;
 
 	camera.set_position(glm::vec3(0.0, 0.0, 0.0));
 
-  	/* create window */
-  	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK);
-	int flags = SDL_OPENGL | SDL_DOUBLEBUF;
-	if ( fullscreen ) flags |= SDL_FULLSCREEN;
-	SDL_SetVideoMode(w, h, 0, flags);
-	SDL_WM_SetCaption("Game menu","Game menu");
-
-	glload::LoadFunctions();
+	if(context == HEADLESS_CONTEXT) {
+		headless_ = new HeadlessContext(w, h);
+	} else if(context == WINDOW_CONTEXT) {
+		/* create window */
+		SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK);
+		int flags = SDL_OPENGL | SDL_DOUBLEBUF;
+		if ( fullscreen ) flags |= SDL_FULLSCREEN;
+		SDL_SetVideoMode(w, h, 0, flags);
+		SDL_WM_SetCaption("Game menu","Game menu");
+	}
 
-	checkForGLErrors("render init");
+	if(context == NO_CONTEXT) {
+		RenderDevice::current = new NullDevice();
+	} else {
+		glload::LoadFunctions();
+		RenderDevice::current = new GLDevice();
+	}
+	GLState::invalidate();
+	if(headless_ != NULL)
+		headless_->create_framebuffer();
+	GLValidation::init();
+	Profiler::init();
 
 	//Load shaders:
 	for(int i=0;i<NUM_SHADERS; ++i) {
@@ -144,71 +189,81 @@ Renderer::Renderer(int w, int h, bool fullscreen) {
 		init_shader(shaders[i]);
 	}
 
-	glActiveTexture(GL_TEXTURE0);
-
 	//Setup uniform buffers
-	glGenBuffers(sizeof(Shader::globals_t)/sizeof(GLuint), (GLuint*)&Shader::globals);
+	render_device()->gen_buffers(sizeof(Shader::globals_t)/sizeof(GLuint), (GLuint*)&Shader::globals);
 
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.matricesBuffer);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::mat4)*3, NULL, GL_STREAM_DRAW);
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.matricesBuffer);
+	render_device()->buffer_data(GL_UNIFORM_BUFFER, sizeof(glm::mat4)*3, NULL, GL_STREAM_DRAW);
 
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.lightsBuffer);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(Shader::lights_data_t), NULL, GL_STREAM_DRAW);
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.lightsBuffer);
+	render_device()->buffer_data(GL_UNIFORM_BUFFER, sizeof(Shader::lights_data_t), NULL, GL_STREAM_DRAW);
 
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.materialBuffer);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(Shader::material_t), NULL, GL_STREAM_DRAW);
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.cameraBuffer);
+	render_device()->buffer_data(GL_UNIFORM_BUFFER, sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
 
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.cameraBuffer);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.bonesBuffer);
+	render_device()->buffer_data(GL_UNIFORM_BUFFER, sizeof(glm::mat4)*SKIN_MAX_BONES, NULL, GL_STREAM_DRAW);
 
-	//Bind buffers to blocks:
-	glBindBufferRange(GL_UNIFORM_BUFFER, Shader::MATRICES_BLOCK_INDEX, Shader::globals.matricesBuffer, 0, sizeof(glm::mat4)*2);
-	glBindBufferRange(GL_UNIFORM_BUFFER, Shader::LIGHTS_DATA_BLOCK_INDEX, Shader::globals.lightsBuffer, 0, sizeof(Shader::lights_data_t));
-	glBindBufferRange(GL_UNIFORM_BUFFER, Shader::MATERIAL_BLOCK_INDEX, Shader::globals.materialBuffer, 0, sizeof(Shader::material_t));
-	glBindBufferRange(GL_UNIFORM_BUFFER, Shader::CAMERA_BLOCK_INDEX, Shader::globals.cameraBuffer, 0, sizeof(glm::vec4));
+	MaterialBuffer::init();
 
-	//Generate skybox buffers:
+	GLValidation::label(GL_BUFFER, Shader::globals.matricesBuffer, "Matrices");
+	GLValidation::label(GL_BUFFER, Shader::globals.lightsBuffer, "LightsData");
+	GLValidation::label(GL_BUFFER, Shader::globals.materialBuffer, "Material");
+	GLValidation::label(GL_BUFFER, Shader::globals.cameraBuffer, "Camera");
+	GLValidation::label(GL_BUFFER, Shader::globals.bonesBuffer, "Bones");
 
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	//Bind buffers to blocks:
+	bind_matrices_block();
+	GLState::bind_buffer_range(GL_UNIFORM_BUFFER, Shader::LIGHTS_DATA_BLOCK_INDEX, Shader::globals.lightsBuffer, 0, sizeof(Shader::lights_data_t));
+	MaterialBuffer::bind(0);
+	GLState::bind_buffer_range(GL_UNIFORM_BUFFER, Shader::CAMERA_BLOCK_INDEX, Shader::globals.cameraBuffer, 0, sizeof(glm::vec4));
+	GLState::bind_buffer_range(GL_UNIFORM_BUFFER, Shader::BONES_BLOCK_INDEX, Shader::globals.bonesBuffer, 0, sizeof(glm::mat4)*SKIN_MAX_BONES);
 
-	glGenBuffers(1, &skybox_buffer_);
-	glBindBuffer(GL_ARRAY_BUFFER, skybox_buffer_);
+	//Generate skybox buffers:
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxData), skyboxData, GL_STATIC_DRAW);
+	render_device()->gen_buffers(1, &skybox_buffer_);
+	GLState::bind_buffer(GL_ARRAY_BUFFER, skybox_buffer_);
 
+	render_device()->buffer_data(GL_ARRAY_BUFFER, sizeof(skyboxData), skyboxData, GL_STATIC_DRAW);
 
-	glUseProgram(0);
+	render_device()->gen_vertex_arrays(1, &skybox_vao_);
+	GLState::bind_vertex_array(skybox_vao_);
+	render_device()->enable_vertex_attrib_array(0);
+	render_device()->enable_vertex_attrib_array(1);
+	render_device()->vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	render_device()->vertex_attrib_pointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)(sizeof(float)*3*36) );
 
 	/* setup opengl */
-	glClearColor(0.2f, 0.1f, 0.2f, 0.0f);
+	render_device()->clear_color(0.2f, 0.1f, 0.2f, 0.0f);
 
 	//Setup view (this may be moved to reshape)
 	projectionViewMatrix.Perspective(45.0f, w/(float)h, zNear, zFar);
-	glViewport(0, 0, w, h);
+	render_device()->viewport(0, 0, w, h);
 
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
-	glFrontFace(GL_CCW);
+	render_device()->cull_face(GL_BACK);
+	render_device()->front_face(GL_CCW);
 
 	//Face culling disabled per default:
-	glDisable(GL_CULL_FACE);
+	GLState::set(GL_CULL_FACE, false);
 	cull_face = false;
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthMask(GL_TRUE);
-	glDepthFunc(GL_LEQUAL);
-	glDepthRange(0.0f, 1.0f);
-	glEnable(GL_DEPTH_CLAMP);
+	GLState::set(GL_DEPTH_TEST, true);
+	GLState::depth_mask(true);
+	render_device()->depth_func(GL_LEQUAL);
+	render_device()->depth_range(0.0f, 1.0f);
+	GLState::set(GL_DEPTH_CLAMP, true);
 
-	glEnable (GL_BLEND); 
-	glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::set(GL_BLEND, true);
+	GLState::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	checkForGLErrors("init(): ");
+	GLValidation::check_pass("Renderer::Renderer()");
 
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	model_loader = new ModelLoader();
+	workers = new ThreadPool();
+	render_queue = new RenderQueue();
+	transform_ring = new UniformRing();
+	if(transform_ring->persistent())
+		printf("Using a persistently mapped transform buffer\n");
 }
 
 /**
@@ -224,60 +279,73 @@ void Renderer::load_skybox(std::string skybox_path) {
 		files.push_back(skybox_path+skybox_texture_name[i]);
 	}
 
-	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	GLState::set(GL_TEXTURE_CUBE_MAP_SEAMLESS, true);
 
 	skybox_texture = new Texture(files, true);
 
-	glActiveTexture(GL_TEXTURE2);
-
-	skybox_texture->bind();
+	skybox_texture->bind(2);
 	skybox_texture->set_clamp_params();
-	//skybox_texture->unbind(); - Do not unbind!
 
 }
 
 Renderer::~Renderer() {
 	delete skybox_texture;		
+	delete model_loader;
+	delete workers;
+	delete render_queue;
+	delete transform_ring;
+	GLState::delete_vertex_array(skybox_vao_);
+	GLState::delete_buffer(skybox_buffer_);
+	Profiler::cleanup();
+	delete headless_;
+	headless_ = NULL;
+	delete RenderDevice::current;
+	RenderDevice::current = NULL;
 }
 
-int Renderer::checkForGLErrors( const char *s )
-{
- int errors = 0 ;
+void Renderer::render(double dt){
+	Profiler::next_frame();
+	PROFILE_SCOPE("Renderer::render");
+	PROFILE_GPU("Renderer::render");
+
+	//Finish background loaded models
+	{
+		PROFILE_SCOPE("ModelLoader::upload");
+		model_loader->upload(MODEL_UPLOAD_BUDGET);
+	}
+	GLValidation::check_pass("Renderer::render() - upload models");
 
- while ( true )
- {
-	GLenum x = glGetError() ;
+	struct timeval start;
+	gettimeofday(&start, NULL);
 
-	if ( x == GL_NO_ERROR )
-	  return errors ;
+	unsigned int fence_waits = transform_ring->fence_waits();
+	transform_ring->begin_frame();
+	stats.fence_waits += transform_ring->fence_waits() - fence_waits;
 
-	fprintf( stderr, "%s: OpenGL error: %s\n", s, gluErrorString ( x )) ;
-	errors++ ;
- }
-}
+	cull_objects();
+	update_animations(dt);
 
-void Renderer::render(double dt){
-	glClear(GL_COLOR_BUFFER_BIT);
-	glClear(GL_DEPTH_BUFFER_BIT);
+	render_device()->clear(GL_COLOR_BUFFER_BIT);
+	render_device()->clear(GL_DEPTH_BUFFER_BIT);
 
-	if(skybox_texture != NULL)
+	if(skybox_texture != NULL) {
 		render_skybox();
+		GLValidation::check_pass("Renderer::render_skybox()");
+	}
 
 	projectionViewMatrix.Push();
 
 	projectionViewMatrix.LookAt(camera.position(), camera.look_at(), camera.up());
 
 	//Upload projection matrix:
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.matricesBuffer);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projectionViewMatrix.Top()));
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.matricesBuffer);
+	render_device()->buffer_sub_data(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projectionViewMatrix.Top()));
 
 	checkForGLErrors("render(): projection matrix");
 
 	//Upload camera position
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.cameraBuffer);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::vec3), glm::value_ptr(camera.position()));
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.cameraBuffer);
+	render_device()->buffer_sub_data(GL_UNIFORM_BUFFER, 0, sizeof(glm::vec3), glm::value_ptr(camera.position()));
 
 	checkForGLErrors("render(): camera position");
 
@@ -293,32 +361,218 @@ void Renderer::render(double dt){
 		lightData.lights[i] = lights[i]->shader_light();
 	}
 	//Upload light data:
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.lightsBuffer);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Shader::lights_data_t), &lightData);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.lightsBuffer);
+	render_device()->buffer_sub_data(GL_UNIFORM_BUFFER, 0, sizeof(Shader::lights_data_t), &lightData);
 
 	checkForGLErrors("render(): lights");
 
-	for(std::vector<RenderGroup*>::iterator it=render_objects.begin(); it!=render_objects.end(); ++it) {
-		(*it)->render(dt, this);
-		checkForGLErrors("Renderer::render() - in model");
-	}	
+	//RenderObjects queue their meshes, other groups draw directly
+	{
+		PROFILE_GPU("scene");
+		for(std::vector<RenderGroup*>::iterator it=render_objects.begin(); it!=render_objects.end(); ++it) {
+			(*it)->render(dt, this);
+			checkForGLErrors("Renderer::render() - in model");
+		}
+		render_queue->submit(this);
+	}
+	GLValidation::check_pass("Renderer::render()");
+	transform_ring->end_frame();
 
 	projectionViewMatrix.Pop();
 
-	glUseProgram(0);
+	struct timeval end;
+	gettimeofday(&end, NULL);
+	stats.cpu_time += (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)/1000000.0;
+	++stats.frames;
 
-	SDL_GL_SwapBuffers();
+	if(headless_ == NULL && render_device()->has_gpu()) {
+		PROFILE_SCOPE("SDL_GL_SwapBuffers");
+		SDL_GL_SwapBuffers();
+	}
 
-	checkForGLErrors("render(): post");
+	GLValidation::check_pass("Renderer::render() - swap buffers");
+
+	stats_time_ += dt;
+	if(stats_time_ >= RENDER_STATS_INTERVAL) {
+		print_stats_and_reset();
+		//Compact mesh buffers left fragmented by deleted models, nothing happens if there are none
+		BufferArena::defragment_all();
+	}
+}
+
+void Renderer::cull_objects() {
+	PROFILE_SCOPE("Renderer::cull_objects");
+	double start = monotonic_seconds();
+
+	frame_objects_.clear();
+	for(std::vector<RenderGroup*>::iterator it=render_objects.begin(); it!=render_objects.end(); ++it) {
+		(*it)->collect_render_objects(glm::mat4(1.f), frame_objects_);
+	}
+
+	//The projection is on top of the stack until render() applies the camera
+	glm::mat4 projection = projectionViewMatrix.Top();
+	view_ = glm::lookAt(camera.position(), camera.look_at(), camera.up());
+	projection_scale_ = projection[1][1];
+	frustum_ = Frustum(projection * view_);
+
+	//Objects whose model finished loading are set up here, on the GL thread (it adds materials),
+	//update_animations() only checks is_ready() from the workers
+	for(std::vector<RenderObject*>::iterator it=frame_objects_.begin(); it!=frame_objects_.end(); ++it) {
+		(*it)->ready();
+	}
+
+	if(!frustum_culling) {
+		for(std::vector<RenderObject*>::iterator it=frame_objects_.begin(); it!=frame_objects_.end(); ++it) {
+			(*it)->culled = false;
+		}
+		stats.visible_objects += frame_objects_.size();
+		return;
+	}
+
+	//Objects still loading have no bounds, they draw nothing anyway
+	bvh_.resize(frame_objects_.size());
+	for(unsigned int i=0; i < frame_objects_.size(); ++i) {
+		RenderObject * obj = frame_objects_[i];
+		glm::vec3 min, max;
+		if(obj->is_ready()) {
+			obj->world_bounds(min, max);
+		} else {
+			min = max = obj->world_center();
+		}
+		bvh_.set_bounds(i, min, max);
+		obj->culled = true;
+	}
+	bvh_.update();
+
+	visible_objects_.clear();
+	bvh_.cull(frustum_, visible_objects_);
+	for(std::vector<unsigned int>::iterator it=visible_objects_.begin(); it!=visible_objects_.end(); ++it) {
+		frame_objects_[*it]->culled = false;
+	}
+
+	stats.visible_objects += visible_objects_.size();
+	stats.culled_objects += frame_objects_.size() - visible_objects_.size();
+	stats.bvh_nodes += bvh_.nodes_tested();
+	stats.cull_time += monotonic_seconds() - start;
+}
+
+void Renderer::update_animations(double dt) {
+	PROFILE_SCOPE("Renderer::update_animations");
+	double start = monotonic_seconds();
+
+	//Each object only writes to itself, the stats are summed after
+	workers->parallel_for(frame_objects_.size(), 1, [&](unsigned int begin, unsigned int end) {
+		for(unsigned int i=begin; i < end; ++i) {
+			RenderObject * obj = frame_objects_[i];
+			unsigned int interval = 1;
+			if(animation_lod && obj->is_ready())
+				interval = obj->animation_update_interval(obj->culled ? -1.f : screen_size(obj->world_center(), obj->world_radius()));
+			obj->update_animation(dt, interval);
+		}
+	});
+
+	for(std::vector<RenderObject*>::iterator it=frame_objects_.begin(); it!=frame_objects_.end(); ++it) {
+		const RenderObject::anim_update_stats_t &s = (*it)->update_stats();
+		stats.nodes += s.nodes;
+		stats.channel_samples += s.samples;
+		stats.skipped_samples += s.skipped_samples;
+		stats.skinned_vertices += s.skinned_vertices;
+		stats.skin_time += s.skin_time;
+	}
+	stats.animated_objects += frame_objects_.size();
+	stats.node_time += monotonic_seconds() - start;
+}
+
+float Renderer::screen_size(const glm::vec3 &center, float radius) const {
+	if(!frustum_.intersects_sphere(center, radius))
+		return -1.f;
+
+	float depth = -glm::vec3(view_ * glm::vec4(center, 1.f)).z;
+	//The camera is inside the sphere
+	if(depth <= radius)
+		return 1.f;
+	return radius * projection_scale_ / depth;
+}
+
+void Renderer::print_stats_and_reset() {
+	if(print_stats && stats.frames > 0 && stats.draw_calls > 0) {
+		printf("Render stats: %.1f draw calls/frame, %.3f ms cpu/frame, %.2f us cpu/draw call\n",
+			stats.draw_calls/(double)stats.frames,
+			1000.0*stats.cpu_time/stats.frames,
+			1000000.0*stats.cpu_time/stats.draw_calls);
+		if(stats.nodes > 0) {
+			printf("Node stats: %.1f objects/frame, %.1f nodes/frame, %.3f ms/frame, %.3f us/node (%u threads)\n",
+				stats.animated_objects/(double)stats.frames,
+				stats.nodes/(double)stats.frames,
+				1000.0*stats.node_time/stats.frames,
+				1000000.0*stats.node_time/stats.nodes,
+				workers->num_threads());
+		}
+		if(stats.queued_draws > 0) {
+			printf("Queue stats: %.1f draws/frame, %.1f program switches/frame, %.1f texture binds/frame, %.1f material binds/frame\n",
+				stats.queued_draws/(double)stats.frames,
+				stats.program_switches/(double)stats.frames,
+				stats.texture_binds/(double)stats.frames,
+				stats.material_binds/(double)stats.frames);
+		}
+		if(stats.multi_draws > 0) {
+			printf("Multi-draw stats: %.1f multi-draws/frame, %.1f commands/multi-draw\n",
+				stats.multi_draws/(double)stats.frames,
+				stats.multi_draw_commands/(double)stats.multi_draws);
+		}
+		if(stats.instanced_draws > 0) {
+			printf("Instancing stats: %.1f instanced draws/frame, %.1f instances/draw\n",
+				stats.instanced_draws/(double)stats.frames,
+				stats.instances/(double)stats.instanced_draws);
+		}
+		if(stats.state_calls + stats.state_calls_avoided > 0) {
+			printf("GL state stats: %.1f state calls/frame, %.1f avoided/frame (%.0f%%)\n",
+				stats.state_calls/(double)stats.frames,
+				stats.state_calls_avoided/(double)stats.frames,
+				100.0*stats.state_calls_avoided/(stats.state_calls + stats.state_calls_avoided));
+		}
+		if(stats.transform_bytes > 0) {
+			printf("Transform stats: %.1f kB/frame, %.1f normal matrix inversions/frame, waited for the gpu %u times\n",
+				stats.transform_bytes/(1024.0*stats.frames),
+				stats.normal_inversions/(double)stats.frames,
+				stats.fence_waits);
+		}
+		if(stats.visible_objects + stats.culled_objects > 0) {
+			printf("Culling stats: %.1f visible objects/frame, %.1f culled objects/frame, %.1f culled meshes/frame, %.1f culled instances/frame, %.1f bvh nodes/frame, %.3f ms/frame\n",
+				stats.visible_objects/(double)stats.frames,
+				stats.culled_objects/(double)stats.frames,
+				stats.culled_meshes/(double)stats.frames,
+				stats.culled_instances/(double)stats.frames,
+				stats.bvh_nodes/(double)stats.frames,
+				1000.0*stats.cull_time/stats.frames);
+		}
+		if(stats.channel_samples + stats.skipped_samples > 0) {
+			printf("Animation lod: %.1f channel samples/frame, %.1f skipped/frame (%.0f%%)\n",
+				stats.channel_samples/(double)stats.frames,
+				stats.skipped_samples/(double)stats.frames,
+				100.0*stats.skipped_samples/(stats.channel_samples + stats.skipped_samples));
+		}
+		if(stats.skinned_vertices > 0) {
+			printf("Skinning stats: %.0f vertices/frame, %.3f ms/frame, %.0f vertices/ms\n",
+				stats.skinned_vertices/(double)stats.frames,
+				1000.0*stats.skin_time/stats.frames,
+				stats.skinned_vertices/(1000.0*stats.skin_time));
+		}
+		BufferArena::print_stats_all();
+		Model::print_memory_all();
+	}
+	Profiler::print_stats();
+	stats = render_stats_t();
+	stats_time_ = 0;
 }
 
 void Renderer::render_skybox() {
-	glDisable(GL_DEPTH_TEST);
-	if(cull_face)
-		glDisable(GL_CULL_FACE);
-	
-	glUseProgram(shaders[SKYBOX_SHADER].program);
+	PROFILE_SCOPE("Renderer::render_skybox");
+	PROFILE_GPU("skybox");
+	GLState::set(GL_DEPTH_TEST, false);
+	GLState::set(GL_CULL_FACE, false);
+
+	GLState::use_program(shaders[SKYBOX_SHADER].program);
 
 	projectionViewMatrix.Push();
 	projectionViewMatrix.SetIdentity();
@@ -326,61 +580,88 @@ void Renderer::render_skybox() {
 	projectionViewMatrix.LookAt(glm::vec3(0.0), camera.look_at()-camera.position(), camera.up());
 
 	//Upload projection matrix:
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.matricesBuffer);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projectionViewMatrix.Top()));
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	bind_matrices_block();
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.matricesBuffer);
+	render_device()->buffer_sub_data(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projectionViewMatrix.Top()));
 
-	glBindBuffer(GL_ARRAY_BUFFER, skybox_buffer_);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)(sizeof(float)*3*36) );
+	GLState::bind_vertex_array(skybox_vao_);
+	skybox_texture->bind(2);
 
 	checkForGLErrors("render_skybox(): pre");
-	
-	//glActiveTexture(GL_TEXTURE0);
 
-	//skybox_texture->bind();
-
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	render_device()->draw_arrays(GL_TRIANGLES, 0, 36);
+	++stats.draw_calls;
 
 	checkForGLErrors("render_skybox(): render");
 
-	//skybox_texture->unbind();
-
+	projectionViewMatrix.Pop();
 
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(0);
-	glUseProgram(shaders[NORMAL_SHADER].program);
+	GLState::set(GL_CULL_FACE, cull_face);
+	GLState::set(GL_DEPTH_TEST, true);
 
-	projectionViewMatrix.Pop();
+	checkForGLErrors("render_skybox(): post");
+}
 
-	if(cull_face)
-		glEnable(GL_CULL_FACE);
+bool Renderer::has_extension(const char * name) {
+	return render_device()->has_extension(name);
+}
 
-	glEnable(GL_DEPTH_TEST);
-	glUseProgram(0);
+void * Renderer::get_proc_address(const char * name) {
+	if(headless_ != NULL)
+		return HeadlessContext::get_proc_address(name);
+	return SDL_GL_GetProcAddress(name);
+}
 
-	checkForGLErrors("render_skybox(): post");
+bool Renderer::read_frame(std::vector<unsigned char> &pixels) const {
+	if(headless_ == NULL)
+		return false;
+	pixels.resize(width_*height_*4);
+	headless_->read_pixels(&pixels[0]);
+	return true;
 }
 
 void Renderer::upload_model_matrices(bool normal_matrix) {
-	glBindBuffer(GL_UNIFORM_BUFFER, Shader::globals.matricesBuffer);
+	upload_model_matrices(modelMatrix.Top(), normal_matrix);
+}
+
+void Renderer::upload_model_matrices(const glm::mat4 &model_matrix, bool normal_matrix) {
+	bind_matrices_block();
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.matricesBuffer);
 	//Model matrix:
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(modelMatrix.Top()));
+	render_device()->buffer_sub_data(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(model_matrix));
 	if(normal_matrix) {
 		//Normal matrix:
-		glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4)*2, sizeof(glm::mat4), glm::value_ptr(glm::transpose(glm::inverse(modelMatrix.Top()))));
+		render_device()->buffer_sub_data(GL_UNIFORM_BUFFER, sizeof(glm::mat4)*2, sizeof(glm::mat4), glm::value_ptr(Renderer::normal_matrix(model_matrix)));
 	}
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void Renderer::bind_matrices_block() {
+	GLState::bind_buffer_range(GL_UNIFORM_BUFFER, Shader::MATRICES_BLOCK_INDEX, Shader::globals.matricesBuffer, 0, sizeof(glm::mat4)*3);
+}
+
+glm::mat4 Renderer::normal_matrix(const glm::mat4 &m) {
+	glm::vec3 x(m[0]), y(m[1]), z(m[2]);
+	float xx = glm::dot(x, x);
+	float epsilon = NORMAL_MATRIX_EPSILON * xx;
+	if(fabs(glm::dot(y, y) - xx) <= epsilon && fabs(glm::dot(z, z) - xx) <= epsilon
+		&& fabs(glm::dot(x, y)) <= epsilon && fabs(glm::dot(y, z)) <= epsilon && fabs(glm::dot(z, x)) <= epsilon)
+		return m;
+
+	++stats.normal_inversions;
+	return glm::transpose(glm::inverse(m));
+}
+
+float Renderer::normalized_depth(const glm::vec3 &p) const {
+	float depth = -glm::vec3(view_ * glm::vec4(p, 1.f)).z;
+	return glm::clamp((depth - zNear) / (zFar - zNear), 0.f, 1.f);
 }
 
 void Renderer::enable_face_culling() {
 	cull_face = true;
-	glEnable(GL_CULL_FACE);
+	GLState::set(GL_CULL_FACE, true);
 }
 
 void Renderer::disabel_face_culling() {
 	cull_face = false;
-	glDisable(GL_CULL_FACE);
+	GLState::set(GL_CULL_FACE, false);
 }
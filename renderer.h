@@ -10,34 +10,132 @@
 	#include "render_group.h"
 	#include "shader.h"
 	#include "texture.h"	
+	#include "frustum.h"
+	#include "bvh.h"
+	#include "gl_validation.h"
 
+	//Bytes of model data uploaded per frame by the model loader
+	#define MODEL_UPLOAD_BUDGET (4*1024*1024)
 
+	//Seconds between each print of render stats (when print_stats is set)
+	#define RENDER_STATS_INTERVAL 5.0
 
-class Renderer {
+	//Relative difference in squared axis length (and dot products) still counted as uniform scale
+	#define NORMAL_MATRIX_EPSILON 0.0001f
+
+class ModelLoader;
+class ThreadPool;
+class RenderQueue;
+class UniformRing;
+class RenderObject;
+class HeadlessContext;
 
-	GLuint vao;
+
+class Renderer {
 
 	void render_skybox();
 
 	Shader::lights_data_t lightData;
 
 	GLuint skybox_buffer_;
+	GLuint skybox_vao_;
+
+	double stats_time_; //Time since stats was last printed
+	void print_stats_and_reset();
 
 	void init_shader(Shader &shader);
 
+	/*
+	 * Collects all RenderObjects in render_objects and sets their culled flag
+	 * from a BVH over their world space bounds.
+	 */
+	void cull_objects();
+	std::vector<RenderObject*> frame_objects_; //All RenderObjects in render_objects, in the order of the BVH items
+	std::vector<unsigned int> visible_objects_;
+	BVH bvh_;
+	Frustum frustum_;
+	glm::mat4 view_;
+	float projection_scale_;
+
+	/*
+	 * Updates the animations of all RenderObjects in render_objects on the workers,
+	 * before anything is drawn. Drawing then only reads the node matrices and palettes.
+	 */
+	void update_animations(double dt);
+
+	//Bounding sphere diameter over the screen height, negative if outside the view. Set up by cull_objects()
+	float screen_size(const glm::vec3 &center, float radius) const;
+
 	int width_, height_;
 
+	static HeadlessContext * headless_; //NULL when rendering to a window
+
 	static std::string shader_files_[];
 public:
 	Texture * skybox_texture;
 
-	Renderer(int w, int h, bool fullscreen);
+	//Pass to RenderObject to load models in the background
+	ModelLoader * model_loader;
+	//Splits per frame cpu work over all cores
+	ThreadPool * workers;
+	//Draws of RenderObjects, submitted after all render_objects have been traversed
+	RenderQueue * render_queue;
+	//Matrices block of each draw in the render queue, written once per frame
+	UniformRing * transform_ring;
+
+	enum context_t {
+		WINDOW_CONTEXT,
+		HEADLESS_CONTEXT, //No window, renders to a w x h framebuffer with an EGL context (see headless.h)
+		NO_CONTEXT //No GL at all, everything goes to a NullDevice (see null_device.h)
+	};
+
+	Renderer(int w, int h, bool fullscreen, context_t context=WINDOW_CONTEXT);
 	~Renderer();
 	
 	float zNear;
 	float zFar;
 	bool cull_face;
 
+	struct render_stats_t {
+		render_stats_t() : frames(0), draw_calls(0), cpu_time(0), animated_objects(0), nodes(0), node_time(0), channel_samples(0), skipped_samples(0), visible_objects(0), culled_objects(0), culled_meshes(0), bvh_nodes(0), cull_time(0),
+			queued_draws(0), program_switches(0), texture_binds(0), material_binds(0), instanced_draws(0), instances(0), culled_instances(0), multi_draws(0), multi_draw_commands(0), state_calls(0), state_calls_avoided(0),
+			normal_inversions(0), transform_bytes(0), fence_waits(0), skinned_vertices(0), skin_time(0) {};
+		unsigned int frames;
+		unsigned long draw_calls; //Increased by everything that calls glDraw*
+		double cpu_time; //Seconds spent submitting draws (not including swap)
+		unsigned long animated_objects; //RenderObjects updated in the parallel animation pass
+		unsigned long nodes; //Node matrices calculated by RenderObjects
+		double node_time; //Wall time spent updating animations and node matrices (part of cpu_time)
+		unsigned long channel_samples; //Animation channels sampled
+		unsigned long skipped_samples; //Channel samples skipped by animation lod
+		unsigned long visible_objects, culled_objects; //RenderObjects inside and outside the view
+		unsigned long culled_meshes; //Meshes of visible objects outside the view
+		unsigned long bvh_nodes; //BVH nodes tested
+		double cull_time; //Seconds spent updating bounds and culling (part of cpu_time)
+		unsigned long queued_draws; //Draws submitted through the render queue
+		unsigned long program_switches, texture_binds, material_binds; //State changes made by the render queue
+		unsigned long instanced_draws, instances; //Instanced draws made by the render queue and the draws merged into them
+		unsigned long culled_instances; //Instances (see RenderObject::instances) of visible objects outside the view
+		unsigned long multi_draws, multi_draw_commands; //glMultiDrawElementsIndirect calls made by the render queue and the draws in them
+		unsigned long state_calls, state_calls_avoided; //Binds, enables and program switches made and skipped by GLState
+		unsigned long normal_inversions; //Normal matrices that needed an inverse (non-uniform scale)
+		unsigned long transform_bytes; //Written to transform_ring
+		unsigned int fence_waits; //Frames where the cpu waited for the gpu to release transform_ring
+		unsigned long skinned_vertices; //Vertices skinned on the cpu
+		double skin_time; //Seconds spent skinning on the cpu, summed over the workers
+	};
+
+	//Accumulated since last print
+	static render_stats_t stats;
+	bool print_stats;
+	//Sample distant animations less often and off screen ones not at all (see RenderObject::animation_update_interval)
+	bool animation_lod;
+	//Skip RenderObjects and meshes outside the view
+	bool frustum_culling;
+
+	//Of the camera this frame, in world space
+	const Frustum &frustum() const { return frustum_; };
+
 	enum shader_program_t {
 		NORMAL_SHADER=0,
 		SKYBOX_SHADER,
@@ -45,17 +143,35 @@ public:
 		WATER_SHADER,
 		PARTICLES_SHADER,
 		DEBUG_SHADER,
+		SKINNED_SHADER,
 		NUM_SHADERS
 	};
 
-	static int checkForGLErrors( const char *s );
+	//Checks for GL errors after a call, only done in GLValidation::STRICT (see gl_validation.h)
+	static int checkForGLErrors(const char * s) { return GLValidation::check_call(s); };
+	//True if the device has the extension
+	static bool has_extension(const char * name);
+	//Address of a GL function not in the 3.3 headers, from SDL or EGL depending on the context
+	static void * get_proc_address(const char * name);
 
 	Shader shaders[NUM_SHADERS];
 
 	void load_shader_uniform_location(shader_program_t shader, std::string uniform_name);
 
-	//Uploads model and normal matrices
+	//Uploads model and normal matrices and binds them to the Matrices block
 	void upload_model_matrices(bool normal_matrix=true);
+	void upload_model_matrices(const glm::mat4 &model_matrix, bool normal_matrix=true);
+	//Binds Shader::globals.matricesBuffer to the Matrices block (the render queue binds ranges of transform_ring)
+	void bind_matrices_block();
+
+	/*
+	 * transpose(inverse(m)), or m itself when it only rotates and scales uniformly:
+	 * the shaders normalize the normals, so the direction is all that matters.
+	 */
+	static glm::mat4 normal_matrix(const glm::mat4 &m);
+
+	//Distance of p from the camera plane this frame, 0 at zNear and 1 at zFar
+	float normalized_depth(const glm::vec3 &p) const;
 
 	//Load skybox
 	void load_skybox(std::string skybox_path);
@@ -76,5 +192,9 @@ public:
 	int width() { return width_; };
 	int height() { return height_; }
 
+	bool headless() const { return headless_ != NULL; };
+	//Reads the last rendered frame as RGBA with the top row first, only headless. Returns false if not headless
+	bool read_frame(std::vector<unsigned char> &pixels) const;
+
 };
 #endif
@@ -1,4 +1,5 @@
 #include "shader.h"
+#include "render_device.h"
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
@@ -76,7 +77,7 @@ std::string Shader::parse_shader(const std::string &filename, std::set<std::stri
 GLuint Shader::load_shader(GLenum eShaderType, const std::string &strFilename) {
 	std::string source = parse_shader(strFilename);
 	try {
-		return glutil::CompileShader(eShaderType, source);
+		return render_device()->compile_shader(eShaderType, source);
 	} catch(glutil::ShaderException &e) {
 		fprintf(stderr, "Shader compile error (%s). Preproccessed source: \n", strFilename.c_str());
 		char buffer[2048];
@@ -93,13 +94,11 @@ GLuint Shader::load_shader(GLenum eShaderType, const std::string &strFilename) {
 
 GLuint Shader::create_program(const std::vector<GLuint> &shaderList) {
 	try {
-		return glutil::LinkProgram(shaderList);
+		return render_device()->link_program(shaderList);
 	} catch(glutil::ShaderException &e) {
 		fprintf(stderr, "%s\n", e.what());
 		throw;
 	}
-
-	std::for_each(shaderList.begin(), shaderList.end(), glDeleteShader);
 }
 
 Shader Shader::create_shader(std::string base_name) {
@@ -119,7 +118,9 @@ Shader Shader::create_shader(std::string base_name) {
 	
 	shader.program = create_program(shader_list);
 
-	std::for_each(shader_list.begin(), shader_list.end(), glDeleteShader);
+	for(std::vector<GLuint>::iterator it=shader_list.begin(); it!=shader_list.end(); ++it) {
+		render_device()->delete_shader(*it);
+	}
 
 	return shader;
 }
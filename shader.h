@@ -58,13 +58,15 @@ public:
 		GLuint lightsBuffer;
 		GLuint materialBuffer;
 		GLuint cameraBuffer;
+		GLuint bonesBuffer;
 	};
 
 	enum {
 		MATRICES_BLOCK_INDEX = 0,
 		LIGHTS_DATA_BLOCK_INDEX = 1,
 		MATERIAL_BLOCK_INDEX = 2,
-		CAMERA_BLOCK_INDEX = 3
+		CAMERA_BLOCK_INDEX = 3,
+		BONES_BLOCK_INDEX = 4
 	};
 
 	static globals_t globals;
@@ -76,6 +78,7 @@ public:
 	GLint LightsData;
 	GLint Material;
 	GLint Camera;
+	GLint Bones;
 	GLint texture1;
 	GLint texture2;
 	GLint texture_array1;
@@ -5,8 +5,7 @@
 layout (location = 0) in vec4 in_position;
 layout (location = 1) in vec2 in_texCoord;
 layout (location = 2) in vec4 in_normal;
-layout (location = 3) in vec4 in_tangent;
-layout (location = 4) in vec4 in_bitangent;
+layout (location = 3) in vec4 in_tangent; //w is the sign of the bitangent
 
 out VertexData {
 	vec3 normal;
@@ -16,7 +15,8 @@ out VertexData {
 
 void main() {
 	gl_Position  = modelMatrix * in_position;
-	vertexData.normal = (normalMatrix * in_normal).xyz;
-	vertexData.tangent = (normalMatrix * in_tangent).xyz;
-	vertexData.bitangent = (normalMatrix * in_bitangent).xyz;
+	vec3 in_bitangent = cross(in_normal.xyz, in_tangent.xyz) * (in_tangent.w < 0.0 ? -1.0 : 1.0);
+	vertexData.normal = (normalMatrix * vec4(in_normal.xyz, 0.0)).xyz;
+	vertexData.tangent = (normalMatrix * vec4(in_tangent.xyz, 0.0)).xyz;
+	vertexData.bitangent = (normalMatrix * vec4(in_bitangent, 0.0)).xyz;
 }
@@ -0,0 +1 @@
+#include "standard.frag"
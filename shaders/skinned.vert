@@ -0,0 +1,45 @@
+#version 330
+#include "uniforms.glsl"
+
+const int maxNumberOfBones = 64; //SKIN_MAX_BONES
+
+layout (location = 0) in vec4 in_position;
+layout (location = 1) in vec2 in_texcoord;
+layout (location = 2) in vec4 in_normal;
+layout (location = 3) in vec4 in_tangent; //w is the sign of the bitangent
+layout (location = 4) in uvec4 in_bones;
+layout (location = 5) in vec4 in_weights;
+layout (location = 13) in vec4 in_tint; //Constant, skinned meshes are not instanced
+
+layout(std140) uniform Bones {
+	mat4 bones[maxNumberOfBones];
+};
+
+out vec3 position;
+out vec3 normal;
+out vec3 tangent;
+out vec3 bitangent;
+out vec2 texcoord;
+out vec4 tint;
+
+void main() {
+	//Same as Skinning::skin_reference
+	mat4 skin = bones[in_bones.x] * in_weights.x
+		+ bones[in_bones.y] * in_weights.y
+		+ bones[in_bones.z] * in_weights.z
+		+ bones[in_bones.w] * in_weights.w;
+
+	vec4 w_pos = modelMatrix * (skin * vec4(in_position.xyz, 1.0));
+	position = w_pos.xyz;
+	gl_Position = projectionViewMatrix *  w_pos;
+	texcoord = in_texcoord;
+	tint = in_tint;
+
+	vec3 s_normal = (skin * vec4(in_normal.xyz, 0.0)).xyz;
+	vec3 s_tangent = (skin * vec4(in_tangent.xyz, 0.0)).xyz;
+	//The bitangent is not stored in the vertex, rebuild it from the normal and tangent
+	vec3 s_bitangent = cross(s_normal, s_tangent) * (in_tangent.w < 0.0 ? -1.0 : 1.0);
+	normal = (normalMatrix * vec4(s_normal, 0.0)).xyz;
+	tangent = (normalMatrix * vec4(s_tangent, 0.0)).xyz;
+	bitangent = (normalMatrix * vec4(s_bitangent, 0.0)).xyz;
+}
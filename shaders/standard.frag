@@ -7,6 +7,7 @@ in vec3 normal;
 in vec3 tangent;
 in vec3 bitangent;
 in vec2 texcoord;
+in vec4 tint;
 
 #include "light_calculations.glsl"
 
@@ -40,6 +41,7 @@ void main() {
 	} else {
 		originalColor = Mtl.diffuse;
 	}
+	originalColor *= tint;
 	vec4 accumLighting = originalColor * Lgt.ambient_intensity;
 
 	for(int light = 0; uint(light) < Lgt.num_lights; ++light) {
@@ -4,22 +4,30 @@
 layout (location = 0) in vec4 in_position;
 layout (location = 1) in vec2 in_texcoord;
 layout (location = 2) in vec4 in_normal;
-layout (location = 3) in vec4 in_tangent;
-layout (location = 4) in vec4 in_bitangent;
+layout (location = 3) in vec4 in_tangent; //w is the sign of the bitangent
+
+//Per instance (see RenderQueue), identity and the draw's tint when not instanced
+layout (location = 6) in mat4 in_instance_matrix;
+layout (location = 10) in mat3 in_instance_normal_matrix;
+layout (location = 13) in vec4 in_tint;
 
 out vec3 position;
 out vec3 normal;
 out vec3 tangent;
 out vec3 bitangent;
 out vec2 texcoord;
+out vec4 tint;
 
 void main() {
-	vec4 w_pos = modelMatrix * in_position;
+	vec4 w_pos = modelMatrix * (in_instance_matrix * in_position);
 	position = w_pos.xyz;
 	gl_Position = projectionViewMatrix *  w_pos;
 	texcoord = in_texcoord;
-	normal = (normalMatrix * in_normal).xyz;
-	tangent = (normalMatrix * in_tangent).xyz;
-	bitangent = (normalMatrix * in_bitangent).xyz;
+	tint = in_tint;
+	//The bitangent is not stored in the vertex, rebuild it from the normal and tangent
+	vec3 in_bitangent = cross(in_normal.xyz, in_tangent.xyz) * (in_tangent.w < 0.0 ? -1.0 : 1.0);
+	normal = (normalMatrix * vec4(in_instance_normal_matrix * in_normal.xyz, 0.0)).xyz;
+	tangent = (normalMatrix * vec4(in_instance_normal_matrix * in_tangent.xyz, 0.0)).xyz;
+	bitangent = (normalMatrix * vec4(in_instance_normal_matrix * in_bitangent, 0.0)).xyz;
 }
 
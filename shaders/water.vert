@@ -14,8 +14,7 @@ uniform vec2 wave2;
 layout (location = 0) in vec4 in_position;
 layout (location = 1) in vec2 in_texcoord;
 layout (location = 2) in vec4 in_normal;
-layout (location = 3) in vec4 in_tangent;
-layout (location = 4) in vec4 in_bitangent;
+layout (location = 3) in vec4 in_tangent; //w is the sign of the bitangent
 
 out vec3 position;
 out vec3 normal;
@@ -33,9 +32,11 @@ void main() {
 	gl_Position = projectionViewMatrix *  w_pos;
 	depth = abs(water_height - in_position.y);
 
-	normal = (normalMatrix * in_normal).xyz;
-	tangent = (normalMatrix * in_tangent).xyz;
-	bitangent = (normalMatrix * in_bitangent).xyz;
+	//The bitangent is not stored in the vertex, rebuild it from the normal and tangent
+	vec3 in_bitangent = cross(in_normal.xyz, in_tangent.xyz) * (in_tangent.w < 0.0 ? -1.0 : 1.0);
+	normal = (normalMatrix * vec4(in_normal.xyz, 0.0)).xyz;
+	tangent = (normalMatrix * vec4(in_tangent.xyz, 0.0)).xyz;
+	bitangent = (normalMatrix * vec4(in_bitangent, 0.0)).xyz;
 
 	tex_coord1 = in_texcoord + time*wave1;
 	tex_coord2 = in_texcoord + time*wave2;
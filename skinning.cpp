@@ -0,0 +1,173 @@
+#include "skinning.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "render_device.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+Skinning::backend_t Skinning::backend = Skinning::GPU_SKINNING;
+
+void Skinning::set_attrib_pointers() {
+	GLsizei stride = sizeof(vertex_t);
+
+	render_device()->enable_vertex_attrib_array(0);
+	render_device()->enable_vertex_attrib_array(1);
+	render_device()->enable_vertex_attrib_array(2);
+	render_device()->enable_vertex_attrib_array(3);
+
+	render_device()->vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid*) offsetof(vertex_t, position));
+	render_device()->vertex_attrib_pointer(1, 2, GL_FLOAT, GL_FALSE, stride, (const GLvoid*) offsetof(vertex_t, uv));
+	render_device()->vertex_attrib_pointer(2, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid*) offsetof(vertex_t, normal));
+	render_device()->vertex_attrib_pointer(3, 4, GL_FLOAT, GL_FALSE, stride, (const GLvoid*) offsetof(vertex_t, tangent));
+}
+
+void Skinning::skin_reference(const source_t &src, const glm::mat4 * palette, vertex_t * dst, unsigned int begin, unsigned int end) {
+	for(unsigned int v=begin; v < end; ++v) {
+		const uint8_t * bones = &src.bones[SKIN_BONES_PER_VERTEX*v];
+		const float * weights = &src.weights[SKIN_BONES_PER_VERTEX*v];
+
+		glm::mat4 m = palette[bones[0]] * weights[0];
+		for(int i=1; i < SKIN_BONES_PER_VERTEX; ++i)
+			m += palette[bones[i]] * weights[i];
+
+		const glm::vec4 &t = src.tangents[v];
+		dst[v].position = glm::vec3(m * glm::vec4(src.positions[v], 1.f));
+		dst[v].uv = src.uvs[v];
+		dst[v].normal = glm::vec3(m * glm::vec4(src.normals[v], 0.f));
+		dst[v].tangent = glm::vec4(glm::vec3(m * glm::vec4(t.x, t.y, t.z, 0.f)), t.w);
+	}
+}
+
+#if defined(__AVX__)
+
+//c0*x + c1*y + c2*z + c3*w, with columns 0 and 1 in c01 and 2 and 3 in c23
+static inline __m128 transform_vector(__m256 c01, __m256 c23, float x, float y, float z, float w) {
+	__m256 r = _mm256_add_ps(_mm256_mul_ps(c01, _mm256_setr_ps(x, x, x, x, y, y, y, y)),
+		_mm256_mul_ps(c23, _mm256_setr_ps(z, z, z, z, w, w, w, w)));
+	return _mm_add_ps(_mm256_castps256_ps128(r), _mm256_extractf128_ps(r, 1));
+}
+
+void Skinning::skin(const source_t &src, const glm::mat4 * palette, vertex_t * dst, unsigned int begin, unsigned int end) {
+	for(unsigned int v=begin; v < end; ++v) {
+		const uint8_t * bones = &src.bones[SKIN_BONES_PER_VERTEX*v];
+		const float * weights = &src.weights[SKIN_BONES_PER_VERTEX*v];
+
+		//Blend two columns of the bone matrices at a time, bones without weight are skipped
+		const float * m = glm::value_ptr(palette[bones[0]]);
+		__m256 w = _mm256_set1_ps(weights[0]);
+		__m256 c01 = _mm256_mul_ps(_mm256_loadu_ps(m), w);
+		__m256 c23 = _mm256_mul_ps(_mm256_loadu_ps(m + 8), w);
+		for(int i=1; i < SKIN_BONES_PER_VERTEX; ++i) {
+			if(weights[i] == 0.f)
+				continue;
+			m = glm::value_ptr(palette[bones[i]]);
+			w = _mm256_set1_ps(weights[i]);
+			c01 = _mm256_add_ps(c01, _mm256_mul_ps(_mm256_loadu_ps(m), w));
+			c23 = _mm256_add_ps(c23, _mm256_mul_ps(_mm256_loadu_ps(m + 8), w));
+		}
+
+		const glm::vec3 &p = src.positions[v];
+		const glm::vec3 &n = src.normals[v];
+		const glm::vec4 &t = src.tangents[v];
+		float out[4];
+
+		_mm_storeu_ps(out, transform_vector(c01, c23, p.x, p.y, p.z, 1.f));
+		memcpy(&dst[v].position, out, 3*sizeof(float));
+		dst[v].uv = src.uvs[v];
+		_mm_storeu_ps(out, transform_vector(c01, c23, n.x, n.y, n.z, 0.f));
+		memcpy(&dst[v].normal, out, 3*sizeof(float));
+		_mm_storeu_ps(out, transform_vector(c01, c23, t.x, t.y, t.z, 0.f));
+		out[3] = t.w;
+		memcpy(&dst[v].tangent, out, 4*sizeof(float));
+	}
+}
+
+#elif defined(__SSE__)
+
+//c0*x + c1*y + c2*z
+static inline __m128 transform_vector(const __m128 * c, float x, float y, float z) {
+	__m128 r = _mm_mul_ps(c[0], _mm_set1_ps(x));
+	r = _mm_add_ps(r, _mm_mul_ps(c[1], _mm_set1_ps(y)));
+	return _mm_add_ps(r, _mm_mul_ps(c[2], _mm_set1_ps(z)));
+}
+
+void Skinning::skin(const source_t &src, const glm::mat4 * palette, vertex_t * dst, unsigned int begin, unsigned int end) {
+	for(unsigned int v=begin; v < end; ++v) {
+		const uint8_t * bones = &src.bones[SKIN_BONES_PER_VERTEX*v];
+		const float * weights = &src.weights[SKIN_BONES_PER_VERTEX*v];
+
+		//Blend the columns of the bone matrices, bones without weight are skipped
+		__m128 c[4];
+		const float * m = glm::value_ptr(palette[bones[0]]);
+		__m128 w = _mm_set1_ps(weights[0]);
+		for(int col=0; col < 4; ++col)
+			c[col] = _mm_mul_ps(_mm_loadu_ps(m + 4*col), w);
+		for(int i=1; i < SKIN_BONES_PER_VERTEX; ++i) {
+			if(weights[i] == 0.f)
+				continue;
+			m = glm::value_ptr(palette[bones[i]]);
+			w = _mm_set1_ps(weights[i]);
+			for(int col=0; col < 4; ++col)
+				c[col] = _mm_add_ps(c[col], _mm_mul_ps(_mm_loadu_ps(m + 4*col), w));
+		}
+
+		const glm::vec3 &p = src.positions[v];
+		const glm::vec3 &n = src.normals[v];
+		const glm::vec4 &t = src.tangents[v];
+		float out[4];
+
+		_mm_storeu_ps(out, _mm_add_ps(transform_vector(c, p.x, p.y, p.z), c[3]));
+		memcpy(&dst[v].position, out, 3*sizeof(float));
+		dst[v].uv = src.uvs[v];
+		_mm_storeu_ps(out, transform_vector(c, n.x, n.y, n.z));
+		memcpy(&dst[v].normal, out, 3*sizeof(float));
+		_mm_storeu_ps(out, transform_vector(c, t.x, t.y, t.z));
+		out[3] = t.w;
+		memcpy(&dst[v].tangent, out, 4*sizeof(float));
+	}
+}
+
+#else
+
+void Skinning::skin(const source_t &src, const glm::mat4 * palette, vertex_t * dst, unsigned int begin, unsigned int end) {
+	skin_reference(src, palette, dst, begin, end);
+}
+
+#endif
+
+static float difference(const glm::vec3 &a, const glm::vec3 &b) {
+	glm::vec3 d = glm::abs(a - b);
+	return std::max(d.x, std::max(d.y, d.z));
+}
+
+float Skinning::compare(const source_t &src, const glm::mat4 * palette) {
+	unsigned int count = src.positions.size();
+	std::vector<vertex_t> simd(count), reference(count);
+	skin(src, palette, &simd.front(), 0, count);
+	skin_reference(src, palette, &reference.front(), 0, count);
+
+	float largest = 0.f;
+	for(unsigned int v=0; v < count; ++v) {
+		largest = std::max(largest, difference(simd[v].position, reference[v].position));
+		largest = std::max(largest, difference(simd[v].normal, reference[v].normal));
+		largest = std::max(largest, difference(glm::vec3(simd[v].tangent), glm::vec3(reference[v].tangent)));
+	}
+	return largest;
+}
+
+void Skinning::upload_palette(const glm::mat4 * palette, unsigned int count) {
+	assert(count <= SKIN_MAX_BONES);
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, Shader::globals.bonesBuffer);
+	render_device()->buffer_sub_data(GL_UNIFORM_BUFFER, 0, count*sizeof(glm::mat4), palette);
+}
@@ -0,0 +1,65 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <vector>
+#include <stdint.h>
+#include <glload/gl_3_3.h>
+#include <glm/glm.hpp>
+
+//Size of the Bones uniform block in skinned.vert, meshes with more bones are imported unskinned
+#define SKIN_MAX_BONES 64
+#define SKIN_BONES_PER_VERTEX 4
+
+/*
+ * Vertex skinning with a palette of up to SKIN_MAX_BONES matrices.
+ *
+ * GPU_SKINNING uploads the palette to the Bones uniform block and draws with the skinned shader.
+ * CPU_SKINNING transforms the vertices in the parallel animation phase (with AVX or SSE when available),
+ * they are uploaded to a stream buffer drawn with the object's normal shader.
+ * Both do the same math: a weighted sum of the bone matrices applied to the position, normal and tangent.
+ */
+class Skinning {
+public:
+	enum backend_t {
+		GPU_SKINNING,
+		CPU_SKINNING
+	};
+
+	//Must be set before any model is loaded, CPU_SKINNING needs the bind pose kept in memory
+	static backend_t backend;
+
+	//Bind pose of a skinned mesh for CPU_SKINNING
+	struct source_t {
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec4> tangents; //w is the sign of the bitangent
+		std::vector<uint8_t> bones; //SKIN_BONES_PER_VERTEX per vertex
+		std::vector<float> weights; //SKIN_BONES_PER_VERTEX per vertex
+		std::vector<unsigned int> indices;
+	};
+
+	//Output of CPU_SKINNING
+	struct vertex_t {
+		glm::vec3 position;
+		glm::vec2 uv;
+		glm::vec3 normal;
+		glm::vec4 tangent;
+	};
+
+	//Enables and sets up attributes 0-3 for the bound array buffer of vertex_t
+	static void set_attrib_pointers();
+
+	//Skins vertices [begin, end) of src into dst (indexed the same as src)
+	static void skin(const source_t &src, const glm::mat4 * palette, vertex_t * dst, unsigned int begin, unsigned int end);
+	//Same without AVX or SSE, written the same way as the shader
+	static void skin_reference(const source_t &src, const glm::mat4 * palette, vertex_t * dst, unsigned int begin, unsigned int end);
+
+	//Largest difference in position, normal or tangent between skin() and skin_reference()
+	static float compare(const source_t &src, const glm::mat4 * palette);
+
+	//Uploads the palette for GPU_SKINNING
+	static void upload_palette(const glm::mat4 * palette, unsigned int count);
+};
+
+#endif
@@ -3,6 +3,9 @@
 #include "renderer.h"
 #include "mesh.h"
 #include "util.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "render_device.h"
 
 #include <SDL/SDL.h>
 #include <SDL/SDL_image.h>
@@ -30,25 +33,23 @@ void Terrain::init_terrain(Renderer * renderer) {
 
 	Renderer::checkForGLErrors("Terrain::init() load shader uniforms");
 	
-	glUseProgram(renderer->shaders[Renderer::TERRAIN_SHADER].program);
-	glUniform1i(renderer->shaders[Renderer::TERRAIN_SHADER].uniform["specular_map"], 2);
+	GLState::use_program(renderer->shaders[Renderer::TERRAIN_SHADER].program);
+	render_device()->uniform_1i(renderer->shaders[Renderer::TERRAIN_SHADER].uniform["specular_map"], 2);
 
-	glSamplerParameteri(renderer->shaders[Renderer::TERRAIN_SHADER].texture_array1, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glSamplerParameteri(renderer->shaders[Renderer::TERRAIN_SHADER].texture_array1, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	//glSamplerParameteri(renderer->shaders[Renderer::TERRAIN_SHADER].texture_array1, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glSamplerParameterf(renderer->shaders[Renderer::TERRAIN_SHADER].texture_array1, GL_TEXTURE_MAX_ANISOTROPY_EXT, 4.0f);
+	render_device()->sampler_parameter_i(renderer->shaders[Renderer::TERRAIN_SHADER].texture_array1, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	render_device()->sampler_parameter_i(renderer->shaders[Renderer::TERRAIN_SHADER].texture_array1, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	//render_device()->sampler_parameter_i(renderer->shaders[Renderer::TERRAIN_SHADER].texture_array1, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	render_device()->sampler_parameter_f(renderer->shaders[Renderer::TERRAIN_SHADER].texture_array1, GL_TEXTURE_MAX_ANISOTROPY_EXT, 4.0f);
 
 	Renderer::checkForGLErrors("Terrain::init() set terrain data");
 	//Set wave data:
 	Shader &water_shader = renderer->shaders[Renderer::WATER_SHADER];
 
-	glUseProgram(water_shader.program);
+	GLState::use_program(water_shader.program);
 
-	glSamplerParameteri(water_shader.texture1, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glSamplerParameteri(water_shader.texture1, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-	glSamplerParameterf(water_shader.texture1, GL_TEXTURE_MAX_ANISOTROPY_EXT, 4.0f);
-
-	glUseProgram(0);
+	render_device()->sampler_parameter_i(water_shader.texture1, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	render_device()->sampler_parameter_i(water_shader.texture1, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+	render_device()->sampler_parameter_f(water_shader.texture1, GL_TEXTURE_MAX_ANISOTROPY_EXT, 4.0f);
 }
 
 Terrain::~Terrain() {
@@ -197,16 +198,15 @@ texture_pack_t  * Terrain::generate_texture_pack(std::string folder, std::vector
 	tp->texture = new Texture(textures, false);
 	tp->normal_map = new Texture(normal, false);
 	tp->specular_map =  new Texture(specular, false);
-	tp->texture->bind();
-	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	tp->normal_map->bind();
-	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	tp->specular_map->bind();
-	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	tp->specular_map->unbind();
+	tp->texture->bind(0);
+	render_device()->tex_parameter_i(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	render_device()->tex_parameter_i(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	tp->normal_map->bind(0);
+	render_device()->tex_parameter_i(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	render_device()->tex_parameter_i(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	tp->specular_map->bind(0);
+	render_device()->tex_parameter_i(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	render_device()->tex_parameter_i(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	return tp;
 }
 
@@ -336,12 +336,15 @@ SDL_Surface * Terrain::load_image(glm::vec2 size) {
 }
 
 void Terrain::render(double dt, Renderer * renderer) {
+	PROFILE_SCOPE("Terrain::render");
+	PROFILE_GPU("terrain");
 	time_+=dt;
 
-	glUseProgram(renderer->shaders[Renderer::TERRAIN_SHADER].program);
+	GLState::use_program(renderer->shaders[Renderer::TERRAIN_SHADER].program);
+	GLState::depth_mask(true);
 
-	glUniform1f(renderer->shaders[Renderer::TERRAIN_SHADER].uniform["vertical_scale"], vertical_scale_);
-	glUniform1f(renderer->shaders[Renderer::TERRAIN_SHADER].uniform["start_height"], start_height);
+	render_device()->uniform_1f(renderer->shaders[Renderer::TERRAIN_SHADER].uniform["vertical_scale"], vertical_scale_);
+	render_device()->uniform_1f(renderer->shaders[Renderer::TERRAIN_SHADER].uniform["start_height"], start_height);
 
 
 	renderer->modelMatrix.Push();
@@ -352,35 +355,28 @@ void Terrain::render(double dt, Renderer * renderer) {
 
 	textures_->bind();
 	terrain_mesh_->render();
-	textures_->unbind();
 
-	glUseProgram(renderer->shaders[Renderer::WATER_SHADER].program);
-	glUniform1f(renderer->shaders[Renderer::WATER_SHADER].uniform["time"], time_);
-	glUniform1f(renderer->shaders[Renderer::WATER_SHADER].uniform["water_height"], water_level_);
-	glUniform2fv(renderer->shaders[Renderer::WATER_SHADER].uniform["wave1"], 1, glm::value_ptr(wave1));
-	glUniform2fv(renderer->shaders[Renderer::WATER_SHADER].uniform["wave2"], 1, glm::value_ptr(wave2));
+	GLState::use_program(renderer->shaders[Renderer::WATER_SHADER].program);
+	render_device()->uniform_1f(renderer->shaders[Renderer::WATER_SHADER].uniform["time"], time_);
+	render_device()->uniform_1f(renderer->shaders[Renderer::WATER_SHADER].uniform["water_height"], water_level_);
+	render_device()->uniform_2fv(renderer->shaders[Renderer::WATER_SHADER].uniform["wave1"], 1, glm::value_ptr(wave1));
+	render_device()->uniform_2fv(renderer->shaders[Renderer::WATER_SHADER].uniform["wave2"], 1, glm::value_ptr(wave2));
 
 
-	glActiveTexture(GL_TEXTURE0);
-	water_normal_map_->bind();
+	water_normal_map_->bind(0);
 
 	water_mesh_->render();
 
 	Renderer::checkForGLErrors("Render water ");
 
-	water_normal_map_->unbind();
-
 #if RENDER_DEBUG
 	//Render debug:
-	glLineWidth(2.0f);
-	glUseProgram(renderer->shaders[Renderer::DEBUG_SHADER].program);
+	render_device()->line_width(2.0f);
+	GLState::use_program(renderer->shaders[Renderer::DEBUG_SHADER].program);
 
 
 	terrain_mesh_->render();
 #endif
 
 	renderer->modelMatrix.Pop();
-
-
-	glUseProgram(0);
 }
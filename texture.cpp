@@ -1,10 +1,15 @@
 #include "renderer.h"
 #include "texture.h"
+#include "gl_state.h"
+#include "render_device.h"
 
 #include <glimg/glimg.h>
 #include <vector>
 #include <string>
+#include <map>
 #include <cassert>
+#include <climits>
+#include <cstdlib>
 
 GLuint Texture::cube_map_index_[6] = {
 	GL_TEXTURE_CUBE_MAP_POSITIVE_X,
@@ -15,12 +20,41 @@ GLuint Texture::cube_map_index_[6] = {
 	GL_TEXTURE_CUBE_MAP_NEGATIVE_Z 
 };
 
+std::map<std::string, Texture*> Texture::loaded_textures_;
+
+Texture * Texture::acquire(const std::string &path) {
+	//Key on the canonical path so different paths to the same file share the texture
+	char resolved[PATH_MAX];
+	std::string key = (realpath(path.c_str(), resolved) != NULL) ? std::string(resolved) : path;
+
+	std::map<std::string, Texture*>::iterator it = loaded_textures_.find(key);
+	if(it != loaded_textures_.end()) {
+		++it->second->_ref_count;
+		return it->second;
+	}
+
+	Texture * texture = new Texture(path);
+	texture->_key = key;
+	texture->_ref_count = 1;
+	loaded_textures_[key] = texture;
+	return texture;
+}
+
+void Texture::release(Texture * texture) {
+	assert(texture->_ref_count > 0);
+	if(--texture->_ref_count == 0) {
+		loaded_textures_.erase(texture->_key);
+		delete texture;
+	}
+}
+
 Texture::Texture(const std::string &path) :
 	_texture(-1),
 	_width(0),
 	_height(0),
 	_num_textures(1),
-	_mipmap_count(1)
+	_mipmap_count(1),
+	_ref_count(0)
 	{
 	_filenames = new std::string[_num_textures];
 	_filenames[0] = path;
@@ -32,7 +66,8 @@ Texture::Texture(const std::vector<std::string> &paths, bool cube_map) :
 	_texture(-1),
 	_width(0),
 	_height(0),
-	_num_textures(paths.size())
+	_num_textures(paths.size()),
+	_ref_count(0)
 	{
 	if(cube_map) {
 		assert(_num_textures == 6);
@@ -60,16 +95,11 @@ int Texture::height() const {
 	return _height;
 }
 
-void Texture::bind() const {
+bool Texture::bind(unsigned int unit) const {
 	assert(_texture != (unsigned int)-1);
-	glBindTexture(_texture_type, _texture);
-	char tmp[256];
-	sprintf(tmp, "Texture(%s,...)::bind()", _filenames[0].c_str());
-	Renderer::checkForGLErrors(tmp);
-}
-
-void Texture::unbind() const {
-	glBindTexture(_texture_type, 0);
+	bool bound = GLState::bind_texture(unit, _texture_type, _texture);
+	GLState::active_texture(unit);
+	return bound;
 }
 
 GLuint Texture::texture() const {
@@ -87,10 +117,11 @@ void Texture::load_texture() {
 	_height = images[0]->GetDimensions().height;
 
 	//Generate texture:
-	glGenTextures(1, &_texture);
-	bind();	
-	glTexParameteri(_texture_type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(_texture_type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	render_device()->gen_textures(1, &_texture);
+	bind(0);
+	GLValidation::label(GL_TEXTURE, _texture, _filenames[0]);
+	render_device()->tex_parameter_i(_texture_type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	render_device()->tex_parameter_i(_texture_type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	Renderer::checkForGLErrors("load_texture(): gen buffer");
 
 	glimg::OpenGLPixelTransferParams fmt;
@@ -98,7 +129,7 @@ void Texture::load_texture() {
 	switch(_texture_type) {
 		case GL_TEXTURE_2D:
 			//One texture only:
-			glPixelStorei(GL_UNPACK_ALIGNMENT, images[0]->GetFormat().LineAlign());
+			render_device()->pixel_store_i(GL_UNPACK_ALIGNMENT, images[0]->GetFormat().LineAlign());
 
 			_mipmap_count = images[0]->GetMipmapCount();
 
@@ -106,7 +137,7 @@ void Texture::load_texture() {
 				const glimg::SingleImage &img = images[0]->GetImage(mipmap_lvl, 0, 0);
 				const glimg::Dimensions &dim = img.GetDimensions();
 				fmt = glimg::GetUploadFormatType(img.GetFormat(), 0); 
-				glTexImage2D(GL_TEXTURE_2D, mipmap_lvl, GL_RGBA, dim.width, dim.height, 
+				render_device()->tex_image_2d(GL_TEXTURE_2D, mipmap_lvl, GL_RGBA, dim.width, dim.height, 
 					0, fmt.format, fmt.type, img.GetImageData() );
 			}
 			Renderer::checkForGLErrors("load_texture(): write GL_TEXTURE_2D data");
@@ -114,7 +145,7 @@ void Texture::load_texture() {
 		case GL_TEXTURE_2D_ARRAY:
 			 fmt = glimg::GetUploadFormatType(images[0]->GetFormat(), 0); 
 			//Generate the array:
-			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, _width, _height,
+			render_device()->tex_image_3d(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, _width, _height,
 				_num_textures, 0,   fmt.format,  fmt.type, NULL);
 			Renderer::checkForGLErrors("load_texture(): gen 2d array buffer");
 
@@ -123,7 +154,7 @@ void Texture::load_texture() {
 			//Fill the array with data:
 			for(unsigned int i=0; i < _num_textures; ++i) {
 				//											, lvl, x, y, z, width, height, depth
-				glPixelStorei(GL_UNPACK_ALIGNMENT, images[i]->GetFormat().LineAlign());
+				render_device()->pixel_store_i(GL_UNPACK_ALIGNMENT, images[i]->GetFormat().LineAlign());
 				if(_mipmap_count > images[i]->GetMipmapCount())
 					_mipmap_count = images[i]->GetMipmapCount(); //Find smallest value
 
@@ -131,7 +162,7 @@ void Texture::load_texture() {
 					const glimg::SingleImage &img = images[i]->GetImage(mipmap_lvl, 0, 0);
 					const glimg::Dimensions &dim = img.GetDimensions();
 					fmt = glimg::GetUploadFormatType(img.GetFormat(), 0); 
-					glTexSubImage3D(GL_TEXTURE_2D_ARRAY, mipmap_lvl, 0, 0, i, dim.width, dim.height, 1, fmt.format,  fmt.type,
+					render_device()->tex_sub_image_3d(GL_TEXTURE_2D_ARRAY, mipmap_lvl, 0, 0, i, dim.width, dim.height, 1, fmt.format,  fmt.type,
 						img.GetImageData());
 				}
 			}
@@ -140,9 +171,9 @@ void Texture::load_texture() {
 			set_clamp_params();
 			for(int i=0; i < 6; ++i) {
 				fmt = glimg::GetUploadFormatType(images[i]->GetFormat(), 0); 
-				glPixelStorei(GL_UNPACK_ALIGNMENT, images[i]->GetFormat().LineAlign());
+				render_device()->pixel_store_i(GL_UNPACK_ALIGNMENT, images[i]->GetFormat().LineAlign());
 				assert(_width == _height);
-				glTexImage2D(cube_map_index_[i], 0, GL_RGBA , _width, _height, 0, fmt.format, fmt.type, images[i]->GetImageArray(0) );
+				render_device()->tex_image_2d(cube_map_index_[i], 0, GL_RGBA , _width, _height, 0, fmt.format, fmt.type, images[i]->GetImageArray(0) );
 				Renderer::checkForGLErrors("load_texture(): Fill cube map");
 			}
 			break;
@@ -152,12 +183,10 @@ void Texture::load_texture() {
 	}
 
 	/*if(_mipmap_count > 0) {
-		glTexParameteri(_texture_type, GL_TEXTURE_BASE_LEVEL, 0);
-		glTexParameteri(_texture_type, GL_TEXTURE_MAX_LEVEL, _mipmap_count - 1);
+		render_device()->tex_parameter_i(_texture_type, GL_TEXTURE_BASE_LEVEL, 0);
+		render_device()->tex_parameter_i(_texture_type, GL_TEXTURE_MAX_LEVEL, _mipmap_count - 1);
 	}*/
 
-	unbind();
-
 	//Free images:
 	for(unsigned int i=0; i<_num_textures; ++i) {
 		delete images[i];
@@ -167,11 +196,11 @@ void Texture::load_texture() {
 
 //Requires the texture to be bound!
 void Texture::set_clamp_params() {
-	glTexParameteri(_texture_type, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(_texture_type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(_texture_type, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(_texture_type, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(_texture_type, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	render_device()->tex_parameter_i(_texture_type, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	render_device()->tex_parameter_i(_texture_type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	render_device()->tex_parameter_i(_texture_type, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	render_device()->tex_parameter_i(_texture_type, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	render_device()->tex_parameter_i(_texture_type, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 }
 
 glimg::ImageSet * Texture::load_image(const std::string &path) {
@@ -186,7 +215,7 @@ glimg::ImageSet * Texture::load_image(const std::string &path) {
 
 void Texture::free_texture(){
 	if(_texture != (unsigned int)-1) {
-		glDeleteTextures(1, &_texture);
+		GLState::delete_texture(_texture);
 		_texture = -1;
 	}
 }
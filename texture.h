@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <glload/gl_3_3.h>
 #include <glimg/glimg.h>
 
@@ -23,11 +24,18 @@ class Texture  {
 		Texture(const std::vector<std::string> &paths, bool cube_map=false);
 		~Texture();
 
+		/*
+		 * Returns the shared single texture for path, loading it if it isn't loaded yet.
+		 * Every acquire must be matched by a release.
+		 */
+		static Texture * acquire(const std::string &path);
+		static void release(Texture * texture);
+
 		int width() const;
 		int height() const;
 
-		void bind() const;
-		void unbind() const;
+		//Binds the texture to texture unit unit (0 for GL_TEXTURE0) and makes it the active unit, false if it already was bound
+		bool bind(unsigned int unit) const;
 
 		//Get texture number on open gl
 		GLuint texture() const; 
@@ -58,7 +66,12 @@ class Texture  {
 		unsigned int _mipmap_count;
 		GLuint _texture_type;
 
+		//Set for textures shared with acquire()
+		std::string _key;
+		unsigned int _ref_count;
+
 		static GLuint cube_map_index_[6];
+		static std::map<std::string, Texture*> loaded_textures_;
 };
 
 struct texture_pack_t {
@@ -76,23 +89,9 @@ struct texture_pack_t {
 	};
 
 	void bind() {
-		glActiveTexture(GL_TEXTURE0);
-		texture->bind();
-		glActiveTexture(GL_TEXTURE1);
-		normal_map->bind();
-		glActiveTexture(GL_TEXTURE2);
-		specular_map->bind();
-		glActiveTexture(GL_TEXTURE0);
-	};
-
-	void unbind() {
-		glActiveTexture(GL_TEXTURE0);
-		texture->unbind();
-		glActiveTexture(GL_TEXTURE1);
-		normal_map->unbind();
-		glActiveTexture(GL_TEXTURE2);
-		specular_map->unbind();
-		glActiveTexture(GL_TEXTURE0);
+		texture->bind(0);
+		normal_map->bind(1);
+		specular_map->bind(2);
 	};
 };
 
@@ -0,0 +1,91 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int num_threads) :
+	stop_(false),
+	func_(NULL),
+	count_(0),
+	range_size_(1),
+	next_(0),
+	running_(0),
+	generation_(0) {
+
+	if(num_threads == 0) {
+		unsigned int cores = std::thread::hardware_concurrency();
+		num_threads = (cores > 1) ? cores - 1 : 0;
+	}
+
+	for(unsigned int i=0; i < num_threads; ++i) {
+		threads_.push_back(std::thread(&ThreadPool::worker, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	work_available_.notify_all();
+
+	for(std::vector<std::thread>::iterator it=threads_.begin(); it!=threads_.end(); ++it) {
+		it->join();
+	}
+}
+
+void ThreadPool::parallel_for(unsigned int count, unsigned int min_range, const range_func_t &func) {
+	if(count == 0)
+		return;
+
+	//Not worth waking anyone up
+	if(threads_.empty() || count <= min_range) {
+		func(0, count);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	func_ = &func;
+	count_ = count;
+	//A few ranges per thread evens out ranges that take longer than others
+	range_size_ = std::max(min_range, count / (4*num_threads()) + 1);
+	next_ = 0;
+	running_ = 0;
+	++generation_;
+	work_available_.notify_all();
+
+	run_ranges(lock);
+	while(running_ > 0) {
+		work_done_.wait(lock);
+	}
+	func_ = NULL;
+}
+
+void ThreadPool::run_ranges(std::unique_lock<std::mutex> &lock) {
+	while(next_ < count_) {
+		unsigned int begin = next_;
+		unsigned int end = std::min(begin + range_size_, count_);
+		next_ = end;
+		++running_;
+
+		lock.unlock();
+		(*func_)(begin, end);
+		lock.lock();
+
+		if(--running_ == 0 && next_ >= count_)
+			work_done_.notify_all();
+	}
+}
+
+void ThreadPool::worker() {
+	unsigned int seen_generation = 0;
+	std::unique_lock<std::mutex> lock(mutex_);
+	while(true) {
+		while(!stop_ && (generation_ == seen_generation || func_ == NULL)) {
+			work_available_.wait(lock);
+		}
+		if(stop_)
+			return;
+		seen_generation = generation_;
+		run_ranges(lock);
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/*
+ * Worker threads for splitting per frame work (skinning, animation) over all cores.
+ *
+ * parallel_for blocks until all work is done, the calling thread takes part in the work.
+ * Only one parallel_for may run at a time.
+ */
+class ThreadPool {
+public:
+	//Called with a range [begin, end)
+	typedef std::function<void(unsigned int begin, unsigned int end)> range_func_t;
+
+	//num_threads=0 uses one thread less than the number of cores (the caller is the last one)
+	ThreadPool(unsigned int num_threads=0);
+	~ThreadPool();
+
+	//Splits [0, count) in ranges of at least min_range items and calls func for each range
+	void parallel_for(unsigned int count, unsigned int min_range, const range_func_t &func);
+
+	//Number of threads working in parallel_for, including the caller
+	unsigned int num_threads() const { return threads_.size() + 1; };
+
+private:
+	//Copy not allowed (no body implemented, intentional!)
+	ThreadPool(const ThreadPool &other);
+
+	void worker();
+	//Runs ranges of the current job until there are none left, must be called with mutex_ locked
+	void run_ranges(std::unique_lock<std::mutex> &lock);
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable work_available_;
+	std::condition_variable work_done_;
+	bool stop_;
+
+	//The current job
+	const range_func_t * func_;
+	unsigned int count_, range_size_;
+	unsigned int next_; //Start of the next range to hand out
+	unsigned int running_; //Ranges handed out but not finished
+	unsigned int generation_; //Increased for each job so workers wake up once per job
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "uniform_ring.h"
+#include "renderer.h"
+#include "gl_state.h"
+#include "render_device.h"
+
+#include <cstdio>
+
+//ARB_buffer_storage is newer than the 3.3 headers
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+UniformRing::UniformRing(size_t frame_bytes) :
+	frame_(0),
+	used_(0),
+	persistent_(NULL),
+	mapped_(false),
+	fence_waits_(0) {
+
+	GLint alignment;
+	render_device()->get_integer_v(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment_ = (alignment > 0) ? alignment : 256;
+	frame_bytes_ = aligned_size(frame_bytes);
+
+	for(int i=0; i < UNIFORM_RING_FRAMES; ++i) {
+		fences_[i] = 0;
+	}
+
+	render_device()->gen_buffers(1, &buffer_);
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, buffer_);
+	GLValidation::label(GL_BUFFER, buffer_, "UniformRing");
+
+	size_t size = frame_bytes_*UNIFORM_RING_FRAMES;
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	bool storage = Renderer::has_extension("GL_ARB_buffer_storage") && render_device()->buffer_storage(GL_UNIFORM_BUFFER, size, NULL, flags);
+	if(storage) {
+		persistent_ = (char*) render_device()->map_buffer_range(GL_UNIFORM_BUFFER, 0, size, flags);
+		if(persistent_ == NULL)
+			fprintf(stderr, "UniformRing: Failed to map persistent buffer, mapping per frame\n");
+	}
+	if(persistent_ == NULL && !storage)
+		render_device()->buffer_data(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+	Renderer::checkForGLErrors("UniformRing::UniformRing()");
+}
+
+UniformRing::~UniformRing() {
+	for(int i=0; i < UNIFORM_RING_FRAMES; ++i) {
+		if(fences_[i] != 0)
+			render_device()->delete_sync(fences_[i]);
+	}
+	if(persistent_ != NULL) {
+		GLState::bind_buffer(GL_UNIFORM_BUFFER, buffer_);
+		render_device()->unmap_buffer(GL_UNIFORM_BUFFER);
+	}
+	GLState::delete_buffer(buffer_);
+}
+
+void UniformRing::begin_frame() {
+	frame_ = (frame_ + 1) % UNIFORM_RING_FRAMES;
+	used_ = 0;
+
+	GLsync fence = fences_[frame_];
+	if(fence == 0)
+		return;
+
+	GLenum result = render_device()->client_wait_sync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if(result == GL_TIMEOUT_EXPIRED) {
+		++fence_waits_;
+		do {
+			result = render_device()->client_wait_sync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UNIFORM_RING_WAIT_NS);
+		} while(result == GL_TIMEOUT_EXPIRED);
+	}
+	if(result == GL_WAIT_FAILED)
+		fprintf(stderr, "UniformRing: Waiting for fence failed\n");
+
+	render_device()->delete_sync(fence);
+	fences_[frame_] = 0;
+}
+
+void UniformRing::end_frame() {
+	if(used_ > 0)
+		fences_[frame_] = render_device()->fence_sync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+size_t UniformRing::aligned_size(size_t size) const {
+	return (size + alignment_ - 1) / alignment_ * alignment_;
+}
+
+void * UniformRing::map(size_t size, size_t &offset) {
+	size = aligned_size(size);
+	if(size == 0 || used_ + size > frame_bytes_)
+		return NULL;
+
+	offset = frame_*frame_bytes_ + used_;
+	used_ += size;
+
+	if(persistent_ != NULL)
+		return persistent_ + offset;
+
+	//The fence in begin_frame() has made sure the gpu is done with this range
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, buffer_);
+	void * ptr = render_device()->map_buffer_range(GL_UNIFORM_BUFFER, offset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	mapped_ = (ptr != NULL);
+	return ptr;
+}
+
+void UniformRing::unmap() {
+	if(!mapped_)
+		return;
+
+	GLState::bind_buffer(GL_UNIFORM_BUFFER, buffer_);
+	render_device()->unmap_buffer(GL_UNIFORM_BUFFER);
+	mapped_ = false;
+}
@@ -0,0 +1,70 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <cstddef>
+#include <glload/gl_3_3.h>
+
+//Frames the gpu may be behind the cpu before begin_frame() waits
+#define UNIFORM_RING_FRAMES 3
+
+//Bytes available to each frame, 16384 draws of the Matrices block or 32768 instances
+#define UNIFORM_RING_FRAME_BYTES (4*1024*1024)
+
+//Nanoseconds to wait for a fence at a time
+#define UNIFORM_RING_WAIT_NS 1000000
+
+/*
+ * A uniform buffer split in UNIFORM_RING_FRAMES parts, each frame writes its per draw data
+ * to the next part and the draws select their range with glBindBufferRange.
+ * The buffer can be bound to other targets too, the render queue reads instance attributes from it.
+ *
+ * With ARB_buffer_storage the buffer is mapped once (persistent and coherent),
+ * otherwise each write maps its range unsynchronized. Either way no synchronization with
+ * the driver happens while writing: begin_frame() waits on the fence end_frame() set
+ * the last time the part was used.
+ *
+ * All functions must be called from the GL thread.
+ */
+class UniformRing {
+public:
+	UniformRing(size_t frame_bytes=UNIFORM_RING_FRAME_BYTES);
+	~UniformRing();
+
+	void begin_frame();
+	void end_frame();
+
+	//size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, ranges at multiples of this can be bound
+	size_t aligned_size(size_t size) const;
+
+	/*
+	 * Returns size bytes of this frame's part to write to and sets offset to where they are in buffer().
+	 * Returns NULL if the part is full. Call unmap() when done writing, before drawing.
+	 */
+	void * map(size_t size, size_t &offset);
+	void unmap();
+
+	GLuint buffer() const { return buffer_; };
+	bool persistent() const { return persistent_ != NULL; };
+
+	//Times begin_frame() had to wait for the gpu, since construction
+	unsigned int fence_waits() const { return fence_waits_; };
+
+private:
+	//Copy not allowed (no body implemented, intentional!)
+	UniformRing(const UniformRing &other);
+
+	GLuint buffer_;
+	size_t frame_bytes_;
+	size_t alignment_;
+
+	unsigned int frame_; //Part used this frame
+	size_t used_; //Bytes used in it
+	GLsync fences_[UNIFORM_RING_FRAMES];
+
+	char * persistent_; //Mapping of the whole buffer, NULL without ARB_buffer_storage
+	bool mapped_;
+
+	unsigned int fence_waits_;
+};
+
+#endif
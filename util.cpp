@@ -33,7 +33,21 @@ float uniformRandomInRange(float min, float max) {
     return v;
 }
 
+static bool fixed_seed = false;
+static unsigned int next_seed = 0;
+
+void fix_random_seed(unsigned int seed) {
+	fixed_seed = true;
+	next_seed = seed;
+	srand(next_seed++);
+}
+
 void seed_random() {
+	if(fixed_seed) {
+		srand(next_seed++);
+		return;
+	}
+
 	struct timeval ts;
 	gettimeofday(&ts, NULL);
 
@@ -42,3 +56,9 @@ void seed_random() {
     t += ts.tv_usec;
 	 srand(t);
 }
+
+double monotonic_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1000000000.0;
+}
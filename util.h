@@ -23,4 +23,9 @@ inline float frand() {
 }
 
 void seed_random();
+//Seeds rand() with seed, and makes every later seed_random() pick the next seed instead of the time so runs repeat
+void fix_random_seed(unsigned int seed);
+
+//Seconds from an arbitrary start, not affected by changes to the system clock
+double monotonic_seconds();
 #endif
@@ -5,14 +5,20 @@
 
 #include "terrain.h"
 #include "particle_system.h"
+#include "util.h"
+#include "profiler.h"
+#include "render_device.h"
 
 #include <assimp/aiPostProcess.h>
 #include <cstdio>
+#include <cmath>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 
 Light * lights_lights[NUM_LIGHTS]; //The actual lights
 RenderObject * lights_ro[NUM_LIGHTS];
+bool lights_colored[NUM_LIGHTS]; //The materials of lights_ro exist once loaded
 MoveGroup lights[NUM_LIGHTS];
 Terrain * t;
 
@@ -74,10 +80,9 @@ ParticleSystem::ParticleSystem(
 
 	Texture * water = new Texture("valley/water.dds");
 
-	water->bind();
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	water->unbind();
+	water->bind(0);
+	render_device()->tex_parameter_i(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	render_device()->tex_parameter_i(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	Renderer::checkForGLErrors("water params");
 
 	t = new Terrain ("valley",1.f, 200.f, 0.3f, terrain_textures, water, glm::vec2(0,0), glm::vec2(0, 0));
@@ -115,8 +120,8 @@ ParticleSystem::ParticleSystem(
 #endif
 
 	for(int i=0; i < NUM_LIGHTS; ++i) {
-		lights_ro[i] = new RenderObject("models/cube.obj", Renderer::NORMAL_SHADER);	
-		lights_lights[i]->set_id_in_render_object(lights_ro[i], i, true);
+		lights_ro[i] = new RenderObject("models/cube.obj", Renderer::NORMAL_SHADER, true, 0, renderer->model_loader);
+		lights_colored[i] = false;
 		lights_ro[i]->scale*=0.25f;
 		lights[i].add_object(lights_lights[i]);
 		lights[i].add_object(lights_ro[i]);
@@ -158,7 +163,71 @@ ParticleSystem::ParticleSystem(
 	
 }
 
+void create_stress_scene(Renderer * renderer, unsigned int instances) {
+	RenderObject * cubes = new RenderObject("models/cube.obj", Renderer::NORMAL_SHADER, true, 0, renderer->model_loader);
+	cubes->set_position(glm::vec3(0.0, -5.0, 0.0));
+
+	unsigned int side = (unsigned int)ceil(sqrt((float)instances));
+	const float spacing = 1.5f;
+	for(unsigned int i=0; i < instances; ++i) {
+		glm::vec3 position((i % side) * spacing, 0.f, (i / side) * spacing);
+		position -= glm::vec3(side * spacing * 0.5f, 0.f, side * spacing * 0.5f);
+
+		glm::mat4 transform = glm::translate(glm::mat4(1.f), position);
+		transform = glm::rotate(transform, frand() * 360.f, glm::vec3(0.f, 1.f, 0.f));
+		transform = glm::scale(transform, glm::vec3(0.5f + 0.5f * frand()));
+
+		cubes->instances.push_back(RenderObject::instance_t(transform, glm::vec4(frand(), frand(), frand(), 1.f)));
+	}
+
+	renderer->render_objects.push_back(cubes);
+	printf("Stress scene: %u instances\n", instances);
+}
+
+void create_draw_bench_scene(Renderer * renderer, unsigned int objects) {
+	renderer->camera.set_position(glm::vec3(0.0, 20.0, 0.0));
+
+	unsigned int side = (unsigned int)ceil(sqrt((float)objects));
+	for(unsigned int i=0; i < objects; ++i) {
+		RenderObject * cube = new RenderObject("models/cube.obj", Renderer::NORMAL_SHADER, true, 0, renderer->model_loader);
+		cube->set_position(glm::vec3((i % side) - side * 0.5f, 0.f, (i / side) - side * 0.5f));
+		cube->scale *= 0.4f;
+		cube->tint = glm::vec4(frand(), frand(), frand(), 1.f);
+		renderer->render_objects.push_back(cube);
+	}
+}
+
+RenderObject * skin_test_rig = NULL;
+bool skin_test_posed = false;
+
+void create_skinning_scene(Renderer * renderer) {
+	skin_test_rig = new RenderObject(SKIN_TEST_MODEL, Renderer::NORMAL_SHADER, true, 0, renderer->model_loader);
+	skin_test_rig->set_position(glm::vec3(0.0, 0.0, 2.0));
+	skin_test_rig->scale *= 1.5f;
+	renderer->render_objects.push_back(skin_test_rig);
+
+	Light * light = new Light(glm::vec3(0.8, 0.8, 0.8), glm::vec3(0.0, 2.0, 0.0), Light::POINT_LIGHT);
+	light->set_half_light_distance(10.f);
+	renderer->lights.push_back(light);
+}
+
+void update_skinning_scene(double dt, Renderer * renderer) {
+	if(skin_test_posed)
+		return;
+	if(skin_test_rig->failed()) {
+		fprintf(stderr, "%s failed to load, nothing to compare\n", SKIN_TEST_MODEL);
+		skin_test_posed = true;
+		return;
+	}
+	if(!skin_test_rig->ready())
+		return;
+	if(!skin_test_rig->start_animation(0, SKIN_TEST_FRAME, -1, RenderObject::ANIM_LOOP))
+		fprintf(stderr, "%s has no animation, only the bind pose is compared\n", SKIN_TEST_MODEL);
+	skin_test_posed = true;
+}
+
 void update_world(double dt, Renderer * renderer) {
+	PROFILE_SCOPE("update_world");
 	/*if(renderer->camera.position().y < (t->matrix()*glm::vec4(0.0, t->water_level(), 0.0, 1.f)).y)
 		underwater->enabled = true;
 	else
@@ -167,6 +236,13 @@ void update_world(double dt, Renderer * renderer) {
 	particles->update(dt);
 	//underwater->update(dt);
 
+	for(int i=0; i < NUM_LIGHTS; ++i) {
+		if(!lights_colored[i] && lights_ro[i]->ready()) {
+			lights_lights[i]->set_id_in_render_object(lights_ro[i], i, true);
+			lights_colored[i] = true;
+		}
+	}
+
 	time_of_day+=dt/time_per_hour;
 	time_of_day = fmod(time_of_day, 24.f);
 	
@@ -8,6 +8,16 @@
 
 	#define NUM_LIGHTS 1
 
+	//Instances in the scene added by create_stress_scene
+	#define STRESS_INSTANCES 10000
+
+	//Objects in the scene made by create_draw_bench_scene
+	#define DRAW_BENCH_OBJECTS 4096
+
+	//Rigged model posed by create_skinning_scene, and the frame of its first animation it starts at
+	#define SKIN_TEST_MODEL "models/Sonic Heroes Model-Rigged.blend"
+	#define SKIN_TEST_FRAME 10
+
 	enum {
 		LIGHT_SOURCE0,
 		LIGHT_SOURCE1,
@@ -20,5 +30,16 @@
 
 
 	void create_world(Renderer * renderer);
+	//A grid of instanced cubes with random tints, to test the renderer with many objects
+	void create_stress_scene(Renderer * renderer, unsigned int instances=STRESS_INSTANCES);
+	//A grid of separate cubes sharing mesh and material, the only thing drawn by --draw-bench
+	void create_draw_bench_scene(Renderer * renderer, unsigned int objects=DRAW_BENCH_OBJECTS);
+	/*
+	 * The rigged SKIN_TEST_MODEL in front of the camera and one light, the only thing drawn by --skin-test.
+	 * Rendered with each skinning back end, the frames must match.
+	 */
+	void create_skinning_scene(Renderer * renderer);
+	//Starts the rig's animation once it has loaded, instead of update_world
+	void update_skinning_scene(double dt, Renderer * renderer);
 	void update_world(double dt, Renderer * renderer);
 #endif